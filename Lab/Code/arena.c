@@ -0,0 +1,87 @@
+#include "arena.h"
+
+#include "stdlib.h"
+#include "string.h"
+
+static ArenaBlock* ArenaBlock_Create(size_t size, ArenaBlock* next) {
+  ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+  block->next = next;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+void* Arena_Alloc(Arena* arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  ArenaBlock* block = arena->head;
+
+  if (!block || block->used + size > block->size) {
+    if (size > ARENA_BLOCK_SIZE / 4) {
+      // 大对象单独成块, 挂在当前块之后, 不浪费当前块的剩余空间
+      ArenaBlock* big = ArenaBlock_Create(size, block ? block->next : NULL);
+      if (block)
+        block->next = big;
+      else
+        arena->head = big;
+      big->used = size;
+      arena->bytes += size;
+      arena->blocks++;
+      return big->data;
+    }
+    if (arena->spare) {
+      ArenaBlock* next = arena->spare->next;
+      arena->spare->next = block;
+      arena->spare->used = 0;
+      block = arena->head = arena->spare;
+      arena->spare = next;
+    } else
+      block = arena->head = ArenaBlock_Create(ARENA_BLOCK_SIZE, block);
+    arena->blocks++;
+  }
+
+  void* ret = block->data + block->used;
+  block->used += size;
+  arena->bytes += size;
+  return ret;
+}
+
+char* Arena_Strdup(Arena* arena, const char* str) {
+  size_t len = strlen(str) + 1;
+  return memcpy(Arena_Alloc(arena, len), str, len);
+}
+
+void Arena_Reset(Arena* arena) {
+  // 标准块移入spare, 单独成块的大对象归还
+  ArenaBlock* block = arena->head;
+  while (block) {
+    ArenaBlock* next = block->next;
+    if (block->size == ARENA_BLOCK_SIZE) {
+      block->next = arena->spare;
+      arena->spare = block;
+    } else
+      free(block);
+    block = next;
+  }
+  arena->head = NULL;
+  arena->bytes = arena->blocks = 0;
+}
+
+void Arena_Release(Arena* arena) {
+  Arena_Reset(arena);
+  ArenaBlock* block = arena->spare;
+  while (block) {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->spare = NULL;
+}
+
+void Arena_Detach(Arena* arena, Arena* to) {
+  to->head = arena->head;
+  to->spare = NULL;
+  to->bytes = arena->bytes;
+  to->blocks = arena->blocks;
+  arena->head = NULL;
+  arena->bytes = arena->blocks = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "stddef.h"
+
+/*
+区域分配器(arena):
+-- 从大块内存中顺序切分(bump), 不支持单独释放
+-- Arena_Release一次性归还全部内存
+-- Arena_Reset清空后保留标准大小的块, 之后的分配先复用它们
+-- Arena_Detach把已分配的块整体移交给另一个区域, 由它单独释放
+*/
+
+#define ARENA_BLOCK_SIZE 0x10000
+#define ARENA_ALIGN 8
+
+typedef struct ArenaBlock ArenaBlock;
+typedef struct Arena Arena;
+
+struct ArenaBlock {
+  ArenaBlock* next;
+  size_t size, used;
+  char data[];
+};
+
+struct Arena {
+  ArenaBlock* head;
+  ArenaBlock* spare;  // Arena_Reset留下的空闲块
+  // 统计信息
+  size_t bytes, blocks;
+};
+
+extern void* Arena_Alloc(Arena* arena, size_t size);
+extern char* Arena_Strdup(Arena* arena, const char* str);
+extern void Arena_Reset(Arena* arena);
+extern void Arena_Release(Arena* arena);
+// 已分配的块移到to(须为空), arena从空开始继续分配, 空闲块仍留在arena
+extern void Arena_Detach(Arena* arena, Arena* to);
+
+#endif
@@ -0,0 +1,152 @@
+#include "callgraph.h"
+
+#include "assert.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "string.h"
+
+static unsigned Hash_Ptr(const char* name) {
+  return (unsigned)((uintptr_t)name >> 3) * 2654435761u;
+}
+
+int CallGraph_Find(const CallGraph* cg, const char* name) {
+  for (unsigned h = Hash_Ptr(name) & cg->mask;; h = (h + 1) & cg->mask) {
+    int k = cg->table[h];
+    if (k < 0 || cg->funcs[k]->name == name) return k;
+  }
+}
+
+static void Build_Table(CallGraph* cg) {
+  unsigned cap = 16;
+  while (cap < 2u * cg->nfunc) cap <<= 1;
+  cg->table = malloc(cap * sizeof(int));
+  cg->mask = cap - 1;
+  for (unsigned h = 0; h < cap; h++) cg->table[h] = -1;
+  for (int k = 0; k < cg->nfunc; k++) {
+    unsigned h = Hash_Ptr(cg->funcs[k]->name) & cg->mask;
+    while (cg->table[h] >= 0) h = (h + 1) & cg->mask;
+    cg->table[h] = k;
+  }
+}
+
+static void Build_Edges(CallGraph* cg) {
+  int n = cg->nfunc;
+  cg->first = calloc(n + 2, sizeof(int));
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 0; k < n; k++) {
+      const IRFunc* func = cg->funcs[k];
+      for (int i = 0; i < func->len; i++) {
+        if (func->code[i].op != IR_CALL) continue;
+        int c = CallGraph_Find(cg, func->code[i].y.name);
+        if (c < 0) continue;
+        if (pass)
+          cg->callee[cg->first[k + 1]++] = c;
+        else
+          cg->first[k + 2]++;
+      }
+    }
+    if (!pass) {
+      for (int k = 2; k <= n + 1; k++) cg->first[k] += cg->first[k - 1];
+      cg->callee = malloc((cg->first[n + 1] + 1) * sizeof(int));
+    }
+  }
+}
+
+// 非递归的Tarjan算法, 强连通分量按逆拓扑序(被调用者在前)得到
+static void Build_Order(CallGraph* cg) {
+  int n = cg->nfunc, clock = 0, sp = 0, top = 0, norder = 0;
+  int* index = malloc((n + 1) * sizeof(int));
+  int* low = malloc((n + 1) * sizeof(int));
+  int* next = malloc((n + 1) * sizeof(int));  // 下一条要访问的边
+  int* stack = malloc((n + 1) * sizeof(int));  // 深度优先的路径
+  int* comp = malloc((n + 1) * sizeof(int));   // 尚未归入分量的结点
+  char* on = calloc(n + 1, 1);
+  int* order = malloc((n + 1) * sizeof(int));
+  cg->recursive = calloc(n + 1, 1);
+  for (int k = 0; k < n; k++) index[k] = -1;
+
+  for (int r = 0; r < n; r++) {
+    if (index[r] >= 0) continue;
+    index[r] = low[r] = clock++;
+    next[r] = cg->first[r];
+    stack[sp++] = comp[top++] = r;
+    on[r] = 1;
+    while (sp) {
+      int v = stack[sp - 1];
+      if (next[v] < cg->first[v + 1]) {
+        int w = cg->callee[next[v]++];
+        if (w == v) cg->recursive[v] = 1;
+        if (index[w] < 0) {
+          index[w] = low[w] = clock++;
+          next[w] = cg->first[w];
+          stack[sp++] = comp[top++] = w;
+          on[w] = 1;
+        } else if (on[w] && index[w] < low[v])
+          low[v] = index[w];
+        continue;
+      }
+      sp--;
+      if (sp && low[v] < low[stack[sp - 1]]) low[stack[sp - 1]] = low[v];
+      if (low[v] != index[v]) continue;
+      // v是分量的根, 分量中多于一个函数时都是递归的
+      int size = 0;
+      do {
+        int w = comp[--top];
+        on[w] = 0;
+        order[norder + size++] = w;
+        if (w != v) cg->recursive[w] = 1;
+      } while (comp[top] != v);
+      if (size > 1) cg->recursive[v] = 1;
+      norder += size;
+    }
+  }
+
+  // 按新的顺序重排函数, 边和标记随之换成新下标
+  IRFunc** funcs = malloc((n + 1) * sizeof(IRFunc*));
+  char* recursive = calloc(n + 1, 1);
+  for (int k = 0; k < n; k++) {
+    funcs[k] = cg->funcs[order[k]];
+    recursive[k] = cg->recursive[order[k]];
+  }
+  free(cg->funcs);
+  free(cg->recursive);
+  cg->funcs = funcs;
+  cg->recursive = recursive;
+
+  free(index);
+  free(low);
+  free(next);
+  free(stack);
+  free(comp);
+  free(on);
+  free(order);
+}
+
+CallGraph* CallGraph_Build() {
+  CallGraph* cg = malloc(sizeof(CallGraph));
+  cg->nfunc = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next) cg->nfunc++;
+  cg->funcs = malloc((cg->nfunc + 1) * sizeof(IRFunc*));
+  int k = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next)
+    cg->funcs[k++] = func;
+  Build_Table(cg);
+  Build_Edges(cg);
+  Build_Order(cg);
+  // 重排后重建散列表和边
+  free(cg->table);
+  free(cg->first);
+  free(cg->callee);
+  Build_Table(cg);
+  Build_Edges(cg);
+  return cg;
+}
+
+void CallGraph_Free(CallGraph* cg) {
+  free(cg->funcs);
+  free(cg->recursive);
+  free(cg->first);
+  free(cg->callee);
+  free(cg->table);
+  free(cg);
+}
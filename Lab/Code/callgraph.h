@@ -0,0 +1,31 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include "ir.h"
+
+/*
+调用图:
+-- 结点为定义了的函数, 边为 x := CALL f (只声明未定义的函数不在图中)
+-- 用Tarjan算法求强连通分量, 函数按自底向上的顺序排列: 被调用的函数
+   在调用者之前(同一强连通分量中的除外)
+-- 在环上(包括调用自身)的函数标为递归
+*/
+
+typedef struct CallGraph CallGraph;
+
+struct CallGraph {
+  IRFunc** funcs;  // 自底向上的顺序
+  int nfunc;
+  char* recursive;      // 按funcs的下标
+  int *first, *callee;  // 函数k调用 callee[first[k], first[k + 1])
+  int* table;           // 函数名 -> 下标的散列表
+  unsigned mask;
+};
+
+extern CallGraph* CallGraph_Build();
+extern void CallGraph_Free(CallGraph* cg);
+
+// 函数名(驻留)对应的下标, 没有定义为-1
+extern int CallGraph_Find(const CallGraph* cg, const char* name);
+
+#endif
@@ -0,0 +1,319 @@
+#include "cfg.h"
+
+#include "assert.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+static void Build_Blocks(CFG* cfg) {
+  IRFunc* func = cfg->func;
+  int n = func->len;
+
+  // 标号 -> 指令下标
+  int lmin = 0x7FFFFFFF, lmax = -1;
+  for (int i = 0; i < n; i++)
+    if (func->code[i].op == IR_LABEL) {
+      if (func->code[i].x.no < lmin) lmin = func->code[i].x.no;
+      if (func->code[i].x.no > lmax) lmax = func->code[i].x.no;
+    }
+  int* where = malloc((lmax >= lmin ? lmax - lmin + 1 : 1) * sizeof(int));
+  for (int i = 0; i < n; i++)
+    if (func->code[i].op == IR_LABEL) where[func->code[i].x.no - lmin] = i;
+
+  // 划分: 标号开始新块, 跳转结束当前块
+  int nblock = 0;
+  for (int i = 0; i < n; i++) {
+    const Instr* in = &func->code[i];
+    if (i == 0 || in->op == IR_LABEL ||
+        (in > func->code && Instr_IsJump(in - 1)))
+      nblock++;
+    cfg->block_of[i] = nblock - 1;
+  }
+  cfg->nblock = nblock;
+  cfg->blocks = malloc((nblock + 1) * sizeof(Block));
+  for (int i = 0; i < n; i++) {
+    Block* b = &cfg->blocks[cfg->block_of[i]];
+    if (i == 0 || cfg->block_of[i - 1] != cfg->block_of[i]) b->first = i;
+    b->last = i + 1;
+  }
+
+  for (int k = 0; k < nblock; k++) {
+    Block* b = &cfg->blocks[k];
+    const Instr* in = &func->code[b->last - 1];
+    b->nsucc = 0;
+    if (in->op == IR_GOTO || in->op == IR_IF)
+      b->succ[b->nsucc++] = cfg->block_of[where[in->x.no - lmin]];
+    if (in->op != IR_GOTO && in->op != IR_RETURN && k + 1 < nblock)
+      b->succ[b->nsucc++] = k + 1;
+  }
+  free(where);
+
+  // 前驱
+  cfg->pred_buf = malloc((2 * nblock + 1) * sizeof(int));
+  for (int k = 0; k < nblock; k++) cfg->blocks[k].npred = 0;
+  for (int k = 0; k < nblock; k++)
+    for (int s = 0; s < cfg->blocks[k].nsucc; s++)
+      cfg->blocks[cfg->blocks[k].succ[s]].npred++;
+  int* p = cfg->pred_buf;
+  for (int k = 0; k < nblock; k++) {
+    cfg->blocks[k].pred = p;
+    p += cfg->blocks[k].npred;
+    cfg->blocks[k].npred = 0;
+  }
+  for (int k = 0; k < nblock; k++)
+    for (int s = 0; s < cfg->blocks[k].nsucc; s++) {
+      Block* to = &cfg->blocks[cfg->blocks[k].succ[s]];
+      to->pred[to->npred++] = k;
+    }
+}
+
+// 非递归的深度优先搜索求逆后序
+static void Build_Order(CFG* cfg) {
+  int nblock = cfg->nblock;
+  int* stack = malloc((nblock + 1) * sizeof(int));
+  int* next = calloc(nblock + 1, sizeof(int));  // 下一个要访问的后继
+  int* post = malloc((nblock + 1) * sizeof(int));
+  int sp = 0, npost = 0;
+  for (int k = 0; k < nblock; k++) cfg->blocks[k].rpo = -1;
+  if (nblock) {
+    cfg->blocks[0].rpo = 0;  // 仅作已访问标记
+    stack[sp++] = 0;
+  }
+  while (sp) {
+    Block* b = &cfg->blocks[stack[sp - 1]];
+    if (next[stack[sp - 1]] < b->nsucc) {
+      int s = b->succ[next[stack[sp - 1]]++];
+      if (cfg->blocks[s].rpo < 0) {
+        cfg->blocks[s].rpo = 0;
+        stack[sp++] = s;
+      }
+    } else
+      post[npost++] = stack[--sp];
+  }
+  cfg->nreach = npost;
+  cfg->order = malloc((npost + 1) * sizeof(int));
+  for (int k = 0; k < npost; k++) {
+    cfg->order[k] = post[npost - 1 - k];
+    cfg->blocks[cfg->order[k]].rpo = k;
+  }
+  free(stack);
+  free(next);
+  free(post);
+}
+
+// Cooper, Harvey, Kennedy: 按逆后序迭代求直接支配者
+static void Build_Dom(CFG* cfg) {
+  Block* blocks = cfg->blocks;
+  for (int k = 0; k < cfg->nblock; k++) blocks[k].idom = -1;
+  cfg->dom_pre = cfg->dom_post = cfg->kid_buf = NULL;
+  for (int k = 0; k < cfg->nblock; k++) blocks[k].nkid = 0;
+  if (!cfg->nreach) return;
+  blocks[0].idom = 0;
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int k = 1; k < cfg->nreach; k++) {
+      Block* b = &blocks[cfg->order[k]];
+      int idom = -1;
+      for (int p = 0; p < b->npred; p++) {
+        int a = b->pred[p];
+        if (blocks[a].idom < 0) continue;
+        if (idom < 0) {
+          idom = a;
+          continue;
+        }
+        while (a != idom) {
+          while (blocks[a].rpo > blocks[idom].rpo) a = blocks[a].idom;
+          while (blocks[idom].rpo > blocks[a].rpo) idom = blocks[idom].idom;
+        }
+      }
+      if (idom != b->idom) {
+        b->idom = idom;
+        changed = 1;
+      }
+    }
+  }
+  blocks[0].idom = -1;
+
+  // 支配树的子结点
+  int n = cfg->nreach;
+  cfg->kid_buf = malloc((n + 1) * sizeof(int));
+  for (int k = 0; k < cfg->nblock; k++) blocks[k].nkid = 0;
+  for (int k = 1; k < n; k++) blocks[blocks[cfg->order[k]].idom].nkid++;
+  int* p = cfg->kid_buf;
+  for (int k = 0; k < cfg->nblock; k++) {
+    blocks[k].kids = p;
+    p += blocks[k].nkid;
+    blocks[k].nkid = 0;
+  }
+  for (int k = 1; k < n; k++) {
+    Block* d = &blocks[blocks[cfg->order[k]].idom];
+    d->kids[d->nkid++] = cfg->order[k];
+  }
+
+  // 支配树的先序/后序编号, 用于O(1)判断支配关系
+  cfg->dom_pre = malloc((cfg->nblock + 1) * sizeof(int));
+  cfg->dom_post = malloc((cfg->nblock + 1) * sizeof(int));
+  int* stack = malloc((n + 1) * sizeof(int));
+  int* next = calloc(cfg->nblock + 1, sizeof(int));
+  int sp = 0, clock = 0;
+  stack[sp++] = 0;
+  cfg->dom_pre[0] = clock++;
+  while (sp) {
+    Block* b = &blocks[stack[sp - 1]];
+    if (next[stack[sp - 1]] < b->nkid) {
+      int c = b->kids[next[stack[sp - 1]]++];
+      cfg->dom_pre[c] = clock++;
+      stack[sp++] = c;
+    } else
+      cfg->dom_post[stack[--sp]] = clock++;
+  }
+  free(stack);
+  free(next);
+}
+
+int CFG_Dominates(const CFG* cfg, int a, int b) {
+  if (cfg->blocks[a].rpo < 0 || cfg->blocks[b].rpo < 0) return 0;
+  return cfg->dom_pre[a] <= cfg->dom_pre[b] &&
+         cfg->dom_post[b] <= cfg->dom_post[a];
+}
+
+// 按逆后序处理循环头, 外层循环的头支配内层的头, 所以先被处理
+static void Build_Loops(CFG* cfg) {
+  Block* blocks = cfg->blocks;
+  int nblock = cfg->nblock;
+  for (int k = 0; k < nblock; k++) blocks[k].loop = -1;
+  cfg->nloop = 0;
+  for (int k = 0; k < cfg->nreach; k++) {
+    const Block* h = &blocks[cfg->order[k]];
+    for (int p = 0; p < h->npred; p++)
+      if (CFG_Dominates(cfg, cfg->order[k], h->pred[p])) {
+        cfg->nloop++;
+        break;
+      }
+  }
+  cfg->loops = malloc((cfg->nloop + 1) * sizeof(Loop));
+
+  // 每个块最多属于 深度 个循环, 缓冲区按需增长
+  int cap = nblock + 1, used = 0, nloop = 0;
+  cfg->loop_buf = malloc(cap * sizeof(int));
+  int* start = malloc((cfg->nloop + 1) * sizeof(int));
+  int* mark = malloc((nblock + 1) * sizeof(int));
+  int* work = malloc((nblock + 1) * sizeof(int));
+  for (int k = 0; k < nblock; k++) mark[k] = -1;
+  start[0] = 0;
+  for (int k = 0; k < cfg->nreach; k++) {
+    int h = cfg->order[k], sp = 0;
+    for (int p = 0; p < blocks[h].npred; p++) {
+      int b = blocks[h].pred[p];
+      if (CFG_Dominates(cfg, h, b) && mark[b] != nloop) {
+        mark[b] = nloop;
+        work[sp++] = b;
+      }
+    }
+    if (!sp) continue;
+    if (mark[h] != nloop) {
+      mark[h] = nloop;
+      work[sp++] = h;
+    }
+    // 从回边的源头逆着前驱找到循环体
+    while (sp) {
+      int b = work[--sp];
+      if (used == cap) {
+        cap *= 2;
+        cfg->loop_buf = realloc(cfg->loop_buf, cap * sizeof(int));
+      }
+      cfg->loop_buf[used++] = b;
+      if (b == h) continue;
+      for (int p = 0; p < blocks[b].npred; p++) {
+        int a = blocks[b].pred[p];
+        if (blocks[a].rpo >= 0 && mark[a] != nloop) {
+          mark[a] = nloop;
+          work[sp++] = a;
+        }
+      }
+    }
+    Loop* loop = &cfg->loops[nloop];
+    loop->header = h;
+    loop->parent = blocks[h].loop;
+    loop->depth = loop->parent < 0 ? 1 : cfg->loops[loop->parent].depth + 1;
+    loop->nblock = used - start[nloop];
+    for (int i = start[nloop]; i < used; i++)
+      blocks[cfg->loop_buf[i]].loop = nloop;
+    start[++nloop] = used;
+  }
+  // 缓冲区可能移动过, 最后再换成指针
+  for (int l = 0; l < nloop; l++)
+    cfg->loops[l].blocks = cfg->loop_buf + start[l];
+  free(start);
+  free(mark);
+  free(work);
+}
+
+CFG* CFG_Build(IRFunc* func) {
+  CFG* cfg = malloc(sizeof(CFG));
+  cfg->func = func;
+  cfg->block_of = malloc((func->len + 1) * sizeof(int));
+  Build_Blocks(cfg);
+  Build_Order(cfg);
+  Build_Dom(cfg);
+  Build_Loops(cfg);
+  return cfg;
+}
+
+void CFG_Free(CFG* cfg) {
+  free(cfg->blocks);
+  free(cfg->block_of);
+  free(cfg->order);
+  free(cfg->pred_buf);
+  free(cfg->kid_buf);
+  free(cfg->loops);
+  free(cfg->loop_buf);
+  free(cfg->dom_pre);
+  free(cfg->dom_post);
+  free(cfg);
+}
+
+/*
+Graphviz输出: 每个函数一个子图
+-- 实线为控制流, 虚线为支配树
+-- 循环头画双线框, 并标出循环深度
+*/
+
+void CFG_Dump(FILE* fp, const CFG* cfg, int id) {
+  fprintf(fp, "  subgraph cluster_%d {\n    label=\"%s\";\n", id,
+          cfg->func->name);
+  for (int k = 0; k < cfg->nblock; k++) {
+    const Block* b = &cfg->blocks[k];
+    int header = b->loop >= 0 && cfg->loops[b->loop].header == k;
+    fprintf(fp, "    f%d_b%d [%slabel=\"B%d", id, k,
+            header ? "peripheries=2, " : "", k);
+    if (b->loop >= 0) fprintf(fp, " (loop %d)", cfg->loops[b->loop].depth);
+    if (b->rpo < 0) fprintf(fp, " (unreachable)");
+    fprintf(fp, "\\l");
+    for (int i = b->first; i < b->last; i++)
+      if (cfg->func->code[i].op != IR_NOP)
+        IR_PrintInstr(fp, &cfg->func->code[i], "\\l");
+    fprintf(fp, "\"];\n");
+  }
+  for (int k = 0; k < cfg->nblock; k++) {
+    const Block* b = &cfg->blocks[k];
+    for (int s = 0; s < b->nsucc; s++)
+      fprintf(fp, "    f%d_b%d -> f%d_b%d;\n", id, k, id, b->succ[s]);
+    if (b->idom >= 0)
+      fprintf(fp, "    f%d_b%d -> f%d_b%d [style=dashed, color=gray];\n", id,
+              b->idom, id, k);
+  }
+  fprintf(fp, "  }\n");
+}
+
+void CFG_DumpAll(FILE* fp) {
+  int id = 0;
+  fprintf(fp, "digraph cfg {\n  node [shape=box, fontname=monospace];\n");
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next) {
+    CFG* cfg = CFG_Build(func);
+    CFG_Dump(fp, cfg, id++);
+    CFG_Free(cfg);
+  }
+  fprintf(fp, "}\n");
+}
@@ -0,0 +1,57 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "ir.h"
+#include "stdio.h"
+
+/*
+控制流图:
+-- 以标号和跳转为界把函数的指令划分为基本块
+-- 基本块0为入口, 后继按跳转目标和顺序执行确定
+-- 建图时一并求出前驱, 逆后序, 支配树和自然循环, 均为近线性时间
+-- 建图后各遍可以把指令改为IR_NOP, 但不能增删指令
+*/
+
+typedef struct Block Block;
+typedef struct Loop Loop;
+typedef struct CFG CFG;
+
+struct Block {
+  int first, last;  // 指令区间[first, last)
+  int succ[2], nsucc;
+  int *pred, npred;
+  int rpo;   // 逆后序编号, 从入口不可达为-1
+  int idom;  // 直接支配者, 入口和不可达块为-1
+  int *kids, nkid;  // 支配树上的子结点
+  int loop;  // 所在的最内层循环, 不在循环中为-1
+};
+
+// 自然循环: 回边 b -> header (header支配b) 所确定的块集合
+struct Loop {
+  int header;
+  int parent;  // 外层循环, 没有为-1
+  int depth;   // 最外层为1
+  int *blocks, nblock;
+};
+
+struct CFG {
+  IRFunc* func;
+  Block* blocks;
+  int nblock;
+  int* block_of;  // 指令 -> 所在基本块
+  int *order, nreach;  // 可达的块按逆后序排列, order[0]为入口
+  Loop* loops;         // 外层循环在前
+  int nloop;
+  int *pred_buf, *kid_buf, *loop_buf, *dom_pre, *dom_post;
+};
+
+extern CFG* CFG_Build(IRFunc* func);
+extern void CFG_Free(CFG* cfg);
+
+// a支配b (a == b时也成立), 不可达的块不被任何块支配
+extern int CFG_Dominates(const CFG* cfg, int a, int b);
+// 输出Graphviz
+extern void CFG_Dump(FILE* fp, const CFG* cfg, int id);
+extern void CFG_DumpAll(FILE* fp);
+
+#endif
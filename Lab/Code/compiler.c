@@ -0,0 +1,39 @@
+#include "compiler.h"
+
+#include "intern.h"
+#include "ir.h"
+#include "lexical_syntax.h"
+#include "string.h"
+#include "symtab.h"
+
+__thread Compiler* ctx;
+
+void Compiler_Init(Compiler* c, FILE* diag) {
+  memset(c, 0, sizeof(Compiler));
+  c->diag = diag;
+  c->intern_gen = 1;
+  ctx = c;
+}
+
+void Compiler_Reset(Compiler* c) {
+  ctx = c;
+  Arena_Reset(&c->ast_arena);
+  c->root = NULL;
+  c->error_type = 0;
+  c->sem_error = 0;
+  Intern_Reset();
+  Arena_Reset(&c->sym_arena);
+  IR_Free();
+  c->vtemp = c->temp = c->label = c->unname_cnt = 0;
+  c->name_int = c->name_read = c->name_write = NULL;
+}
+
+void Compiler_Uninit(Compiler* c) {
+  // 各模块的释放函数都作用于当前上下文
+  ctx = c;
+  free_syntax_tree();
+  IR_Free();
+  Intern_Uninit();
+  Symtab_Free();
+  ctx = NULL;
+}
@@ -0,0 +1,65 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "arena.h"
+#include "stdio.h"
+
+/*
+编译上下文: 一次编译(一个输入文件)的全部状态
+-- 扫描器, 语法树, 驻留表, 符号表, 各种编号的计数器和中间代码都在其中,
+   互不相同的上下文可以在不同线程中同时编译
+-- 当前线程正在使用的上下文为ctx(线程局部), 各模块通过它访问状态,
+   不必逐层传递
+-- 命令行选项等只读的配置仍是全局的
+*/
+
+typedef struct Compiler Compiler;
+
+struct Compiler {
+  // 词法, 语法分析
+  void* scanner;     // 可重入的flex扫描器
+  FILE* diag;        // 词法, 语法和语义错误的输出
+  int error_type;    // 0为无错误
+  struct ast* root;  // 语法树
+  Arena ast_arena;   // 语法树结点的分配区域
+  struct Pipeline* pipeline;  // 非NULL时ExtDef不进语法树, 交给流水线翻译
+
+  // 名字驻留表
+  Arena intern_arena;                // 名字的存储区
+  struct InternEntry* intern_table;  // 开放定址的散列表
+  unsigned intern_mask;              // 表长 - 1
+  unsigned intern_cnt;               // 已驻留的名字数
+  unsigned intern_gen;               // 表项的当前一代
+
+  // 符号表
+  struct Symtab* global;          // 全局符号表
+  struct Symtab* local;           // 局部符号表
+  struct Binding** buckets;       // 散列桶, 同名绑定新者在前
+  unsigned bucket_mask;           // 桶数 - 1
+  unsigned bindcnt;               // 当前绑定数
+  struct Binding* free_bindings;  // 回收的绑定
+  Arena sym_arena;                // 符号表, 符号和类型的分配区域
+
+  // 语义分析
+  int sem_error;  // 1为翻译时发现了语义错误, 流水线模式下由翻译线程写
+  int vtemp, temp, label;  // 变量, 临时变量, 标号
+  int unname_cnt;          // 匿名结构体
+  const char *name_int, *name_read, *name_write;  // 常用名字的驻留指针
+
+  // 中间代码
+  struct IRFunc* ir_funcs;  // 按定义顺序排列的函数
+  struct IRFunc* ir_tail;   // 当前正在生成的函数
+  int label_max;            // 已用的最大标号
+};
+
+// 当前线程的编译上下文
+extern __thread Compiler* ctx;
+
+// 初始化c并设为当前上下文, 错误信息输出到diag
+extern void Compiler_Init(Compiler* c, FILE* diag);
+// 清空c以编译下一个输入, 区域, 散列表等已分配的内存留着复用
+extern void Compiler_Reset(Compiler* c);
+// 释放c拥有的全部内存
+extern void Compiler_Uninit(Compiler* c);
+
+#endif
@@ -0,0 +1,313 @@
+#include "gen.h"
+
+#include "stdarg.h"
+#include "stdlib.h"
+#include "string.h"
+
+#define GEN_VARS 4         // 每个函数的int变量x0..x3
+#define GEN_ARRAY 8        // 局部数组a的长度, 也是循环次数的上限
+#define GEN_FIELD 4        // 结构体的数组成员v的长度
+#define GEN_FUNC_LINES 40  // 没有给出函数个数时每个函数的行数
+
+const GenParams gen_defaults = {.seed = 1,
+                                .lines = 1000,
+                                .funcs = 0,
+                                .depth = 3,
+                                .expr = 4,
+                                .structs = 4,
+                                .arrays = 1};
+
+typedef struct Gen {
+  FILE* fp;
+  const GenParams* p;
+  unsigned state;  // xorshift32的状态
+  long lines;      // 已输出的行数
+  int func;        // 当前函数的编号
+  int loops;       // 所在的循环层数, 循环变量依次为i0, i1, ...
+  int called;      // 当前函数是否已调用过别的函数
+} Gen;
+
+static unsigned Rand(Gen* g) {
+  unsigned x = g->state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return g->state = x;
+}
+
+static int Below(Gen* g, int n) { return Rand(g) % n; }
+
+static void Out(Gen* g, const char* fmt, ...) {
+  va_list v;
+  va_start(v, fmt);
+  vfprintf(g->fp, fmt, v);
+  va_end(v);
+}
+
+// 开始新的一行, level为缩进层数
+static void Begin(Gen* g, int level) {
+  for (int i = 0; i < level; i++) fputs("  ", g->fp);
+}
+
+static void End(Gen* g, const char* text) {
+  fputs(text, g->fp);
+  fputc('\n', g->fp);
+  g->lines++;
+}
+
+/* 表达式: 都是int类型, 除数是非零常数, 下标不越界 */
+
+static void Index(Gen* g) {
+  if (g->loops > 0 && Below(g, 2))
+    Out(g, "i%d", Below(g, g->loops));
+  else
+    Out(g, "%d", Below(g, GEN_ARRAY));
+}
+
+static void Leaf(Gen* g) {
+  const GenParams* p = g->p;
+  // 选中的种类不可用时重选
+  for (;;) {
+    int k = Below(g, 7);
+    if (k == 0) {
+      Out(g, "%d", Below(g, 100));
+    } else if (k == 1) {
+      Out(g, "p%d", Below(g, 2));
+    } else if (k == 2) {
+      if (!p->arrays) continue;
+      Out(g, "a[");
+      Index(g);
+      Out(g, "]");
+    } else if (k == 3) {
+      if (!p->structs) continue;
+      if (p->arrays && Below(g, 2))
+        Out(g, "s.v[%d]", Below(g, GEN_FIELD));
+      else
+        Out(g, "s.%c", "ab"[Below(g, 2)]);
+    } else if (k == 4) {
+      if (g->loops == 0) continue;
+      Out(g, "i%d", Below(g, g->loops));
+    } else
+      Out(g, "x%d", Below(g, GEN_VARS));
+    return;
+  }
+}
+
+static void Exp(Gen* g, int depth) {
+  if (depth <= 0 || Below(g, 4) == 0) {
+    Leaf(g);
+    return;
+  }
+  switch (Below(g, 6)) {
+    case 0:
+      Out(g, "(");
+      Exp(g, depth - 1);
+      Out(g, ")");
+      break;
+    case 1:
+      Out(g, "-");
+      Exp(g, depth - 1);
+      break;
+    case 2:
+      Exp(g, depth - 1);
+      Out(g, " / %d", Below(g, 9) + 1);
+      break;
+    default:
+      Exp(g, depth - 1);
+      Out(g, " %c ", "+-*"[Below(g, 3)]);
+      Exp(g, depth - 1);
+      break;
+  }
+}
+
+static void Cond(Gen* g, int depth) {
+  static const char* relops[] = {"<", ">", "<=", ">=", "==", "!="};
+  if (depth <= 0 || Below(g, 3) == 0) {
+    if (Below(g, 8) == 0) {
+      Out(g, "r %s %d.5", relops[Below(g, 4)], Below(g, 10));
+      return;
+    }
+    Exp(g, g->p->expr - 1);
+    Out(g, " %s ", relops[Below(g, 6)]);
+    Exp(g, g->p->expr - 1);
+    return;
+  }
+  switch (Below(g, 3)) {
+    case 0:
+      Out(g, "!(");
+      Cond(g, depth - 1);
+      Out(g, ")");
+      break;
+    default:
+      Cond(g, depth - 1);
+      Out(g, Below(g, 2) ? " && " : " || ");
+      Cond(g, depth - 1);
+      break;
+  }
+}
+
+static void LValue(Gen* g) {
+  const GenParams* p = g->p;
+  int k = Below(g, 8);
+  if (k == 0 && p->arrays) {
+    Out(g, "a[");
+    Index(g);
+    Out(g, "]");
+  } else if (k == 1 && p->structs)
+    Out(g, "s.%c", "ab"[Below(g, 2)]);
+  else if (k == 2 && p->structs && p->arrays)
+    Out(g, "s.v[%d]", Below(g, GEN_FIELD));
+  else
+    Out(g, "x%d", Below(g, GEN_VARS));
+}
+
+/* 语句 */
+
+static void Stmt(Gen* g, int level, int depth);
+
+static void Block(Gen* g, int level, int depth) {
+  int n = Below(g, 4) + 1;
+  for (int i = 0; i < n; i++) Stmt(g, level, depth);
+}
+
+static void Stmt(Gen* g, int level, int depth) {
+  const GenParams* p = g->p;
+  int k = Below(g, 16);
+  Begin(g, level);
+  if (k < 2 && depth < p->depth) {
+    Out(g, "if (");
+    Cond(g, 2);
+    End(g, ") {");
+    Block(g, level + 1, depth + 1);
+    Begin(g, level);
+    if (Below(g, 2)) {
+      End(g, "}");
+      return;
+    }
+    End(g, "} else {");
+    Block(g, level + 1, depth + 1);
+    Begin(g, level);
+    End(g, "}");
+  } else if (k < 4 && depth < p->depth) {
+    // 循环变量只在这里赋值, 循环次数不超过数组长度
+    int i = g->loops++;
+    Out(g, "i%d = 0;", i);
+    End(g, "");
+    Begin(g, level);
+    Out(g, "while (i%d < %d", i, Below(g, GEN_ARRAY) + 1);
+    if (Below(g, 2)) {
+      Out(g, " && (");
+      Cond(g, 1);
+      Out(g, ")");
+    }
+    End(g, ") {");
+    Block(g, level + 1, depth + 1);
+    Begin(g, level + 1);
+    Out(g, "i%d = i%d + 1;", i, i);
+    End(g, "");
+    Begin(g, level);
+    End(g, "}");
+    g->loops--;
+  } else if (k == 4 && depth == 0 && g->func > 0 && !g->called) {
+    // 每个函数至多调用一次, 运行时间与函数个数成正比
+    g->called = 1;
+    Out(g, "x%d = f%d(", Below(g, GEN_VARS), Below(g, g->func));
+    Exp(g, p->expr);
+    Out(g, ", ");
+    Exp(g, p->expr);
+    End(g, ");");
+  } else if (k == 5) {
+    Out(g, "write(");
+    Exp(g, p->expr);
+    End(g, ");");
+  } else if (k == 6) {
+    Out(g, "r = r * %d.5 + %d.25;", Below(g, 3), Below(g, 10));
+    End(g, "");
+  } else {
+    LValue(g);
+    Out(g, " = ");
+    Exp(g, p->expr);
+    End(g, ";");
+  }
+}
+
+static void Func(Gen* g, long budget) {
+  const GenParams* p = g->p;
+  long start = g->lines;
+  g->called = 0;
+  Out(g, "int f%d(int p0, int p1)", g->func);
+  End(g, "");
+  End(g, "{");
+  Out(g, "  int x0 = p0, x1 = p1, x2 = %d, x3 = %d;", Below(g, 100),
+      Below(g, 100));
+  End(g, "");
+  if (p->depth > 0) {
+    Out(g, "  int i0");
+    for (int i = 1; i < p->depth; i++) Out(g, ", i%d", i);
+    End(g, ";");
+  }
+  if (p->arrays) {
+    Out(g, "  int a[%d];", GEN_ARRAY);
+    End(g, "");
+  }
+  if (p->structs) {
+    Out(g, "  struct S%d s;", Below(g, p->structs));
+    End(g, "");
+  }
+  End(g, "  float r = 1.5;");
+  while (g->lines - start < budget - 2) Stmt(g, 1, 0);
+  Out(g, "  return ");
+  Exp(g, p->expr);
+  End(g, ";");
+  End(g, "}");
+}
+
+void Gen_Program(FILE* fp, const GenParams* params) {
+  Gen g = {.fp = fp, .p = params, .state = params->seed ? params->seed : 1};
+  const GenParams* p = params;
+
+  for (int i = 0; i < p->structs; i++) {
+    Out(&g, "struct S%d { int a; int b;", i);
+    if (p->arrays) Out(&g, " int v[%d];", GEN_FIELD);
+    End(&g, " };");
+  }
+
+  long lines = p->lines - p->structs - 5;
+  int funcs = p->funcs > 0 ? p->funcs : lines / GEN_FUNC_LINES;
+  if (funcs < 1) funcs = 1;
+  for (g.func = 0; g.func < funcs; g.func++)
+    Func(&g, (lines - g.lines + p->structs) / (funcs - g.func));
+
+  End(&g, "int main()");
+  End(&g, "{");
+  Out(&g, "  write(f%d(1, 2));", funcs - 1);
+  End(&g, "");
+  End(&g, "  return 0;");
+  End(&g, "}");
+}
+
+int Gen_Parse(GenParams* params, const char* spec) {
+  while (*spec) {
+    const char* eq = strchr(spec, '=');
+    if (!eq) return 0;
+    char* end;
+    long value = strtol(eq + 1, &end, 10);
+    if (end == eq + 1 || (*end && *end != ',')) return 0;
+    size_t len = eq - spec;
+#define GEN_PARAM(name)                                    \
+  if (len == strlen(#name) && !strncmp(spec, #name, len)) \
+    params->name = value;                                  \
+  else
+    GEN_PARAM(seed)
+    GEN_PARAM(lines)
+    GEN_PARAM(funcs)
+    GEN_PARAM(depth)
+    GEN_PARAM(expr)
+    GEN_PARAM(structs)
+    GEN_PARAM(arrays)
+    return 0;
+#undef GEN_PARAM
+    spec = *end ? end + 1 : end;
+  }
+  return 1;
+}
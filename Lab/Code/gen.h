@@ -0,0 +1,32 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include "stdio.h"
+
+/*
+随机程序生成器: 为性能测试生成任意规模的C--程序
+-- 同一组参数(含种子)总是生成同一个程序
+-- 生成的程序没有词法, 语法和语义错误; 只用int和float, 数组下标不越界,
+   循环次数有上限, 函数只调用在它之前定义的函数, 可以直接运行
+-- C--不支持全局变量, 全局的定义是结构体类型; 每个函数都用其中一个
+*/
+
+typedef struct GenParams {
+  unsigned seed;  // 随机数种子
+  long lines;     // 大约的总行数
+  int funcs;      // 函数个数(不含main), 0为每个函数约40行
+  int depth;      // 语句的最大嵌套深度
+  int expr;       // 表达式的最大深度
+  int structs;    // 全局结构体类型的个数, 0为不用结构体
+  int arrays;     // 是否使用数组
+} GenParams;
+
+// 默认参数
+extern const GenParams gen_defaults;
+
+// 按"名字=值,..."修改参数, 名字同GenParams的成员; 有错时返回0
+extern int Gen_Parse(GenParams* params, const char* spec);
+// 生成一个程序写到fp
+extern void Gen_Program(FILE* fp, const GenParams* params);
+
+#endif
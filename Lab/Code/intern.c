@@ -0,0 +1,84 @@
+#include "intern.h"
+
+#include "arena.h"
+#include "compiler.h"
+#include "stdlib.h"
+#include "string.h"
+
+#define INTERN_SIZE 0x3FFF
+
+// 表项的gen与上下文的intern_gen不同时为空, 清空表只需增加intern_gen
+typedef struct InternEntry {
+  const char* str;
+  size_t len;
+  unsigned hash, gen;
+} InternEntry;
+
+static unsigned Hash_Bytes(const char* str, size_t len) {
+  // FNV-1a
+  unsigned h = 2166136261u;
+  for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)str[i]) * 16777619u;
+  return h;
+}
+
+static void Intern_Grow(Compiler* c) {
+  unsigned mask = c->intern_table ? c->intern_mask * 2 + 1 : INTERN_SIZE;
+  InternEntry* nt = calloc(mask + 1, sizeof(InternEntry));
+  for (unsigned i = 0; c->intern_table && i <= c->intern_mask; i++) {
+    if (c->intern_table[i].gen != c->intern_gen) continue;
+    unsigned j = c->intern_table[i].hash & mask;
+    while (nt[j].gen == c->intern_gen) j = (j + 1) & mask;
+    nt[j] = c->intern_table[i];
+  }
+  free(c->intern_table);
+  c->intern_table = nt;
+  c->intern_mask = mask;
+}
+
+const char* Intern_Len(const char* str, size_t len) {
+  Compiler* c = ctx;
+  // 装载因子不超过1/2
+  if (!c->intern_table || c->intern_cnt * 2 >= c->intern_mask) Intern_Grow(c);
+  InternEntry* table = c->intern_table;
+  unsigned h = Hash_Bytes(str, len);
+  unsigned i = h & c->intern_mask;
+  while (table[i].gen == c->intern_gen) {
+    if (table[i].hash == h && table[i].len == len &&
+        !memcmp(table[i].str, str, len))
+      return table[i].str;
+    i = (i + 1) & c->intern_mask;
+  }
+
+  char* copy = Arena_Alloc(&c->intern_arena, len + 1);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  table[i].str = copy;
+  table[i].len = len;
+  table[i].hash = h;
+  table[i].gen = c->intern_gen;
+  c->intern_cnt++;
+  return copy;
+}
+
+const char* Intern(const char* str) { return Intern_Len(str, strlen(str)); }
+
+void Intern_Reset() {
+  // 保留表长, 换一代即清空全部表项
+  Compiler* c = ctx;
+  if (++c->intern_gen == 0) {
+    // 回绕时才真正清零
+    c->intern_gen = 1;
+    if (c->intern_table)
+      memset(c->intern_table, 0, (c->intern_mask + 1) * sizeof(InternEntry));
+  }
+  c->intern_cnt = 0;
+  Arena_Reset(&c->intern_arena);
+}
+
+void Intern_Uninit() {
+  free(ctx->intern_table);
+  ctx->intern_table = NULL;
+  ctx->intern_mask = ctx->intern_cnt = 0;
+  ctx->intern_gen = 1;
+  Arena_Release(&ctx->intern_arena);
+}
@@ -0,0 +1,17 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "stddef.h"
+
+/*
+标识符驻留表:
+-- 每个名字只保存一份, 相同的名字得到相同的指针
+-- 驻留后的名字可直接用 == 比较, 没有长度限制
+*/
+
+extern const char* Intern(const char* str);
+extern const char* Intern_Len(const char* str, size_t len);
+extern void Intern_Reset();  // 清空, 留着表和存储区复用
+extern void Intern_Uninit();
+
+#endif
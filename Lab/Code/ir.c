@@ -0,0 +1,319 @@
+#include "ir.h"
+
+#include "assert.h"
+#include "stdlib.h"
+#include "string.h"
+
+static const char* relop_names[] = {"==", "!=", "<", ">", "<=", ">="};
+
+int IR_Relop(const char* text, int len) {
+  // 词法已保证是六种之一, 看首字符和长度即可
+  switch (text[0]) {
+    case '=':
+      return RELOP_EQ;
+    case '!':
+      return RELOP_NE;
+    case '<':
+      return len == 1 ? RELOP_LT : RELOP_LE;
+    default:
+      return len == 1 ? RELOP_GT : RELOP_GE;
+  }
+}
+
+IRFunc* IR_NewFunc(const char* name) {
+  IRFunc* func = malloc(sizeof(IRFunc));
+  func->name = name;
+  func->code = NULL;
+  func->len = func->cap = 0;
+  func->next = NULL;
+  if (ctx->ir_tail)
+    ctx->ir_tail->next = func;
+  else
+    ctx->ir_funcs = func;
+  ctx->ir_tail = func;
+  return func;
+}
+
+Instr* IR_Emit(int op, Operand x, Operand y, Operand z) {
+  IRFunc* func = ctx->ir_tail;
+  assert(func);
+  if (func->len == func->cap) {
+    func->cap = func->cap ? func->cap * 2 : 64;
+    func->code = realloc(func->code, func->cap * sizeof(Instr));
+  }
+  Instr* in = &func->code[func->len++];
+  in->op = op;
+  in->relop = 0;
+  in->x = x, in->y = y, in->z = z;
+  if (op == IR_LABEL && x.no > ctx->label_max) ctx->label_max = x.no;
+  return in;
+}
+
+int IR_NewLabel() { return ++ctx->label_max; }
+
+Instr* IR_EmitIf(int relop, Operand y, Operand z, int label) {
+  Instr* in = IR_Emit(IR_IF, OpLabel(label), y, z);
+  in->relop = relop;
+  return in;
+}
+
+/* 输出: 整数手工格式化, 攒满缓冲区后一次写出 */
+
+#define OUT_SIZE 0x10000
+
+static __thread char out_buf[OUT_SIZE];
+static __thread int out_len;
+static __thread FILE* out_fp;
+
+static void Out_Flush() {
+  fwrite(out_buf, 1, out_len, out_fp);
+  out_len = 0;
+}
+
+static void Out_Str(const char* str) {
+  while (*str) {
+    if (out_len == OUT_SIZE) Out_Flush();
+    out_buf[out_len++] = *str++;
+  }
+}
+
+static void Out_Int(int v) {
+  char tmp[16];
+  int n = 0;
+  unsigned u = v < 0 ? -(unsigned)v : (unsigned)v;
+  do tmp[n++] = '0' + u % 10;
+  while (u /= 10);
+  if (v < 0) tmp[n++] = '-';
+  if (out_len + n > OUT_SIZE) Out_Flush();
+  while (n) out_buf[out_len++] = tmp[--n];
+}
+
+static void Out_Operand(Operand op) {
+  switch (op.kind) {
+    case O_TEMP:
+      Out_Str("t");
+      Out_Int(op.no);
+      break;
+    case O_VAR:
+      Out_Str("v");
+      Out_Int(op.no);
+      break;
+    case O_CONST:
+      Out_Str("#");
+      Out_Int(op.ival);
+      break;
+    case O_FCONST: {
+      char tmp[64];
+      snprintf(tmp, sizeof(tmp), "#%f", op.fval);
+      Out_Str(tmp);
+      break;
+    }
+    case O_LABEL:
+      Out_Str("label");
+      Out_Int(op.no);
+      break;
+    case O_FUNC:
+      Out_Str(op.name);
+      break;
+    default:
+      assert(0);
+  }
+}
+
+static void Out_Instr(const Instr* in, const char* end) {
+  static const char* arith[] = {[IR_ADD] = " + ",
+                                [IR_SUB] = " - ",
+                                [IR_MUL] = " * ",
+                                [IR_DIV] = " / "};
+  switch (in->op) {
+    case IR_LABEL:
+      Out_Str("LABEL ");
+      Out_Operand(in->x);
+      Out_Str(" :");
+      break;
+    case IR_ASSIGN:
+      Out_Operand(in->x);
+      Out_Str(" := ");
+      Out_Operand(in->y);
+      break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+      Out_Operand(in->x);
+      Out_Str(" := ");
+      Out_Operand(in->y);
+      Out_Str(arith[in->op]);
+      Out_Operand(in->z);
+      break;
+    case IR_ADDR:
+      Out_Operand(in->x);
+      Out_Str(" := &");
+      Out_Operand(in->y);
+      break;
+    case IR_LOAD:
+      Out_Operand(in->x);
+      Out_Str(" := *");
+      Out_Operand(in->y);
+      break;
+    case IR_STORE:
+      Out_Str("*");
+      Out_Operand(in->x);
+      Out_Str(" := ");
+      Out_Operand(in->y);
+      break;
+    case IR_GOTO:
+      Out_Str("GOTO ");
+      Out_Operand(in->x);
+      break;
+    case IR_IF:
+      Out_Str("IF ");
+      Out_Operand(in->y);
+      Out_Str(" ");
+      Out_Str(relop_names[in->relop]);
+      Out_Str(" ");
+      Out_Operand(in->z);
+      Out_Str(" GOTO ");
+      Out_Operand(in->x);
+      break;
+    case IR_RETURN:
+      Out_Str("RETURN ");
+      Out_Operand(in->x);
+      break;
+    case IR_DEC:
+      // 大小不带#
+      Out_Str("DEC ");
+      Out_Operand(in->x);
+      Out_Str(" ");
+      Out_Int(in->y.ival);
+      break;
+    case IR_ARG:
+      Out_Str("ARG ");
+      Out_Operand(in->x);
+      break;
+    case IR_CALL:
+      Out_Operand(in->x);
+      Out_Str(" := CALL ");
+      Out_Operand(in->y);
+      break;
+    case IR_PARAM:
+      Out_Str("PARAM ");
+      Out_Operand(in->x);
+      break;
+    case IR_READ:
+      Out_Str("READ ");
+      Out_Operand(in->x);
+      break;
+    case IR_WRITE:
+      Out_Str("WRITE ");
+      Out_Operand(in->x);
+      break;
+    default:
+      assert(0);
+  }
+  Out_Str(end);
+}
+
+void IR_Print(FILE* fp) {
+  out_fp = fp;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next) {
+    Out_Str("FUNCTION ");
+    Out_Str(func->name);
+    Out_Str(" :\n");
+    for (int i = 0; i < func->len; i++)
+      if (func->code[i].op != IR_NOP) Out_Instr(&func->code[i], "\n");
+    Out_Str("\n");
+  }
+  Out_Flush();
+  fflush(fp);
+}
+
+// 单独输出一条指令, 以end结尾
+void IR_PrintInstr(FILE* fp, const Instr* in, const char* end) {
+  out_fp = fp;
+  Out_Instr(in, end);
+  Out_Flush();
+}
+
+// 标号按出现顺序在整个程序中重新编号
+void IR_RenumberLabels() {
+  int* map = calloc(ctx->label_max + 1, sizeof(int));
+  int n = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next)
+    for (int i = 0; i < func->len; i++)
+      if (func->code[i].op == IR_LABEL) map[func->code[i].x.no] = ++n;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next)
+    for (int i = 0; i < func->len; i++) {
+      Operand* ops = &func->code[i].x;
+      for (int k = 0; k < 3; k++)
+        if (ops[k].kind == O_LABEL) ops[k].no = map[ops[k].no];
+    }
+  free(map);
+  ctx->label_max = n;
+}
+
+// 统计函数数, 指令数, 各函数中不同的临时变量和变量数之和, 以及每个名字
+// 占4字节(DEC的按其大小)时栈帧的总大小
+void IR_Stats(FILE* fp, const char* when) {
+  int funcs = 0, instrs = 0, nmax = -1;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next)
+    for (int i = 0; i < func->len; i++) {
+      const Operand* ops = &func->code[i].x;
+      for (int k = 0; k < 3; k++)
+        if ((ops[k].kind == O_TEMP || ops[k].kind == O_VAR) &&
+            ops[k].no > nmax)
+          nmax = ops[k].no;
+    }
+  // 按函数编号标记已计过的名字, 免得每个函数清零
+  int* tseen = calloc(nmax + 2, sizeof(int));
+  int* vseen = calloc(nmax + 2, sizeof(int));
+  int temps = 0, vars = 0;
+  long frame = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next) {
+    funcs++;
+    for (int i = 0; i < func->len; i++) {
+      const Instr* in = &func->code[i];
+      if (in->op == IR_NOP) continue;
+      instrs++;
+      if (in->op == IR_DEC) frame += in->y.ival - 4;
+      const Operand* ops = &in->x;
+      for (int k = 0; k < 3; k++) {
+        if (ops[k].kind != O_TEMP && ops[k].kind != O_VAR) continue;
+        int* seen = ops[k].kind == O_TEMP ? tseen : vseen;
+        if (seen[ops[k].no] == funcs) continue;
+        seen[ops[k].no] = funcs;
+        if (ops[k].kind == O_TEMP)
+          temps++;
+        else
+          vars++;
+        frame += 4;
+      }
+    }
+  }
+  free(tseen);
+  free(vseen);
+  fprintf(fp,
+          "%-8s functions %d, instructions %d, temps %d, vars %d, "
+          "frame %ld bytes\n",
+          when, funcs, instrs, temps, vars, frame);
+}
+
+// 输出并释放已生成的函数, 标号继续累加; 用于流水线模式逐个输出
+void IR_Drain(FILE* fp) {
+  int label_max = ctx->label_max;
+  IR_Print(fp);
+  IR_Free();
+  ctx->label_max = label_max;
+}
+
+void IR_Free() {
+  IRFunc* func = ctx->ir_funcs;
+  while (func) {
+    IRFunc* next = func->next;
+    free(func->code);
+    free(func);
+    func = next;
+  }
+  ctx->ir_funcs = ctx->ir_tail = NULL;
+  ctx->label_max = 0;
+}
@@ -0,0 +1,115 @@
+#ifndef IR_H
+#define IR_H
+
+#include "compiler.h"
+#include "stdio.h"
+
+/*
+中间代码(三地址码)在内存中的表示:
+-- 程序由函数组成, 每个函数是一个指令数组
+-- 指令由操作码和至多三个操作数(x, y, z)组成
+-- IR_Print按原有的文本格式输出
+*/
+
+typedef struct Operand Operand;
+typedef struct Instr Instr;
+typedef struct IRFunc IRFunc;
+
+// 操作数
+struct Operand {
+  enum { O_NONE, O_TEMP, O_VAR, O_CONST, O_FCONST, O_LABEL, O_FUNC } kind;
+  union {
+    int no;            // 临时变量, 变量, 标号的编号
+    int ival;          // 整型常量
+    float fval;        // 浮点常量
+    const char* name;  // 函数名(驻留)
+  };
+};
+
+// 操作码
+enum {
+  IR_LABEL,   // LABEL x :
+  IR_ASSIGN,  // x := y
+  IR_ADD,     // x := y + z
+  IR_SUB,     // x := y - z
+  IR_MUL,     // x := y * z
+  IR_DIV,     // x := y / z
+  IR_ADDR,    // x := &y
+  IR_LOAD,    // x := *y
+  IR_STORE,   // *x := y
+  IR_GOTO,    // GOTO x
+  IR_IF,      // IF y relop z GOTO x
+  IR_RETURN,  // RETURN x
+  IR_DEC,     // DEC x y
+  IR_ARG,     // ARG x
+  IR_CALL,    // x := CALL y
+  IR_PARAM,   // PARAM x
+  IR_READ,    // READ x
+  IR_WRITE,   // WRITE x
+  IR_NOP,     // 已删除, 由IR_Compact清除
+};
+
+// 比较运算符
+enum { RELOP_EQ, RELOP_NE, RELOP_LT, RELOP_GT, RELOP_LE, RELOP_GE };
+
+struct Instr {
+  int op, relop;
+  Operand x, y, z;
+};
+
+// 函数
+struct IRFunc {
+  const char* name;
+  Instr* code;
+  int len, cap;
+  IRFunc* next;
+};
+
+// 按定义顺序排列的函数为ctx->ir_funcs
+
+static inline Operand OpTemp(int no) {
+  Operand op = {.kind = O_TEMP, .no = no};
+  return op;
+}
+static inline Operand OpVar(int no) {
+  Operand op = {.kind = O_VAR, .no = no};
+  return op;
+}
+static inline Operand OpConst(int ival) {
+  Operand op = {.kind = O_CONST, .ival = ival};
+  return op;
+}
+static inline Operand OpFConst(float fval) {
+  Operand op = {.kind = O_FCONST, .fval = fval};
+  return op;
+}
+static inline Operand OpLabel(int no) {
+  Operand op = {.kind = O_LABEL, .no = no};
+  return op;
+}
+static inline Operand OpFunc(const char* name) {
+  Operand op = {.kind = O_FUNC, .name = name};
+  return op;
+}
+static inline Operand OpNone() {
+  Operand op = {.kind = O_NONE};
+  return op;
+}
+
+#define IR_Emit1(op, x) IR_Emit(op, x, OpNone(), OpNone())
+#define IR_Emit2(op, x, y) IR_Emit(op, x, y, OpNone())
+
+// 比较运算符的词素(>, <, >=, <=, ==, !=)对应的RELOP_*
+extern int IR_Relop(const char* text, int len);
+extern IRFunc* IR_NewFunc(const char* name);
+extern Instr* IR_Emit(int op, Operand x, Operand y, Operand z);
+extern Instr* IR_EmitIf(int relop, Operand y, Operand z, int label);
+extern int IR_NewLabel();
+extern void IR_Print(FILE* fp);
+extern void IR_PrintInstr(FILE* fp, const Instr* in, const char* end);
+extern void IR_RenumberLabels();
+extern void IR_Stats(FILE* fp, const char* when);
+extern void IR_Free();
+extern void IR_Drain(FILE* fp);
+
+#endif
@@ -0,0 +1,943 @@
+#define _DEFAULT_SOURCE
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include "assert.h"
+#include "cfg.h"
+#include "ir.h"
+#include "liveness.h"
+#include "opt.h"
+#include "regalloc.h"
+#include "setjmp.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/mman.h"
+#include "time.h"
+
+// 寄存器编号
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// 分配给名字的寄存器, 前NCALLER个调用C函数时要保存; rax, rcx, rdx, rdi
+// 为临时寄存器, rbx为帧, r15为内存
+#define NREG 9
+#define NCALLER 5
+static const int alloc_regs[NREG] = {RSI, R8, R9, R10, R11, RBP, R12, R13, R14};
+
+#define MEM_SIZE (1ULL << 32)  // 任何32位偏移都落在内存中
+#define STACK_LIMIT 0x7FF00000  // 帧的上限, 可以作为32位立即数比较
+#define NATIVE_STACK (1ULL << 30)  // 机器栈, 放返回地址和保存的寄存器
+
+// 运行时错误
+enum { FAIL_DIV_ZERO = 1, FAIL_OVERFLOW, FAIL_UNDEFINED, FAIL_BAD_ADDRESS };
+
+typedef struct Fixup {
+  int pos;     // rel32所在的位置
+  int target;  // 标号或函数下标
+} Fixup;
+
+typedef struct Jit {
+  unsigned char* buf;
+  int len, cap;
+  Fixup *calls, *jumps;
+  int ncall, callcap, njump, jumpcap;
+  int fail_stub[5];  // 各种错误的处理代码
+  // 当前函数
+  OpMap m;
+  int* home;  // 名字 -> 寄存器, 不在寄存器中为-1
+  int* off;   // 名字 -> 帧中的字偏移
+  int frame, nparam;
+  int top;          // 帧中存放帧末尾地址的字偏移, 没有访存时为-1
+  int used[NREG];   // 用到的寄存器
+  int* label;       // 标号 -> 代码位置
+  int lmin;
+} Jit;
+
+static __thread FILE *jit_in, *jit_out;
+static __thread jmp_buf jit_fail;
+
+static int Jit_Read() {
+  int v = 0;
+  if (fscanf(jit_in, "%d", &v) != 1) v = 0;
+  return v;
+}
+
+static void Jit_Write(int v) { fprintf(jit_out, "%d\n", v); }
+
+static void Jit_Fail(int code) { longjmp(jit_fail, code); }
+
+/* 编码 */
+
+static void Byte(Jit* j, int b) {
+  if (j->len == j->cap) {
+    j->cap = j->cap ? 2 * j->cap : 4096;
+    j->buf = realloc(j->buf, j->cap);
+  }
+  j->buf[j->len++] = (unsigned char)b;
+}
+
+// 用多字节nop填充到n字节对齐; 代码映射在页边界上, 缓冲区中对齐即对齐
+static void Align(Jit* j, int n) {
+  static const unsigned char nops[][9] = {
+      {0x90},
+      {0x66, 0x90},
+      {0x0F, 0x1F, 0x00},
+      {0x0F, 0x1F, 0x40, 0x00},
+      {0x0F, 0x1F, 0x44, 0x00, 0x00},
+      {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+      {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+      {0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+  };
+  for (int pad = -j->len & (n - 1); pad > 0;) {
+    int k = pad < 9 ? pad : 9;
+    for (int b = 0; b < k; b++) Byte(j, nops[k - 1][b]);
+    pad -= k;
+  }
+}
+
+static void Int32(Jit* j, int v) {
+  for (int k = 0; k < 4; k++) Byte(j, (unsigned)v >> (8 * k));
+}
+
+static void Int64(Jit* j, uint64_t v) {
+  for (int k = 0; k < 8; k++) Byte(j, (int)(v >> (8 * k)));
+}
+
+static void Patch32(Jit* j, int pos, int v) {
+  for (int k = 0; k < 4; k++) j->buf[pos + k] = (unsigned)v >> (8 * k);
+}
+
+static void Rex(Jit* j, int w, int reg, int base) {
+  int rex = 0x40 | w << 3 | (reg & 8) >> 1 | (base & 8) >> 3;
+  if (rex != 0x40) Byte(j, rex);
+}
+
+// 一或两字节(0F xx)的操作码
+static void Opcode(Jit* j, int op) {
+  if (op > 0xFF) Byte(j, op >> 8);
+  Byte(j, op & 0xFF);
+}
+
+// op reg, rm (寄存器之间)
+static void Op_RR(Jit* j, int op, int w, int reg, int rm) {
+  Rex(j, w, reg, rm);
+  Opcode(j, op);
+  Byte(j, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// op reg, [base + disp]
+static void Op_RM(Jit* j, int op, int w, int reg, int base, int disp) {
+  Rex(j, w, reg, base);
+  Opcode(j, op);
+  Byte(j, 0x80 | (reg & 7) << 3 | (base & 7));
+  if ((base & 7) == RSP) Byte(j, 0x24);
+  Int32(j, disp);
+}
+
+// op reg, [r15 + idx]
+static void Op_RMem(Jit* j, int op, int reg, int idx) {
+  Byte(j, 0x41 | (reg & 8) >> 1 | (idx & 8) >> 2);
+  Opcode(j, op);
+  Byte(j, 0x04 | (reg & 7) << 3);
+  Byte(j, (idx & 7) << 3 | 0x07);  // SIB: base r15
+}
+
+static void Mov_RI(Jit* j, int reg, int imm) {
+  if (!imm) {
+    Op_RR(j, 0x31, 0, reg, reg);  // xor
+    return;
+  }
+  Rex(j, 0, 0, reg);
+  Byte(j, 0xB8 + (reg & 7));
+  Int32(j, imm);
+}
+
+static void Mov_RI64(Jit* j, int reg, uint64_t imm) {
+  Rex(j, 1, 0, reg);
+  Byte(j, 0xB8 + (reg & 7));
+  Int64(j, imm);
+}
+
+static void Push(Jit* j, int reg) {
+  Rex(j, 0, 0, reg);
+  Byte(j, 0x50 + (reg & 7));
+}
+
+static void Pop(Jit* j, int reg) {
+  Rex(j, 0, 0, reg);
+  Byte(j, 0x58 + (reg & 7));
+}
+
+// lea r64, [base + disp]
+static void Lea(Jit* j, int reg, int base, int disp) {
+  Op_RM(j, 0x8D, 1, reg, base, disp);
+}
+
+// lea r32, [base + index * 2^shift + disp], 没有index时为-1
+static void Lea_Index(Jit* j, int reg, int base, int index, int shift,
+                      int disp) {
+  int mod = !disp && (base & 7) != RBP ? 0 : disp == (signed char)disp ? 1 : 2;
+  int rex = 0x40 | (reg & 8) >> 1 | (index >= 0 ? index & 8 : 0) >> 2 |
+            (base & 8) >> 3;
+  if (rex != 0x40) Byte(j, rex);
+  Byte(j, 0x8D);
+  Byte(j, mod << 6 | (reg & 7) << 3 | 0x04);
+  Byte(j, shift << 6 | (index >= 0 ? index & 7 : 4) << 3 | (base & 7));
+  if (mod == 1) Byte(j, disp);
+  if (mod == 2) Int32(j, disp);
+}
+
+// jmp/jcc rel32, 返回rel32的位置
+static int Jump(Jit* j, int cc) {
+  if (cc < 0)
+    Byte(j, 0xE9);
+  else
+    Opcode(j, 0x0F80 | cc);
+  Int32(j, 0);
+  return j->len - 4;
+}
+
+static void Land(Jit* j, int pos) { Patch32(j, pos, j->len - pos - 4); }
+
+static void Jump_To(Jit* j, int cc, int target) {
+  int pos = Jump(j, cc);
+  Patch32(j, pos, target - pos - 4);
+}
+
+// 调用C函数: 保存调用时会被破坏的分配寄存器, 对齐栈
+static void Call_C(Jit* j, void* fn) {
+  for (int r = 0; r < NCALLER; r++)
+    if (j->used[r]) Push(j, alloc_regs[r]);
+  Op_RR(j, 0x8B, 1, RAX, RSP);  // mov rax, rsp
+  Rex(j, 1, 0, RSP);            // and rsp, -16
+  Byte(j, 0x83);
+  Byte(j, 0xE4);
+  Byte(j, 0xF0);
+  Push(j, RAX);
+  Rex(j, 1, 0, RSP);  // sub rsp, 8
+  Byte(j, 0x83);
+  Byte(j, 0xEC);
+  Byte(j, 0x08);
+  Mov_RI64(j, RAX, (uint64_t)(uintptr_t)fn);
+  Byte(j, 0xFF);  // call rax
+  Byte(j, 0xD0);
+  Rex(j, 1, 0, RSP);  // add rsp, 8
+  Byte(j, 0x83);
+  Byte(j, 0xC4);
+  Byte(j, 0x08);
+  Byte(j, 0x5C);  // pop rsp
+  for (int r = NCALLER - 1; r >= 0; r--)
+    if (j->used[r]) Pop(j, alloc_regs[r]);
+}
+
+/* 操作数 */
+
+enum { S_IMM, S_REG, S_MEM };
+
+typedef struct Src {
+  int kind, v;
+} Src;
+
+static Src Source(const Jit* j, Operand op) {
+  if (op.kind == O_CONST) return (Src){S_IMM, op.ival};
+  if (op.kind == O_FCONST) return (Src){S_IMM, (int)op.fval};
+  int k = OpMap_Index(&j->m, op);
+  if (j->home[k] >= 0) return (Src){S_REG, j->home[k]};
+  return (Src){S_MEM, 4 * j->off[k]};
+}
+
+static void Load(Jit* j, int reg, Operand op) {
+  Src s = Source(j, op);
+  if (s.kind == S_IMM)
+    Mov_RI(j, reg, s.v);
+  else if (s.kind == S_REG) {
+    if (s.v != reg) Op_RR(j, 0x8B, 0, reg, s.v);
+  } else
+    Op_RM(j, 0x8B, 0, reg, RBX, s.v);
+}
+
+static void Store(Jit* j, Operand op, int reg) {
+  Src s = Source(j, op);
+  if (s.kind == S_REG) {
+    if (s.v != reg) Op_RR(j, 0x8B, 0, s.v, reg);
+  } else
+    Op_RM(j, 0x89, 0, reg, RBX, s.v);
+}
+
+// 双操作数的运算 reg = reg op src; ops为 {r, r/m} 形式的操作码和立即数形式的 /n
+static void Arith(Jit* j, int op, int ext, int reg, Src s) {
+  if (s.kind == S_IMM) {
+    if (op == 0x0FAF && Pow2_Shift(s.v) > 0) {  // shl reg, imm8
+      Op_RR(j, 0xC1, 0, 4, reg);
+      Byte(j, Pow2_Shift(s.v));
+    } else if (s.v == (signed char)s.v) {  // imm8的形式
+      Op_RR(j, op == 0x0FAF ? 0x6B : 0x83, 0, op == 0x0FAF ? reg : ext, reg);
+      Byte(j, s.v);
+    } else if (op == 0x0FAF) {  // imul reg, reg, imm32
+      Op_RR(j, 0x69, 0, reg, reg);
+      Int32(j, s.v);
+    } else {
+      Op_RR(j, 0x81, 0, ext, reg);
+      Int32(j, s.v);
+    }
+  } else if (s.kind == S_REG)
+    Op_RR(j, op, 0, reg, s.v);
+  else
+    Op_RM(j, op, 0, reg, RBX, s.v);
+}
+
+/* 翻译一个函数 */
+
+// 比较运算符对应的条件码
+static const int cc_of[] = {0x4, 0x5, 0xC, 0xF, 0xE, 0xD};
+static const int swap_relop[] = {RELOP_EQ, RELOP_NE, RELOP_GT,
+                                 RELOP_LT, RELOP_GE, RELOP_LE};
+
+static void Jump_Label(Jit* j, int cc, int label) {
+  if (j->njump == j->jumpcap) {
+    j->jumpcap = j->jumpcap ? 2 * j->jumpcap : 64;
+    j->jumps = realloc(j->jumps, j->jumpcap * sizeof(Fixup));
+  }
+  j->jumps[j->njump++] = (Fixup){Jump(j, cc), label};
+}
+
+// 线性扫描分配寄存器
+static void Assign_Homes(Jit* j, IRFunc* func, const char* taken) {
+  int size = OpMap_Size(&j->m);
+  int* reg = RegAlloc_Linear(func, &j->m, taken, NREG);
+  for (int r = 0; r < NREG; r++) j->used[r] = 0;
+  for (int k = 0; k < size; k++) {
+    j->home[k] = reg[k] >= 0 ? alloc_regs[reg[k]] : -1;
+    if (reg[k] >= 0) j->used[reg[k]] = 1;
+  }
+  free(reg);
+}
+
+static void Prologue(Jit* j, IRFunc* func, const char* taken) {
+  for (int r = 0; r < NREG; r++)
+    if (j->used[r]) Push(j, alloc_regs[r]);
+  // 栈溢出检查: 帧的末尾超过STACK_LIMIT, 或者机器栈低于下限
+  Lea(j, RAX, RBX, 4 * j->frame);
+  Op_RR(j, 0x2B, 1, RAX, R15);  // sub rax, r15
+  Op_RR(j, 0x81, 1, 7, RAX);    // cmp rax, imm32
+  Int32(j, STACK_LIMIT);
+  Jump_To(j, 0x7, j->fail_stub[FAIL_OVERFLOW]);  // ja
+  Op_RM(j, 0x3B, 1, RSP, R15, STACK_LIMIT);      // cmp rsp, 栈的下限
+  Jump_To(j, 0x2, j->fail_stub[FAIL_OVERFLOW]);  // jb
+  if (j->top >= 0) Op_RM(j, 0x89, 0, RAX, RBX, 4 * j->top);
+
+  // 形参从帧开头的实参取到它的位置
+  for (int p = 0; p < j->nparam; p++) {
+    int k = OpMap_Index(&j->m, func->code[p].x);
+    if (j->home[k] >= 0) Op_RM(j, 0x8B, 0, j->home[k], RBX, 4 * p);
+  }
+
+  // 进入时就活跃(先使用后定值)的名字和内存中的变量清零
+  if (!func->len) return;
+  CFG* cfg = CFG_Build(func);
+  Liveness* lv = Liveness_Build(cfg, &j->m, taken);
+  int size = OpMap_Size(&j->m);
+  for (int k = 0; k < size; k++) {
+    int param = 0;
+    for (int p = 0; p < j->nparam; p++)
+      if (OpMap_Index(&j->m, func->code[p].x) == k) param = 1;
+    if (param || (!taken[k] && !Live_In(lv, 0, k))) continue;
+    if (j->home[k] >= 0)
+      Mov_RI(j, j->home[k], 0);
+    else {
+      Op_RM(j, 0xC7, 0, 0, RBX, 4 * j->off[k]);
+      Int32(j, 0);
+    }
+  }
+  Liveness_Free(lv);
+  CFG_Free(cfg);
+}
+
+// 访存的地址须在活跃的帧中, 即低于当前帧的末尾, 与解释器相同
+static void Check_Address(Jit* j, int idx) {
+  Op_RM(j, 0x3B, 0, idx, RBX, 4 * j->top);            // cmp idx, [帧末尾]
+  Jump_To(j, 0x3, j->fail_stub[FAIL_BAD_ADDRESS]);  // jae
+}
+
+static void Epilogue(Jit* j) {
+  for (int r = NREG - 1; r >= 0; r--)
+    if (j->used[r]) Pop(j, alloc_regs[r]);
+  Byte(j, 0xC3);
+}
+
+static void Binary(Jit* j, const Instr* in) {
+  static const int ops[] = {[IR_ADD] = 0x03, [IR_SUB] = 0x2B, [IR_MUL] = 0x0FAF};
+  static const int exts[] = {[IR_ADD] = 0, [IR_SUB] = 5, [IR_MUL] = 0};
+  Operand y = in->y, z = in->z;
+  Src x = Source(j, in->x);
+  int d = x.kind == S_REG ? x.v : RAX;
+  Src sz = Source(j, z);
+  // 常量放在右边, 用立即数形式
+  if (in->op != IR_SUB && Source(j, y).kind == S_IMM && sz.kind != S_IMM) {
+    Operand t = y;
+    y = z, z = t;
+    sz = Source(j, z);
+  }
+  // 结果的寄存器与两个操作数都不同时用lea, 省去一条mov
+  Src sy = Source(j, y);
+  if (x.kind == S_REG && sy.kind == S_REG && sy.v != d &&
+      (sz.kind != S_REG || sz.v != d)) {
+    if (in->op == IR_ADD && sz.kind == S_REG) {
+      Lea_Index(j, d, sy.v, sz.v, 0, 0);
+      return;
+    }
+    if (in->op != IR_MUL && sz.kind == S_IMM && sz.v != (int)0x80000000) {
+      Lea_Index(j, d, sy.v, -1, 0, in->op == IR_ADD ? sz.v : -sz.v);
+      return;
+    }
+  }
+  if (sz.kind == S_REG && sz.v == d) {
+    if (in->op == IR_SUB)
+      d = RAX;
+    else {
+      Operand t = y;
+      y = z, z = t;
+    }
+  }
+  Load(j, d, y);
+  Arith(j, ops[in->op], exts[in->op], d, Source(j, z));
+  Store(j, in->x, d);
+}
+
+static void Divide(Jit* j, const Instr* in) {
+  Load(j, RAX, in->y);
+  Src s = Source(j, in->z);
+  if (s.kind == S_IMM && s.v == 0) {
+    Jump_To(j, -1, j->fail_stub[FAIL_DIV_ZERO]);
+    return;
+  }
+  if (s.kind == S_IMM && s.v == -1) {
+    Op_RR(j, 0xF7, 0, 3, RAX);  // neg eax
+  } else if (s.kind == S_IMM) {
+    // 除以常量: q = n * m >> (31 + l)取下整, n为负时加1即向零取整;
+    // l = ceil(log2|d|), m = 2^(31 + l) / |d| + 1 不超过2^32, 乘积不溢出
+    unsigned a = s.v < 0 ? -(unsigned)s.v : (unsigned)s.v;
+    int l = 0;
+    while ((1ULL << l) < a) l++;
+    Op_RR(j, 0x63, 1, RDX, RAX);  // movsxd rdx, eax
+    Mov_RI64(j, RAX, (1ULL << (31 + l)) / a + 1);
+    Op_RR(j, 0x0FAF, 1, RAX, RDX);  // imul rax, rdx
+    Op_RR(j, 0xC1, 1, 7, RAX);      // sar rax, 31 + l
+    Byte(j, 31 + l);
+    Op_RR(j, 0xC1, 0, 5, RDX);  // shr edx, 31
+    Byte(j, 31);
+    Op_RR(j, 0x03, 0, RAX, RDX);  // add eax, edx
+    if (s.v < 0) Op_RR(j, 0xF7, 0, 3, RAX);
+  } else {
+    Load(j, RCX, in->z);
+    int neg = -1, done = -1;
+    if (s.kind != S_IMM) {
+      Op_RR(j, 0x85, 0, RCX, RCX);  // test ecx, ecx
+      Jump_To(j, 0x4, j->fail_stub[FAIL_DIV_ZERO]);
+      Op_RR(j, 0x81, 0, 7, RCX);  // cmp ecx, -1
+      Int32(j, -1);
+      neg = Jump(j, 0x4);
+    }
+    Byte(j, 0x99);              // cdq
+    Op_RR(j, 0xF7, 0, 7, RCX);  // idiv ecx
+    if (neg >= 0) {
+      done = Jump(j, -1);
+      Land(j, neg);
+      Op_RR(j, 0xF7, 0, 3, RAX);
+      Land(j, done);
+    }
+  }
+  Store(j, in->x, RAX);
+}
+
+// invert时条件不成立才跳转到label
+static void Branch(Jit* j, const Instr* in, int invert, int label) {
+  Operand y = in->y, z = in->z;
+  int relop = in->relop;
+  if (Source(j, y).kind == S_IMM && Source(j, z).kind != S_IMM) {
+    Operand t = y;
+    y = z, z = t;
+    relop = swap_relop[relop];
+  }
+  Src sy = Source(j, y);
+  int reg = sy.kind == S_REG ? sy.v : RAX;
+  Load(j, reg, y);
+  Arith(j, 0x3B, 7, reg, Source(j, z));
+  Jump_Label(j, cc_of[relop] ^ invert, label);  // 相反的条件码只差最低位
+}
+
+/* 块内的复制
+-- -O0的每个表达式都先算到新的临时变量再复制给变量, 翻译成机器码后是
+   一串mov; 在块内把复制向后传播, 把 x := y op z; y := x 合并为
+   y := y op z
+-- 只改写块内的使用, 不增加任何名字的块间活跃性, 所以整个函数只需求
+   一次活跃性; 访存和除法一条也不删, 运行时错误与解释器相同
+*/
+
+static int Is_Name(const OpMap* m, const char* taken, Operand op) {
+  int k = OpMap_Index(m, op);
+  return k >= 0 && !taken[k];
+}
+
+// 把块[i + 1, last)中x := y之后对x的使用改为y, 直到x或y被重新定值;
+// 改完所有的使用且x不再活跃时删去这条复制
+static void Forward_Copy(IRFunc* func, const OpMap* m, const Liveness* lv,
+                         int b, int i) {
+  Instr* copy = &func->code[i];
+  Operand x = copy->x, y = copy->y;
+  int last = lv->cfg->blocks[b].last, keep = 0, redef = 0, moved = 0;
+  Operand* u[2];
+  for (int k = i + 1; k < last && !redef; k++) {
+    Instr* in = &func->code[k];
+    int n = Instr_Uses(in, u);
+    for (int e = 0; e < n; e++)
+      if (Op_Equal(*u[e], x)) {
+        if (moved)
+          keep = 1;
+        else
+          *u[e] = y;
+      }
+    Operand* d = Instr_Def(in);
+    if (d && Op_Equal(*d, x)) redef = 1;
+    if (d && Op_Equal(*d, y)) moved = 1;
+  }
+  if (!keep && (redef || !Live_Out(lv, b, OpMap_Index(m, x))))
+    copy->op = IR_NOP;
+}
+
+// x := y op z; y := x, 此后块中对x的使用在y被重新定值之前, 且x不再
+// 活跃: 改为y := y op z, 后面的x改为y
+static void Fold_Copy(IRFunc* func, const OpMap* m, const Liveness* lv,
+                      int b, int i) {
+  Instr *in = &func->code[i], *copy = &func->code[i + 1];
+  Operand x = in->x, y = copy->x;
+  int last = lv->cfg->blocks[b].last, redef = 0, moved = 0, k;
+  Operand* u[2];
+  for (k = i + 2; k < last && !redef; k++) {
+    Instr* c = &func->code[k];
+    int n = Instr_Uses(c, u);
+    for (int e = 0; e < n; e++)
+      if (moved && Op_Equal(*u[e], x)) return;
+    Operand* d = Instr_Def(c);
+    if (d && Op_Equal(*d, x)) redef = 1;
+    if (d && Op_Equal(*d, y)) moved = 1;
+  }
+  if (!redef && Live_Out(lv, b, OpMap_Index(m, x))) return;
+  in->x = y;
+  copy->op = IR_NOP;
+  for (k = i + 2; k < last; k++) {
+    Instr* c = &func->code[k];
+    int n = Instr_Uses(c, u);
+    for (int e = 0; e < n; e++)
+      if (Op_Equal(*u[e], x)) *u[e] = y;
+    Operand* d = Instr_Def(c);
+    if (d && Op_Equal(*d, x)) break;
+  }
+}
+
+static void Local_Copies(IRFunc* func, const OpMap* m, const char* taken) {
+  if (!func->len) return;
+  CFG* cfg = CFG_Build(func);
+  Liveness* lv = Liveness_Build(cfg, m, taken);
+  for (int b = 0; b < cfg->nblock; b++)
+    for (int i = cfg->blocks[b].first; i < cfg->blocks[b].last; i++) {
+      Instr* in = &func->code[i];
+      if (in->op == IR_ASSIGN && Is_Name(m, taken, in->x) &&
+          !Op_Equal(in->x, in->y) &&
+          (in->y.kind == O_CONST || Is_Name(m, taken, in->y)))
+        Forward_Copy(func, m, lv, b, i);
+      else if ((in->op == IR_ADD || in->op == IR_SUB || in->op == IR_MUL ||
+                in->op == IR_DIV) &&
+               i + 1 < cfg->blocks[b].last && in[1].op == IR_ASSIGN &&
+               Op_Equal(in[1].y, in->x) && Is_Name(m, taken, in->x) &&
+               Is_Name(m, taken, in[1].x) && !Op_Equal(in->x, in[1].x))
+        Fold_Copy(func, m, lv, b, i);
+    }
+  Liveness_Free(lv);
+  CFG_Free(cfg);
+}
+
+// x := a * 2^s; x := b + x (s = 1, 2, 3)合并为lea, 常用于数组下标
+static int Scaled_Add(Jit* j, const Instr* mul, const Instr* add) {
+  Operand a = mul->y, c = mul->z;
+  if (a.kind == O_CONST) a = mul->z, c = mul->y;
+  if (a.kind == O_CONST || c.kind != O_CONST || add->op != IR_ADD ||
+      !Op_Equal(add->x, mul->x))
+    return 0;
+  int shift = Pow2_Shift(c.ival);
+  Operand b = Op_Equal(add->z, mul->x) ? add->y : add->z;
+  if (shift < 1 || shift > 3 || b.kind == O_CONST || Op_Equal(b, mul->x) ||
+      (!Op_Equal(add->y, mul->x) && !Op_Equal(add->z, mul->x)))
+    return 0;
+  Src x = Source(j, mul->x), sa = Source(j, a), sb = Source(j, b);
+  int d = x.kind == S_REG ? x.v : RAX;
+  int ra = sa.kind == S_REG ? sa.v : RCX, rb = sb.kind == S_REG ? sb.v : RDX;
+  Load(j, ra, a);
+  Load(j, rb, b);
+  Lea_Index(j, d, rb, ra, shift, 0);
+  Store(j, mul->x, d);
+  return 1;
+}
+
+// 函数体中从i开始的连续ARG直到CALL, 返回CALL的下标, 不是这种形式为-1
+static int Call_Of(const IRFunc* func, int i) {
+  while (i < func->len && func->code[i].op == IR_ARG) i++;
+  return i < func->len && func->code[i].op == IR_CALL ? i : -1;
+}
+
+static int Find_Func(const char* name) {
+  int k = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next, k++)
+    if (func->name == name) return k;
+  return -1;
+}
+
+// 翻译一个函数, 不支持的形式返回0
+static int Compile_Func(Jit* j, IRFunc* func) {
+  // ARG须连续地紧接CALL, PARAM须在函数开头
+  for (int i = 0, params = 1; i < func->len; i++) {
+    int op = func->code[i].op;
+    if ((op == IR_ARG && Call_Of(func, i) < 0) || (op == IR_PARAM && !params))
+      return 0;
+    if (op != IR_PARAM) params = 0;
+  }
+  // -O0的变量都在帧中, 每次读写都经过内存; 能提升的先提升为名字,
+  // 和临时变量一起分配寄存器
+  Opt_Mem2Reg(func);
+  OpMap_Init(&j->m, func);
+  int size = OpMap_Size(&j->m), n = func->len;
+  char* taken = Func_AddrTaken(func, &j->m);
+  Local_Copies(func, &j->m, taken);
+  j->home = malloc((size + 1) * sizeof(int));
+  j->off = malloc((size + 1) * sizeof(int));
+  j->nparam = 0;
+  while (j->nparam < n && func->code[j->nparam].op == IR_PARAM) j->nparam++;
+
+  // 帧: 实参, 帧的末尾(有访存时), 名字, DEC的区域; 形参直接用实参的
+  // 位置. 帧的末尾在数组之前, 数组向上越界写不到它
+  j->top = -1;
+  for (int i = 0; i < n; i++)
+    if (func->code[i].op == IR_LOAD || func->code[i].op == IR_STORE)
+      j->top = j->nparam;
+  j->frame = j->top >= 0 ? j->nparam + 1 : j->nparam;
+  for (int k = 0; k < size; k++) j->off[k] = j->frame + k;
+  for (int p = 0; p < j->nparam; p++)
+    j->off[OpMap_Index(&j->m, func->code[p].x)] = p;
+  j->frame += size;
+  int lmax = -1;
+  j->lmin = 0x7FFFFFFF;
+  for (int i = 0; i < n; i++) {
+    const Instr* in = &func->code[i];
+    if (in->op == IR_DEC) {
+      j->off[OpMap_Index(&j->m, in->x)] = j->frame;
+      j->frame += (in->y.ival + 3) / 4;
+    }
+    if (in->op == IR_LABEL) {
+      if (in->x.no < j->lmin) j->lmin = in->x.no;
+      if (in->x.no > lmax) lmax = in->x.no;
+    }
+  }
+  int nlabel = lmax >= j->lmin ? lmax - j->lmin + 1 : 1;
+  j->label = malloc(nlabel * sizeof(int));
+  j->njump = 0;
+  // 循环头: 之后有跳转跳回的标号(1为已见过, 2为循环头)
+  char* head = calloc(nlabel, 1);
+  for (int i = 0; i < n; i++) {
+    const Instr* in = &func->code[i];
+    if (in->op == IR_LABEL)
+      head[in->x.no - j->lmin] = 1;
+    else if ((in->op == IR_GOTO || in->op == IR_IF) &&
+             head[in->x.no - j->lmin])
+      head[in->x.no - j->lmin] = 2;
+  }
+
+  Assign_Homes(j, func, taken);
+  Prologue(j, func, taken);
+  // 块中已检查过的地址, 重新定值之前再访问同一地址不必再检查
+  Operand checked = {.kind = O_NONE};
+  for (int i = j->nparam; i < n; i++) {
+    const Instr* in = &func->code[i];
+    Operand* def = Instr_Def(&func->code[i]);
+    switch (in->op) {
+      case IR_NOP:
+        break;
+      case IR_LABEL:
+        if (head[in->x.no - j->lmin] == 2) Align(j, 16);
+        j->label[in->x.no - j->lmin] = j->len;
+        checked.kind = O_NONE;
+        break;
+      case IR_ASSIGN: {
+        Src x = Source(j, in->x), y = Source(j, in->y);
+        if (x.kind == S_MEM && y.kind == S_IMM) {
+          Op_RM(j, 0xC7, 0, 0, RBX, x.v);
+          Int32(j, y.v);
+        } else if (x.kind == S_REG)
+          Load(j, x.v, in->y);
+        else {
+          Load(j, RAX, in->y);
+          Store(j, in->x, RAX);
+        }
+        break;
+      }
+      case IR_MUL:
+        if (i + 1 < n && Scaled_Add(j, in, in + 1)) {
+          i++;
+          break;
+        }
+      // fall through
+      case IR_ADD:
+      case IR_SUB:
+        Binary(j, in);
+        break;
+      case IR_DIV:
+        Divide(j, in);
+        break;
+      case IR_ADDR:
+        Lea(j, RAX, RBX, 4 * j->off[OpMap_Index(&j->m, in->y)]);
+        Op_RR(j, 0x2B, 1, RAX, R15);
+        Store(j, in->x, RAX);
+        break;
+      case IR_LOAD: {
+        Src x = Source(j, in->x), y = Source(j, in->y);
+        int idx = y.kind == S_REG ? y.v : RAX;
+        int d = x.kind == S_REG ? x.v : RAX;
+        Load(j, idx, in->y);
+        if (!Op_Equal(in->y, checked)) Check_Address(j, idx);
+        checked = in->y;
+        Op_RMem(j, 0x8B, d, idx);
+        Store(j, in->x, d);
+        break;
+      }
+      case IR_STORE: {
+        Src x = Source(j, in->x), y = Source(j, in->y);
+        int idx = x.kind == S_REG ? x.v : RAX;
+        Load(j, idx, in->x);
+        if (!Op_Equal(in->x, checked)) Check_Address(j, idx);
+        checked = in->x;
+        if (y.kind == S_IMM) {
+          Op_RMem(j, 0xC7, 0, idx);
+          Int32(j, y.v);
+        } else {
+          int v = y.kind == S_REG ? y.v : RCX;
+          Load(j, v, in->y);
+          Op_RMem(j, 0x89, v, idx);
+        }
+        break;
+      }
+      case IR_GOTO:
+        Jump_Label(j, -1, in->x.no);
+        break;
+      case IR_IF:
+        // IF c GOTO l1; GOTO l2; LABEL l1: 条件不成立时跳到l2
+        if (i + 2 < n && in[1].op == IR_GOTO && in[2].op == IR_LABEL &&
+            in[2].x.no == in->x.no) {
+          Branch(j, in, 1, in[1].x.no);
+          i++;
+        } else
+          Branch(j, in, 0, in->x.no);
+        break;
+      case IR_RETURN:
+        Load(j, RAX, in->x);
+        Epilogue(j);
+        break;
+      case IR_DEC:  // rep stosd清零
+        Lea(j, RDI, RBX, 4 * j->off[OpMap_Index(&j->m, in->x)]);
+        Mov_RI(j, RCX, (in->y.ival + 3) / 4);
+        Mov_RI(j, RAX, 0);
+        Byte(j, 0xF3);
+        Byte(j, 0xAB);
+        break;
+      case IR_ARG: {
+        // 第几个形参: 最后一个ARG是第一个形参
+        int p = Call_Of(func, i) - i - 1;
+        Src s = Source(j, in->x);
+        if (s.kind == S_IMM) {
+          Op_RM(j, 0xC7, 0, 0, RBX, 4 * (j->frame + p));
+          Int32(j, s.v);
+        } else {
+          int reg = s.kind == S_REG ? s.v : RAX;
+          Load(j, reg, in->x);
+          Op_RM(j, 0x89, 0, reg, RBX, 4 * (j->frame + p));
+        }
+        break;
+      }
+      case IR_CALL: {
+        int k = Find_Func(in->y.name);
+        if (k < 0) {
+          Jump_To(j, -1, j->fail_stub[FAIL_UNDEFINED]);
+          break;
+        }
+        Lea(j, RBX, RBX, 4 * j->frame);
+        Byte(j, 0xE8);
+        Int32(j, 0);
+        if (j->ncall == j->callcap) {
+          j->callcap = j->callcap ? 2 * j->callcap : 64;
+          j->calls = realloc(j->calls, j->callcap * sizeof(Fixup));
+        }
+        j->calls[j->ncall++] = (Fixup){j->len - 4, k};
+        Lea(j, RBX, RBX, -4 * j->frame);
+        Store(j, in->x, RAX);
+        break;
+      }
+      case IR_READ:
+        Call_C(j, (void*)Jit_Read);
+        Store(j, in->x, RAX);
+        break;
+      case IR_WRITE:
+        Load(j, RAX, in->x);
+        Op_RR(j, 0x8B, 0, RDI, RAX);
+        Call_C(j, (void*)Jit_Write);
+        break;
+      default:
+        assert(0);
+    }
+    if (def && Op_Equal(*def, checked)) checked.kind = O_NONE;
+  }
+  // 执行到末尾返回0
+  Mov_RI(j, RAX, 0);
+  Epilogue(j);
+
+  for (int k = 0; k < j->njump; k++)
+    Patch32(j, j->jumps[k].pos,
+            j->label[j->jumps[k].target - j->lmin] - j->jumps[k].pos - 4);
+  free(j->label);
+  free(head);
+  free(j->home);
+  free(j->off);
+  free(taken);
+  return 1;
+}
+
+// 入口: void entry(void* mem, void* stack), 保存C的被调用者保存寄存器,
+// 换到自己的栈上调用main; *call为call main的rel32的位置
+static int Emit_Entry(Jit* j, int* call) {
+  static const int saved[] = {RBX, RBP, R12, R13, R14, R15};
+  int at = j->len;
+  for (int k = 0; k < 6; k++) Push(j, saved[k]);
+  Op_RR(j, 0x8B, 1, R15, RDI);
+  Op_RR(j, 0x8B, 1, RBX, RDI);
+  Op_RR(j, 0x8B, 1, RAX, RSP);
+  Op_RR(j, 0x8B, 1, RSP, RSI);
+  Push(j, RAX);
+  Rex(j, 1, 0, RSP);  // sub rsp, 8: 对齐到16字节
+  Byte(j, 0x83);
+  Byte(j, 0xEC);
+  Byte(j, 0x08);
+  Byte(j, 0xE8);
+  Int32(j, 0);
+  *call = j->len - 4;
+  Rex(j, 1, 0, RSP);  // add rsp, 8
+  Byte(j, 0x83);
+  Byte(j, 0xC4);
+  Byte(j, 0x08);
+  Byte(j, 0x5C);  // pop rsp
+  for (int k = 5; k >= 0; k--) Pop(j, saved[k]);
+  Byte(j, 0xC3);
+  return at;
+}
+
+static void Emit_Stubs(Jit* j) {
+  for (int code = FAIL_DIV_ZERO; code <= FAIL_BAD_ADDRESS; code++) {
+    j->fail_stub[code] = j->len;
+    Mov_RI(j, RDI, code);
+    Rex(j, 1, 0, RSP);  // and rsp, -16
+    Byte(j, 0x83);
+    Byte(j, 0xE4);
+    Byte(j, 0xF0);
+    Mov_RI64(j, RAX, (uint64_t)(uintptr_t)Jit_Fail);
+    Byte(j, 0xFF);
+    Byte(j, 0xD0);
+  }
+}
+
+int JIT_Run(FILE* in, FILE* out, FILE* report) {
+  int nfunc = 0, main_k = -1;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next, nfunc++)
+    if (!strcmp(func->name, "main")) main_k = nfunc;
+  if (main_k < 0) {
+    fprintf(stderr, "runtime error: no main function\n");
+    return 1;
+  }
+
+  Jit j;
+  memset(&j, 0, sizeof(j));
+  Emit_Stubs(&j);
+  int call_main;
+  int entry = Emit_Entry(&j, &call_main);
+
+  int* start = malloc((nfunc + 1) * sizeof(int));
+  int k = 0;
+  IRFunc* func = ctx->ir_funcs;
+  for (; func; func = func->next, k++) {
+    start[k] = j.len;
+    if (!Compile_Func(&j, func)) break;
+  }
+  if (func) {
+    fprintf(stderr, "jit: unsupported IR in function %s\n", func->name);
+    free(start);
+    free(j.buf);
+    free(j.calls);
+    free(j.jumps);
+    return 1;
+  }
+  Patch32(&j, call_main, start[main_k] - call_main - 4);
+  for (int c = 0; c < j.ncall; c++)
+    Patch32(&j, j.calls[c].pos, start[j.calls[c].target] - j.calls[c].pos - 4);
+
+  int status = 1;
+  void* code = mmap(NULL, j.len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  void* mem = mmap(NULL, MEM_SIZE + 4096, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  void* stack = mmap(NULL, NATIVE_STACK, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (code == MAP_FAILED || mem == MAP_FAILED || stack == MAP_FAILED) {
+    perror("jit: mmap");
+  } else {
+    memcpy(code, j.buf, j.len);
+    mprotect(code, j.len, PROT_READ | PROT_EXEC);
+    // 栈的下限放在内存中帧的上限处, 留出调用C函数的空间
+    *(uint64_t*)((char*)mem + STACK_LIMIT) = (uint64_t)(uintptr_t)stack + 0x10000;
+    void (*run)(void*, void*) =
+        (void (*)(void*, void*))(void*)((unsigned char*)code + entry);
+    jit_in = in;
+    jit_out = out;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int fail = setjmp(jit_fail);
+    if (!fail) {
+      run(mem, (char*)stack + NATIVE_STACK);
+      status = 0;
+    } else
+      fprintf(stderr, "runtime error: %s\n",
+              fail == FAIL_DIV_ZERO      ? "division by zero"
+              : fail == FAIL_OVERFLOW    ? "stack overflow"
+              : fail == FAIL_BAD_ADDRESS ? "bad address"
+                                         : "call to undefined function");
+    fflush(out);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (report)
+      fprintf(report, "jit      code %d bytes, time %.3f s\n", j.len,
+              (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+  }
+  if (code != MAP_FAILED) munmap(code, j.len);
+  if (mem != MAP_FAILED) munmap(mem, MEM_SIZE + 4096);
+  if (stack != MAP_FAILED) munmap(stack, NATIVE_STACK);
+  free(start);
+  free(j.buf);
+  free(j.calls);
+  free(j.jumps);
+  return status;
+}
+
+#else
+
+int JIT_Run(FILE* in, FILE* out, FILE* report) {
+  (void)in, (void)out, (void)report;
+  fprintf(stderr, "jit: only supported on x86-64 Linux\n");
+  return 1;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "stdio.h"
+
+/*
+中间代码的即时编译(x86-64):
+-- 每个函数翻译成机器码, 放在mmap得到的可执行缓冲区中直接运行
+-- 内存与解释器相同: 所有栈帧在一块平坦的内存中, 地址为相对它的
+   32位字节偏移, r15为内存的起点, rbx为当前帧
+-- 调用约定: 调用者把实参按PARAM的顺序写到自己帧末尾之后(即被调用者
+   帧的开头), rbx移到那里再call, 返回值在eax; 被调用者保存它用到的
+   寄存器
+-- 名字用线性扫描(RegAlloc_Linear)分配到寄存器, 溢出的在帧中; 地址不
+   逃逸的变量先用Opt_Mem2Reg提升为名字, -O0时也不必每次读写帧
+-- 访存前检查地址低于当前帧的末尾(进入时存在帧中), 与解释器相同, 否则
+   为bad address
+-- READ, WRITE和运行时错误调用C函数
+*/
+
+// 从main开始执行, READ读in, WRITE写out; 出错或不支持时返回非零
+// report非空时输出用时; 中间代码被就地改写(提升变量)
+extern int JIT_Run(FILE* in, FILE* out, FILE* report);
+
+#endif
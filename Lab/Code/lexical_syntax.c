@@ -1,42 +1,77 @@
+#define _DEFAULT_SOURCE
 #include "lexical_syntax.h"
 
+#include "arena.h"
+#include "compiler.h"
+#include "intern.h"
+#include "ir.h"
 #include "lex.yy.c"
 #include "stdarg.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "time.h"
 
-int error_type = 0;
+#define AST_KIND_NAME(kind, name) name,
+const char* const node_names[N_KIND_NUM] = {AST_KINDS(AST_KIND_NAME)};
+#undef AST_KIND_NAME
 
-struct ast* root;
-
-void yyerror(char* msg) {
-  switch (error_type) {
+void yyerror(void* scanner, const char* msg) {
+  Compiler* c = yyget_extra(scanner);
+  int lineno = yyget_lineno(scanner);
+  switch (c->error_type) {
     case 1:
-      printf("Error type A at Line %d: Mysterious character \'%s\'.\n",
-             yylineno, msg);
+      fprintf(c->diag,
+              "Error type A at Line %d: Mysterious character \'%s\'.\n",
+              lineno, msg);
       break;
     case 2:
-      printf("Error type A at Line %d: Invalid ID \'%s\'.\n", yylineno, msg);
+      fprintf(c->diag, "Error type A at Line %d: Invalid ID \'%s\'.\n",
+              lineno, msg);
       break;
     default:
-      printf("Error type B at Line %d: %s.\n", yylineno, msg);
+      fprintf(c->diag, "Error type B at Line %d: %s.\n", lineno, msg);
       break;
   }
 
   // default
-  error_type = -1;
+  c->error_type = -1;
 }
 
-struct ast* newnode(char* name, int num, ...) {
-  struct ast* node = malloc(sizeof(struct ast));
+struct ast* newnode(int kind, int num, ...) {
+  size_t size = sizeof(struct ast);
+  if (num > 0) size += num * sizeof(struct ast*);
+  struct ast* node = Arena_Alloc(&ctx->ast_arena, size);
 
-  node->name = name;
+  node->kind = kind;
   node->num = num;
 
-  if (!strcmp(name, "ID") || !strcmp(name, "TYPE") || !strcmp(name, "RELOP"))
-    strcpy(node->id_name, yytext);
-  else if (!strcmp(name, "INT")) {
-    node->int_value = strtol(yytext, NULL, 0);
-  } else if (!strcmp(name, "FLOAT"))
-    node->float_value = atof(yytext);
+  // 终结符取扫描器当前的词素
+  yyscan_t scanner = ctx->scanner;
+  switch (kind) {
+    case N_ID:
+    case N_TYPE:
+      node->id_name = Intern_Len(yyget_text(scanner), yyget_leng(scanner));
+      break;
+    case N_RELOP:
+      // 比较运算符在这里就换成RELOP_*, 翻译时不再比较字符串
+      node->int_value = IR_Relop(yyget_text(scanner), yyget_leng(scanner));
+      break;
+    case N_INT: {
+      // 不超过9位的十进制数直接累加, 八进制, 十六进制和更长的交给strtol
+      const char* text = yyget_text(scanner);
+      int len = yyget_leng(scanner);
+      if (text[0] != '0' && len <= 9) {
+        int value = 0;
+        for (int i = 0; i < len; i++) value = value * 10 + (text[i] - '0');
+        node->int_value = value;
+      } else
+        node->int_value = strtol(text, NULL, 0);
+      break;
+    }
+    case N_FLOAT:
+      node->float_value = atof(yyget_text(scanner));
+      break;
+  }
 
   if (num > 0) {
     // Nonterminal
@@ -46,35 +81,132 @@ struct ast* newnode(char* name, int num, ...) {
       struct ast* temp = va_arg(v, struct ast*);
       node->children[i] = temp;
     }
-    node->lineno = node->children[0]->lineno;
+    struct ast* first = node->children[0];
+    node->lineno = IS_TOKEN(first) ? TOKEN_LINENO(first) : first->lineno;
     va_end(v);
   } else {
     // Terminal or Empty
-    node->lineno = yylineno;
+    node->lineno = yyget_lineno(scanner);
   }
   return node;
 }
 
 void eval_syntax_tree(struct ast* node, int level) {
+  if (IS_TOKEN(node)) {
+    for (int i = 0; i < level; i++) printf("  ");
+    printf("%s\n", node_names[TOKEN_KIND(node)]);
+    return;
+  }
   if (node->num >= 0)  // Nonempty
     for (int i = 0; i < level; i++) printf("  ");
   if (node->num > 0) {
     // Nonterminal
-    printf("%s (%d)\n", node->name, node->lineno);
+    printf("%s (%d)\n", node_names[node->kind], node->lineno);
     for (int i = 0; i < node->num; i++) {
       eval_syntax_tree(node->children[i], level + 1);
     }
   } else if (node->num == 0) {
     // Terminal
-    if (strcmp(node->name, "ID") == 0 || strcmp(node->name, "TYPE") == 0)
-      printf("%s: %s\n", node->name, node->id_name);
-    else if (strcmp(node->name, "INT") == 0)
-      printf("%s: %d\n", node->name, node->int_value);
-    else if (strcmp(node->name, "FLOAT") == 0)
-      printf("%s: %f\n", node->name, node->float_value);
+    const char* name = node_names[node->kind];
+    if (node->kind == N_ID || node->kind == N_TYPE)
+      printf("%s: %s\n", name, node->id_name);
+    else if (node->kind == N_INT)
+      printf("%s: %d\n", name, node->int_value);
+    else if (node->kind == N_FLOAT)
+      printf("%s: %f\n", name, node->float_value);
     else
-      printf("%s\n", node->name);
+      printf("%s\n", name);
   } else {
     // Empty node->num == -1
   }
-}
\ No newline at end of file
+}
+
+/*
+普通文件映射到内存中直接扫描, 省去flex从流中读入并复制到自己的缓冲区
+-- yy_scan_buffer(base, size, scanner)要求base[size - 2]和base[size - 1]
+   为'\0', 否则返回NULL: 先保留长度+2的匿名映射(全为0), 再把文件映射
+   到它的开头. 扫描时flex会在词素末尾临时写'\0', 所以映射须可写(私有)
+-- yy_scan_buffer不设缓冲区的行号; 可重入的扫描器中yylineno属于当前
+   缓冲区, yyset_lineno须在有缓冲区之后调用
+-- 标准输入, 管道和内存中的流, 以及映射失败时, 仍然用yyset_in逐块读入
+*/
+typedef struct Input {
+  char* base;
+  size_t size;  // 映射的长度, 0为没有映射
+} Input;
+
+static void Input_Open(Input* in, FILE* fp) {
+  in->base = NULL;
+  in->size = 0;
+  struct stat st;
+  int fd = fileno(fp);
+  if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    yyset_in(fp, ctx->scanner);
+    return;
+  }
+  size_t len = st.st_size;
+  char* base = mmap(NULL, len + 2, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED ||
+      mmap(base, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+           0) == MAP_FAILED) {
+    if (base != MAP_FAILED) munmap(base, len + 2);
+    yyset_in(fp, ctx->scanner);
+    return;
+  }
+  if (!yy_scan_buffer(base, len + 2, ctx->scanner)) {
+    munmap(base, len + 2);
+    yyset_in(fp, ctx->scanner);
+    return;
+  }
+  in->base = base;
+  in->size = len + 2;
+  yyset_lineno(1, ctx->scanner);
+}
+
+static void Input_Close(Input* in) {
+  if (in->size) munmap(in->base, in->size);
+}
+
+void build_syntax_tree(FILE* fp) {
+  // 每次分析用一个新的扫描器, 状态都在其中
+  yylex_init_extra(ctx, (yyscan_t*)&ctx->scanner);
+  Input in;
+  Input_Open(&in, fp);
+  yyparse(ctx->scanner);
+  Input_Close(&in);
+  yylex_destroy(ctx->scanner);
+  ctx->scanner = NULL;
+}
+
+long scan_tokens(FILE* fp, long* bytes) {
+  yylex_init_extra(ctx, (yyscan_t*)&ctx->scanner);
+  Input in;
+  Input_Open(&in, fp);
+  YYSTYPE value;
+  long tokens = 0;
+  while (yylex(&value, ctx->scanner)) tokens++;
+  *bytes = in.size ? (long)in.size - 2 : ftell(fp);
+  Input_Close(&in);
+  yylex_destroy(ctx->scanner);
+  ctx->scanner = NULL;
+  return tokens;
+}
+
+void lex_benchmark(FILE* fp, FILE* info) {
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  long bytes, tokens = scan_tokens(fp, &bytes);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  double mb = bytes > 0 ? bytes / (double)(1 << 20) : 0;
+  fprintf(info, "lex: %ld tokens, %.2f MB, %.3f s, %.1f MB/s\n", tokens, mb,
+          sec, sec > 0 ? mb / sec : 0);
+}
+
+void free_syntax_tree() {
+  // 语法树结点一次性释放
+  Arena_Release(&ctx->ast_arena);
+  ctx->root = NULL;
+}
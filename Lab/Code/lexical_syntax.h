@@ -1,29 +1,86 @@
 #ifndef LEXICAL_SYNTAX_H
 #define LEXICAL_SYNTAX_H
 
-#define MAX_NAME_LEN 32
+#include "stdint.h"
+#include "stdio.h"
+
 #define d(n) printf("Debug[%d]\n", n);
 
-extern int yylineno;
+// 语法树, 错误类型等在当前的编译上下文中(ctx->root, ctx->error_type)
+extern struct ast* newnode(int kind, int num, ...);
+extern void build_syntax_tree(FILE* fp);
+extern void eval_syntax_tree();
+extern void free_syntax_tree();
+// 只做词法分析: 扫描fp的全部词法单元, 返回个数, 字节数存入*bytes
+extern long scan_tokens(FILE* fp, long* bytes);
+// 同scan_tokens, 把个数, 字节数和速度输出到info
+extern void lex_benchmark(FILE* fp, FILE* info);
 
-extern struct ast* root;
+/*
+结点类型: 终结符以及产生式
+-- 终结符的类型与词法单元一一对应
+-- 需要区分的产生式各有一个类型, 其余非终结符一个类型
+-- node_names按类型给出打印语法树时使用的名字
+*/
+#define AST_KINDS(X)                                                          \
+  /* 终结符 */                                                                \
+  X(N_INT, "INT") X(N_FLOAT, "FLOAT") X(N_ID, "ID") X(N_TYPE, "TYPE")         \
+  X(N_SEMI, "SEMI") X(N_COMMA, "COMMA") X(N_ASSIGNOP, "ASSIGNOP")             \
+  X(N_RELOP, "RELOP") X(N_PLUS, "PLUS") X(N_MINUS, "MINUS")                   \
+  X(N_STAR, "STAR") X(N_DIV, "DIV") X(N_AND, "AND") X(N_OR, "OR")             \
+  X(N_DOT, "DOT") X(N_NOT, "NOT") X(N_LP, "LP") X(N_RP, "RP") X(N_LB, "LB")   \
+  X(N_RB, "RB") X(N_LC, "LC") X(N_RC, "RC") X(N_STRUCT, "STRUCT")             \
+  X(N_RETURN, "RETURN") X(N_IF, "IF") X(N_ELSE, "ELSE") X(N_WHILE, "WHILE")   \
+  /* 非终结符 */                                                              \
+  X(N_PROGRAM, "Program") X(N_EXTDEFLIST, "ExtDefList")                       \
+  X(N_EXTDEF_VAR, "ExtDef") X(N_EXTDEF_STRUCT, "ExtDef")                      \
+  X(N_EXTDEF_FUNDEC, "ExtDef") X(N_EXTDEF_FUNC, "ExtDef")                     \
+  X(N_EXTDECLIST, "ExtDecList")                                               \
+  X(N_SPECIFIER_TYPE, "Specifier") X(N_SPECIFIER_STRUCT, "Specifier")         \
+  X(N_STRUCTSPECIFIER_DEF, "StructSpecifier")                                 \
+  X(N_STRUCTSPECIFIER_TAG, "StructSpecifier")                                 \
+  X(N_OPTTAG, "OptTag") X(N_TAG, "Tag") X(N_VARDEC, "VarDec")                 \
+  X(N_FUNDEC, "FunDec") X(N_VARLIST, "VarList") X(N_PARAMDEC, "ParamDec")     \
+  X(N_COMPST, "CompSt") X(N_STMTLIST, "StmtList")                             \
+  X(N_STMT_EXP, "Stmt") X(N_STMT_COMPST, "Stmt") X(N_STMT_RETURN, "Stmt")     \
+  X(N_STMT_IF, "Stmt") X(N_STMT_IFELSE, "Stmt") X(N_STMT_WHILE, "Stmt")       \
+  X(N_DEFLIST, "DefList") X(N_DEF, "Def") X(N_DECLIST, "DecList")             \
+  X(N_DEC, "Dec")                                                             \
+  X(N_EXP_ASSIGNOP, "Exp") X(N_EXP_AND, "Exp") X(N_EXP_OR, "Exp")             \
+  X(N_EXP_RELOP, "Exp") X(N_EXP_PLUS, "Exp") X(N_EXP_MINUS, "Exp")            \
+  X(N_EXP_STAR, "Exp") X(N_EXP_DIV, "Exp") X(N_EXP_PAREN, "Exp")              \
+  X(N_EXP_NEG, "Exp") X(N_EXP_NOT, "Exp") X(N_EXP_CALL, "Exp")                \
+  X(N_EXP_INDEX, "Exp") X(N_EXP_DOT, "Exp") X(N_EXP_ID, "Exp")                \
+  X(N_EXP_INT, "Exp") X(N_EXP_FLOAT, "Exp")                                   \
+  X(N_ARGS, "Args")
 
-extern int error_type;
-extern struct ast* newnode(char* name, int num, ...);
-extern void eval_syntax_tree();
+#define AST_KIND_ENUM(kind, name) kind,
+enum { AST_KINDS(AST_KIND_ENUM) N_KIND_NUM };
+#undef AST_KIND_ENUM
+
+extern const char* const node_names[N_KIND_NUM];
 
 // 抽象语法树
+// 结点从区域分配器中切分, 子结点数组按num变长分配
+// 标点和不带值的关键字(STRUCT, RETURN, IF, ELSE, WHILE)不分配结点, 在
+// children中是标记指针: 最低位为1, 其余位为类型和行号, 用TOKEN_*取出
 struct ast {
-  int lineno, num;
-  char* name;
-  struct ast* children[8];
+  int lineno;
+  short num, kind;
   union {
-    char id_name[MAX_NAME_LEN];
-    int int_value;
+    const char* id_name;  // 驻留后的名字
+    int int_value;        // INT的值, RELOP的RELOP_*
     float float_value;
   };
+  struct ast* children[];
 };
 
+#define TOKEN(kind, lineno) \
+  ((struct ast*)((((uintptr_t)(lineno) << 8 | (kind)) << 1) | 1))
+#define IS_TOKEN(node) ((uintptr_t)(node) & 1)
+#define TOKEN_KIND(node) ((int)((uintptr_t)(node) >> 1 & 0xff))
+#define TOKEN_LINENO(node) ((int)((uintptr_t)(node) >> 9))
+
 #define TRUE 1
 #define FALSE 0
 
@@ -0,0 +1,207 @@
+#include "liveness.h"
+
+#include "assert.h"
+#include "stdlib.h"
+#include "string.h"
+
+// (块, 名字)对
+typedef struct Pairs {
+  int n, cap;
+  int (*p)[2];
+} Pairs;
+
+static void Pairs_Add(Pairs* ps, int b, int j) {
+  if (ps->n == ps->cap) {
+    ps->cap = ps->cap ? 2 * ps->cap : 64;
+    ps->p = realloc(ps->p, ps->cap * sizeof(*ps->p));
+  }
+  ps->p[ps->n][0] = b;
+  ps->p[ps->n][1] = j;
+  ps->n++;
+}
+
+// 按第key个分量(取值[0, n))计数排序: 值为v的对的另一分量为
+// list[at[v], at[v + 1]), 保持加入的顺序
+static void Group(const Pairs* ps, int n, int key, int** at, int** list) {
+  int* a = calloc(n + 2, sizeof(int));
+  int* l = malloc((ps->n + 1) * sizeof(int));
+  for (int k = 0; k < ps->n; k++) a[ps->p[k][key] + 2]++;
+  for (int v = 2; v < n + 2; v++) a[v] += a[v - 1];
+  for (int k = 0; k < ps->n; k++) l[a[ps->p[k][key] + 1]++] = ps->p[k][!key];
+  *at = a;
+  *list = l;
+}
+
+Liveness* Liveness_Build(CFG* cfg, const OpMap* m, const char* taken) {
+  Liveness* lv = malloc(sizeof(Liveness));
+  IRFunc* func = cfg->func;
+  int size = OpMap_Size(m), nb = cfg->nblock;
+  lv->cfg = cfg;
+  lv->m = m;
+  lv->gidx = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) lv->gidx[j] = -1;
+
+  // 找出向上暴露的名字
+  int* killed = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) killed[j] = -1;
+  Operand* u[2];
+  lv->ng = 0;
+  for (int b = 0; b < nb; b++)
+    for (int i = cfg->blocks[b].first; i < cfg->blocks[b].last; i++) {
+      Instr* in = &func->code[i];
+      int n = Instr_Uses(in, u);
+      for (int k = 0; k < n; k++) {
+        int j = OpMap_Index(m, *u[k]);
+        if (j >= 0 && !taken[j] && killed[j] != b && lv->gidx[j] < 0)
+          lv->gidx[j] = lv->ng++;
+      }
+      Operand* d = Instr_Def(in);
+      int j = d ? OpMap_Index(m, *d) : -1;
+      if (j >= 0) killed[j] = b;
+    }
+
+  // 每个名字在哪些块中向上暴露(UEVar), 在哪些块中定值(VarKill)
+  Pairs ue = {0}, kill = {0};
+  int* used = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) killed[j] = used[j] = -1;
+  for (int b = 0; b < nb; b++)
+    for (int i = cfg->blocks[b].first; i < cfg->blocks[b].last; i++) {
+      Instr* in = &func->code[i];
+      int n = Instr_Uses(in, u);
+      for (int k = 0; k < n; k++) {
+        int j = OpMap_Index(m, *u[k]);
+        if (j >= 0 && lv->gidx[j] >= 0 && killed[j] != b && used[j] != b) {
+          used[j] = b;
+          Pairs_Add(&ue, b, j);
+        }
+      }
+      Operand* d = Instr_Def(in);
+      int j = d ? OpMap_Index(m, *d) : -1;
+      if (j >= 0 && killed[j] != b) {
+        killed[j] = b;
+        if (lv->gidx[j] >= 0) Pairs_Add(&kill, b, j);
+      }
+    }
+  int *ue_at, *ue_blk, *kill_at, *kill_blk;
+  Group(&ue, size, 1, &ue_at, &ue_blk);
+  Group(&kill, size, 1, &kill_at, &kill_blk);
+
+  // 逐个名字从向上暴露的块沿前驱反向传播, 到定值它的块为止;
+  // 标记数组记录块最近一次属于哪个名字的in, out或VarKill
+  int* mark = malloc(3 * (nb + 1) * sizeof(int));
+  int* in_mark = mark;
+  int* out_mark = in_mark + nb + 1;
+  int* kill_mark = out_mark + nb + 1;
+  for (int b = 0; b < 3 * (nb + 1); b++) mark[b] = -1;
+  int* stack = malloc((nb + 1) * sizeof(int));
+  Pairs in = {0}, out = {0};
+  for (int j = 0; j < size; j++) {
+    if (lv->gidx[j] < 0) continue;
+    for (int k = kill_at[j]; k < kill_at[j + 1]; k++)
+      kill_mark[kill_blk[k]] = j;
+    int top = 0;
+    for (int k = ue_at[j]; k < ue_at[j + 1]; k++) {
+      in_mark[ue_blk[k]] = j;
+      stack[top++] = ue_blk[k];
+    }
+    while (top) {
+      const Block* blk = &cfg->blocks[stack[--top]];
+      Pairs_Add(&in, blk - cfg->blocks, j);
+      for (int p = 0; p < blk->npred; p++) {
+        int a = blk->pred[p];
+        if (out_mark[a] == j) continue;
+        out_mark[a] = j;
+        Pairs_Add(&out, a, j);
+        if (kill_mark[a] != j && in_mark[a] != j) {
+          in_mark[a] = j;
+          stack[top++] = a;
+        }
+      }
+    }
+  }
+  // 按名字的顺序加入, 所以每块的名字是升序的
+  Group(&in, nb, 0, &lv->in_at, &lv->in);
+  Group(&out, nb, 0, &lv->out_at, &lv->out);
+
+  free(killed);
+  free(used);
+  free(ue.p);
+  free(kill.p);
+  free(in.p);
+  free(out.p);
+  free(ue_at);
+  free(ue_blk);
+  free(kill_at);
+  free(kill_blk);
+  free(mark);
+  free(stack);
+  return lv;
+}
+
+// 在升序的list[lo, hi)中二分查找idx
+static int Find(const int* list, int lo, int hi, int idx) {
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (list[mid] < idx)
+      lo = mid + 1;
+    else if (list[mid] > idx)
+      hi = mid;
+    else
+      return 1;
+  }
+  return 0;
+}
+
+int Live_In(const Liveness* lv, int block, int idx) {
+  return lv->gidx[idx] >= 0 &&
+         Find(lv->in, lv->in_at[block], lv->in_at[block + 1], idx);
+}
+
+int Live_Out(const Liveness* lv, int block, int idx) {
+  return lv->gidx[idx] >= 0 &&
+         Find(lv->out, lv->out_at[block], lv->out_at[block + 1], idx);
+}
+
+static void Extend(int* lo, int* hi, int j, int pos) {
+  if (pos < lo[j]) lo[j] = pos;
+  if (pos > hi[j]) hi[j] = pos;
+}
+
+void Live_Intervals(const Liveness* lv, int* lo, int* hi) {
+  const CFG* cfg = lv->cfg;
+  IRFunc* func = cfg->func;
+  int size = OpMap_Size(lv->m), n = func->len;
+  for (int j = 0; j < size; j++) lo[j] = 2 * n + 2, hi[j] = -1;
+
+  // 各名字的出现位置
+  Operand* u[2];
+  for (int i = 0; i < n; i++) {
+    Instr* in = &func->code[i];
+    int k = Instr_Uses(in, u);
+    for (int t = 0; t < k; t++) {
+      int j = OpMap_Index(lv->m, *u[t]);
+      if (j >= 0) Extend(lo, hi, j, 2 * i);
+    }
+    Operand* d = Instr_Def(in);
+    int j = d ? OpMap_Index(lv->m, *d) : -1;
+    if (j >= 0) Extend(lo, hi, j, in->op == IR_PARAM ? 0 : 2 * i + 1);
+  }
+
+  // 块间活跃的部分
+  for (int b = 0; b < cfg->nblock; b++) {
+    const Block* blk = &cfg->blocks[b];
+    for (int k = lv->in_at[b]; k < lv->in_at[b + 1]; k++)
+      Extend(lo, hi, lv->in[k], 2 * blk->first);
+    for (int k = lv->out_at[b]; k < lv->out_at[b + 1]; k++)
+      Extend(lo, hi, lv->out[k], 2 * blk->last);
+  }
+}
+
+void Liveness_Free(Liveness* lv) {
+  free(lv->gidx);
+  free(lv->in_at);
+  free(lv->in);
+  free(lv->out_at);
+  free(lv->out);
+  free(lv);
+}
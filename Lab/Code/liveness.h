@@ -0,0 +1,39 @@
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include "cfg.h"
+#include "opt.h"
+
+/*
+活跃变量分析:
+-- 只对在某个基本块中"向上暴露"(先使用后定值)的名字求块间活跃性,
+   其余名字离开定值所在的块后不再活跃
+-- 放在内存中的变量不参与分析, 一律视为活跃
+-- 逐个名字从向上暴露的块沿前驱反向传播, 用时和内存与活跃集合的总大小
+   成正比, 而不是块数乘名字数
+*/
+
+typedef struct Liveness Liveness;
+
+struct Liveness {
+  CFG* cfg;
+  const OpMap* m;
+  int* gidx;  // OpMap下标 -> 参与块间分析的下标, 否则为-1
+  int ng;
+  // 块b活跃进入的名字(OpMap下标, 升序)为in[in_at[b], in_at[b + 1]),
+  // 活跃离开的同理
+  int *in_at, *in;
+  int *out_at, *out;
+};
+
+extern Liveness* Liveness_Build(CFG* cfg, const OpMap* m, const char* taken);
+extern int Live_In(const Liveness* lv, int block, int idx);
+extern int Live_Out(const Liveness* lv, int block, int idx);
+
+// 活跃区间[lo, hi]: 位置2i为第i条指令的使用, 2i + 1为它的定值; 区间从
+// 第一次出现到最后一次出现, 再扩展到它活跃进入的块的开头和活跃离开的
+// 块的末尾. 形参从0开始, 没有出现的名字hi为-1
+extern void Live_Intervals(const Liveness* lv, int* lo, int* hi);
+extern void Liveness_Free(Liveness* lv);
+
+#endif
@@ -1,31 +1,427 @@
+#define _DEFAULT_SOURCE
+#include "cfg.h"
+#include "compiler.h"
+#include "gen.h"
+#include "ir.h"
+#include "jit.h"
 #include "lexical_syntax.h"
+#include "mips.h"
+#include "mips_sim.h"
+#include "opt.h"
+#include "pipeline.h"
+#include "pthread.h"
 #include "semantic.h"
+#include "server.h"
 #include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/resource.h"
+#include "time.h"
+#include "unistd.h"
+#include "vm.h"
+#include "x86.h"
 
-extern int yyrestart(FILE*);
-extern int yyparse();
+// 命令行: parser [-O0|-O1] [--stats] [--dump-cfg|--mips|--x86] [--inline=N]
+//               [--run|--jit] input [output]
+// --dump-cfg 输出优化后的控制流图(Graphviz)而不是中间代码
+// --mips 输出MIPS32汇编(SPIM)而不是中间代码
+// --x86 输出x86-64汇编(GAS)而不是中间代码, 用cc链接成可执行文件
+// --inline=N 内联不超过N条指令的函数, 0为不内联
+// --run 直接执行中间代码而不输出, 程序的输出写到output;
+//       执行的指令数和用时输出到stderr
+// --jit 同--run, 但编译成x86-64机器码执行
+// --mips --run 同--run, 但用模拟器执行--mips输出的汇编(见mips_sim.h)
+// --stream 边分析边翻译(见pipeline.h): -O0输出中间代码时每个函数翻译完
+//          就输出; 有词法, 语法错误时输出不完整
+//        parser [-O0|-O1] [--dump-cfg|--mips|--x86] [--inline=N] --jobs=N
+//               input...
+// --jobs=N 用N个线程并行编译所有输入, 0为CPU核数; 输入f的结果写到f.ir
+//          (--mips, --x86为f.s, --dump-cfg为f.dot), 词法, 语法错误也写在
+//          其中; 有输入失败时返回非零
+//        parser [选项] --serve=SOCKET
+// --serve 常驻在Unix域套接字SOCKET上接受编译请求(见server.h), 命令行中
+//         的选项是每个请求的默认选项
+//        parser [选项] --connect=SOCKET input [output]
+//        parser [选项] --connect=SOCKET --jobs=N input...
+// --connect 作为客户端把输入交给服务器编译, 选项随请求发送; 没有input时
+//           发送标准输入; 与--jobs同用时每个线程一个连接
+// --time 把各阶段的用时(ms)和内存峰值(KB)输出到stderr; lex为先单独扫描
+//        一遍的用时(标准输入不能读两遍, 为0), parse含其中的词法分析
+//        parser --lex input
+// --lex 只做词法分析, 把词法单元数和速度(MB/s)输出到stderr
+//        parser --gen=名字=值,... [output]
+// --gen 生成一个随机的C--程序(见gen.h), 参数如lines=10000,seed=2
+typedef struct Options {
+  int level, stats, dump_cfg, mips, x86, run, jit, lex, stream, time;
+  int inline_limit;
+  int jobs;                     // 批量编译的线程数, -1为不批量编译
+  const char *serve, *connect;  // 服务器, 客户端的套接字
+  const char* gen;              // 随机程序的参数
+} Options;
 
-int main(int argc, char** argv) {
-  if (argc <= 1) yyparse();
-  FILE* fr = fopen(argv[1], "r");
+// 当前线程的选项: 批量编译的工作线程和服务器的请求都从main_opt开始
+static __thread Options opt = {.inline_limit = OPT_INLINE_LIMIT, .jobs = -1};
+static Options main_opt;
+static char** inputs;  // 命令行中的文件名
+static int ninput;
+static char** forward;  // 客户端随请求发送的编译选项
+static int nforward;
+
+// 解析一个选项: 不认识时返回0, 编译选项返回1, 只影响运行方式的返回2
+static int Parse_Option(const char* arg) {
+  if (!strcmp(arg, "-O0") || !strcmp(arg, "-O1"))
+    opt.level = arg[2] - '0';
+  else if (!strcmp(arg, "--stats"))
+    opt.stats = 1;
+  else if (!strcmp(arg, "--dump-cfg"))
+    opt.dump_cfg = 1;
+  else if (!strcmp(arg, "--mips"))
+    opt.mips = 1;
+  else if (!strcmp(arg, "--x86"))
+    opt.x86 = 1;
+  else if (!strcmp(arg, "--run"))
+    opt.run = 1;
+  else if (!strcmp(arg, "--jit"))
+    opt.jit = 1;
+  else if (!strncmp(arg, "--inline=", 9))
+    opt.inline_limit = atoi(arg + 9);
+  else if (!strcmp(arg, "--lex")) {
+    opt.lex = 1;
+    return 2;
+  } else if (!strcmp(arg, "--stream")) {
+    opt.stream = 1;
+    return 2;
+  } else if (!strcmp(arg, "--time")) {
+    opt.time = 1;
+    return 2;
+  } else if (!strncmp(arg, "--gen=", 6)) {
+    opt.gen = arg + 6;
+    return 2;
+  } else if (!strncmp(arg, "--jobs=", 7)) {
+    opt.jobs = atoi(arg + 7);
+    return 2;
+  } else if (!strncmp(arg, "--serve=", 8)) {
+    opt.serve = arg + 8;
+    return 2;
+  } else if (!strncmp(arg, "--connect=", 10)) {
+    opt.connect = arg + 10;
+    return 2;
+  } else
+    return 0;
+  return 1;
+}
+
+static int Parse_Args(int argc, char** argv) {
+  inputs = malloc(argc * sizeof(char*));
+  forward = malloc(argc * sizeof(char*));
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-')
+      inputs[ninput++] = argv[i];
+    else if (Parse_Option(argv[i]) == 1)
+      forward[nforward++] = argv[i];
+    else if (!Parse_Option(argv[i])) {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 0;
+    }
+  }
+  if (opt.jobs >= 0 && !opt.connect && (opt.run || opt.jit)) {
+    fprintf(stderr, "--jobs cannot be used with --run or --jit\n");
+    return 0;
+  }
+  if (opt.serve && (opt.connect || opt.jobs >= 0 || opt.run || opt.jit)) {
+    fprintf(stderr, "--serve cannot be used with --connect, --jobs, --run "
+                    "or --jit\n");
+    return 0;
+  }
+  if ((opt.lex || opt.stream || opt.time) &&
+      (opt.serve || opt.connect || opt.jobs >= 0)) {
+    fprintf(stderr, "--lex, --stream and --time cannot be used with "
+                    "--serve, --connect or --jobs\n");
+    return 0;
+  }
+  if (opt.stream && opt.time) {
+    fprintf(stderr, "--time cannot be used with --stream\n");
+    return 0;
+  }
+  main_opt = opt;
+  return 1;
+}
+
+// 优化并输出当前上下文中的中间代码, 结果写到fp, --stats的统计写到info
+static int Emit(FILE* fp, FILE* info) {
+  opt_inline_limit = opt.inline_limit;
+  if (opt.stats) IR_Stats(info, "before");
+  Optimize(opt.level);
+  if (opt.stats) IR_Stats(info, "after");
+  if (opt.jit) return JIT_Run(stdin, fp, stderr);
+  if (opt.mips && opt.run) return Mips_Run(stdin, fp, stderr);
+  if (opt.run) return VM_Run(stdin, fp, stderr);
+  if (opt.mips) return Mips_Print(fp);
+  if (opt.x86) return X86_Print(fp);
+  if (opt.dump_cfg)
+    CFG_DumpAll(fp);
+  else
+    IR_Print(fp);
+  return 0;
+}
+
+// 翻译当前上下文中的语法树, 有语义错误时不输出
+static int Translate(FILE* fp, FILE* info) {
+  eval_semantic(ctx->root);
+  return ctx->sem_error ? 1 : Emit(fp, info);
+}
 
-  if (!fr) {
-    perror(argv[1]);
+// 服务器的请求: 选项在服务器的选项上修改
+static int Serve_Compile(char** args, int nargs, FILE* in, FILE* out,
+                         FILE* diag) {
+  opt = main_opt;
+  opt.serve = NULL;
+  for (int i = 0; i < nargs; i++)
+    if (Parse_Option(args[i]) != 1) {
+      fprintf(diag, "bad option %s\n", args[i]);
+      return 1;
+    }
+  if (opt.run || opt.jit) {
+    fprintf(diag, "--run and --jit are not supported by the server\n");
     return 1;
   }
+  build_syntax_tree(in);
+  return ctx->error_type ? 1 : Translate(out, diag);
+}
+
+/* 批量编译: 工作线程各自取下一个输入, 在本地用自己的编译上下文编译,
+   或经自己的连接交给服务器编译 */
+
+static int batch_next, batch_failed;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int Compile_File(Compiler* c, Conn* conn, const char* input) {
+  const char* ext = opt.mips || opt.x86 ? ".s" : opt.dump_cfg ? ".dot" : ".ir";
+  char* output = malloc(strlen(input) + strlen(ext) + 1);
+  strcpy(output, input);
+  strcat(output, ext);
+  FILE* fr = conn ? NULL : fopen(input, "r");
+  FILE* fw = conn || fr ? fopen(output, "w") : NULL;
+  if (!fw) {
+    perror(fr || conn ? output : input);
+    if (fr) fclose(fr);
+    free(output);
+    return 1;
+  }
+
+  int status;
+  if (conn) {
+    status = Client_Request(conn, forward, nforward, input, NULL, fw, fw);
+    if (status < 0) fprintf(stderr, "%s: connection lost\n", opt.connect);
+  } else {
+    Compiler_Reset(c);
+    c->diag = fw;
+    build_syntax_tree(fr);
+    status = c->error_type ? 1 : Translate(fw, stderr);
+    fclose(fr);
+  }
+  if (fclose(fw)) status = 1;
+  free(output);
+  return status;
+}
+
+static void* Batch_Worker(void* arg) {
+  opt = main_opt;
+  Compiler c;
+  Compiler_Init(&c, NULL);
+  Conn* conn = opt.connect ? Client_Connect(opt.connect) : NULL;
+  for (;;) {
+    pthread_mutex_lock(&batch_lock);
+    int i = batch_next++;
+    pthread_mutex_unlock(&batch_lock);
+    if (i >= ninput) break;
+    // 连不上服务器时, 余下的输入由其他线程编译
+    if (opt.connect && !conn) {
+      pthread_mutex_lock(&batch_lock);
+      batch_failed++;
+      pthread_mutex_unlock(&batch_lock);
+      break;
+    }
+    if (Compile_File(&c, conn, inputs[i])) {
+      pthread_mutex_lock(&batch_lock);
+      batch_failed++;
+      pthread_mutex_unlock(&batch_lock);
+    }
+  }
+  if (conn) Client_Close(conn);
+  Compiler_Uninit(&c);
+  return NULL;
+}
+
+static int Batch() {
+  int n = opt.jobs ? opt.jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (n > ninput) n = ninput;
+  if (n < 1) n = 1;
+  pthread_t* threads = malloc(n * sizeof(pthread_t));
+  for (int i = 0; i < n; i++)
+    pthread_create(&threads[i], NULL, Batch_Worker, NULL);
+  for (int i = 0; i < n; i++) pthread_join(threads[i], NULL);
+  free(threads);
+  return batch_failed != 0;
+}
 
-  yyrestart(fr);
-  yyparse();
+// 流水线的翻译线程: 逐个翻译ExtDef, out非NULL时随即输出并释放中间代码;
+// 出现语义错误后不再输出
+static void Stream_ExtDef(struct ast* extdef, void* out) {
+  ExtDef(extdef);
+  if (out && !ctx->sem_error) IR_Drain(out);
+}
+
+// 流水线模式: 只有-O0输出中间代码时能逐个函数输出, 否则中间代码仍要
+// 等全部翻译完再做全局的优化和输出, 只省下语法树
+static int Stream(FILE* fr, const char* output) {
+  FILE* fw = output ? fopen(output, "w") : stdout;
+  if (!fw) {
+    perror(output);
+    return 1;
+  }
+  int drain = opt.level == 0 && !opt.stats && !opt.dump_cfg && !opt.mips &&
+              !opt.x86 && !opt.run && !opt.jit;
+  eval_semantic_begin();
+  Pipeline_Run(fr, Stream_ExtDef, drain ? fw : NULL);
+  eval_semantic_end();
+  int status = ctx->error_type || ctx->sem_error ? 1 : Emit(fw, stderr);
+  if (output) fclose(fw);
+  return status;
+}
+
+static double Now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// 在本地编译一个输入, 词法, 语法错误输出到stdout
+static int Compile_One(const char* input, const char* output) {
+  FILE* fr = stdin;
+  if (input) {
+    fr = fopen(input, "r");
+    if (!fr) {
+      perror(input);
+      return 1;
+    }
+  }
+
+  Compiler c;
+  Compiler_Init(&c, stdout);
+  if (opt.lex) {
+    lex_benchmark(fr, stderr);
+    int status = c.error_type != 0;
+    Compiler_Uninit(&c);
+    return status;
+  }
+  if (opt.stream) {
+    int status = Stream(fr, output);
+    Compiler_Uninit(&c);
+    return status;
+  }
+  // --time: 先单独扫描一遍得到词法分析的用时, 这一遍的错误信息不输出
+  double lex = 0, start = Now();
+  if (opt.time && fr != stdin) {
+    long bytes;
+    c.diag = fopen("/dev/null", "w");
+    scan_tokens(fr, &bytes);
+    lex = Now() - start;
+    fclose(c.diag);
+    c.diag = stdout;
+    c.error_type = 0;
+    rewind(fr);
+    start = Now();
+  }
+  build_syntax_tree(fr);
+  double parse = Now() - start;
   /*
-  if (!error_type) {
-    eval_syntax_tree(root, 0);
+  if (!c.error_type) {
+    eval_syntax_tree(c.root, 0);
   }
   */
 
-  if (argc > 2) freopen(argv[2], "w", stdout);
+  int status = 0;
+  double semantic = 0, emit = 0;
+  if (!c.error_type) {
+    start = Now();
+    eval_semantic(c.root);
+    semantic = Now() - start;
+  }
+  // 语义错误与词法, 语法错误一样输出到标准输出, 之后再换成输出文件
+  if (output) freopen(output, "w", stdout);
+  if (!c.error_type && !c.sem_error) {
+    start = Now();
+    status = Emit(stdout, stderr);
+    fflush(stdout);
+    emit = Now() - start;
+  }
+  if (opt.time) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr,
+            "time: lex %.2f parse %.2f semantic %.2f emit %.2f ms, "
+            "peak %ld KB\n",
+            lex, parse, semantic, emit, usage.ru_maxrss);
+  }
+  Compiler_Uninit(&c);
+  return status;
+}
 
-  if (!error_type) {
-    eval_semantic(root);
+// 生成随机程序写到output, 没有output时写到stdout
+static int Generate(const char* output) {
+  GenParams params = gen_defaults;
+  if (!Gen_Parse(&params, opt.gen)) {
+    fprintf(stderr, "bad --gen parameters %s\n", opt.gen);
+    return 1;
   }
+  FILE* fw = output ? fopen(output, "w") : stdout;
+  if (!fw) {
+    perror(output);
+    return 1;
+  }
+  Gen_Program(fw, &params);
+  if (output) fclose(fw);
   return 0;
 }
+
+// 客户端: 一个输入交给服务器编译, 诊断信息输出到stdout
+static int Remote(const char* input, const char* output) {
+  Conn* conn = Client_Connect(opt.connect);
+  if (!conn) return 1;
+  FILE* fw = output ? fopen(output, "w") : stdout;
+  if (!fw) {
+    perror(output);
+    Client_Close(conn);
+    return 1;
+  }
+  int status =
+      Client_Request(conn, forward, nforward, input, stdin, fw, stdout);
+  if (status < 0) {
+    fprintf(stderr, "%s: connection lost\n", opt.connect);
+    status = 1;
+  }
+  if (output) fclose(fw);
+  Client_Close(conn);
+  return status;
+}
+
+int main(int argc, char** argv) {
+  if (!Parse_Args(argc, argv)) return 1;
+  int status = 0;
+  char* input = ninput > 0 ? inputs[0] : NULL;
+  char* output = ninput > 1 ? inputs[ninput - 1] : NULL;
+  if (opt.gen)
+    status = Generate(input);
+  else if (opt.serve)
+    status = Server_Run(opt.serve, Serve_Compile);
+  else if (opt.jobs >= 0)
+    status = Batch();
+  else if (opt.connect)
+    status = Remote(input, output);
+  else
+    status = Compile_One(input, output);
+  free(inputs);
+  free(forward);
+  return status;
+}
@@ -0,0 +1,414 @@
+#include "mips.h"
+
+#include "assert.h"
+#include "cfg.h"
+#include "ir.h"
+#include "liveness.h"
+#include "opt.h"
+#include "regalloc.h"
+#include "stdlib.h"
+#include "string.h"
+
+// 可分配的寄存器, 0-7为调用者保存的$t, 8-15为被调用者保存的$s
+#define NREG 16
+static const char* const reg_names[NREG] = {
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7"};
+static const char* const arg_regs[4] = {"$a0", "$a1", "$a2", "$a3"};
+static const char* const branch_of[] = {"beq", "bne", "blt", "bgt", "ble", "bge"};
+
+static const char* header =
+    ".data\n"
+    "_prompt: .asciiz \"Enter an integer:\"\n"
+    "_ret: .asciiz \"\\n\"\n"
+    ".globl main\n"
+    ".text\n"
+    "read:\n"
+    "  li $v0, 4\n"
+    "  la $a0, _prompt\n"
+    "  syscall\n"
+    "  li $v0, 5\n"
+    "  syscall\n"
+    "  jr $ra\n"
+    "\n"
+    "write:\n"
+    "  li $v0, 1\n"
+    "  syscall\n"
+    "  li $v0, 4\n"
+    "  la $a0, _ret\n"
+    "  syscall\n"
+    "  move $v0, $0\n"
+    "  jr $ra\n";
+
+typedef struct Mips {
+  FILE* fp;
+  IRFunc* func;
+  OpMap m;
+  char* taken;
+  int *home, *off;  // 名字 -> 寄存器, 不在寄存器中为-1; 名字 -> 帧中的偏移
+  int *lo, *hi;     // 活跃区间
+  int save[NREG];   // 寄存器 -> 保存的位置, 不用保存为0
+  int nparam, frame;
+} Mips;
+
+static __thread int zero_loops;  // 清零循环的标号
+
+static int Fits16(int v) { return v >= -32768 && v <= 32767; }
+
+// op reg, off($fp), 偏移超出16位时用$v1算地址
+static void Frame_Access(Mips* g, const char* op, const char* reg, int off) {
+  if (Fits16(off)) {
+    fprintf(g->fp, "  %s %s, %d($fp)\n", op, reg, off);
+    return;
+  }
+  fprintf(g->fp, "  li $v1, %d\n  addu $v1, $v1, $fp\n", off);
+  fprintf(g->fp, "  %s %s, 0($v1)\n", op, reg);
+}
+
+// reg := $fp + off
+static void Frame_Addr(Mips* g, const char* reg, int off) {
+  if (Fits16(off))
+    fprintf(g->fp, "  addiu %s, $fp, %d\n", reg, off);
+  else
+    fprintf(g->fp, "  li %s, %d\n  addu %s, %s, $fp\n", reg, off, reg, reg);
+}
+
+static int Home(const Mips* g, Operand op) {
+  if (op.kind != O_TEMP && op.kind != O_VAR) return -1;
+  return g->home[OpMap_Index(&g->m, op)];
+}
+
+// 取操作数所在的寄存器, 常量和帧中的名字装入tmp
+static const char* Use(Mips* g, Operand op, const char* tmp) {
+  if (op.kind == O_CONST || op.kind == O_FCONST) {
+    int v = op.kind == O_CONST ? op.ival : (int)op.fval;
+    if (!v) return "$zero";
+    fprintf(g->fp, "  li %s, %d\n", tmp, v);
+    return tmp;
+  }
+  int r = Home(g, op);
+  if (r >= 0) return reg_names[r];
+  Frame_Access(g, "lw", tmp, g->off[OpMap_Index(&g->m, op)]);
+  return tmp;
+}
+
+// reg := op
+static void Load_To(Mips* g, const char* reg, Operand op) {
+  const char* s = Use(g, op, reg);
+  if (strcmp(s, reg)) fprintf(g->fp, "  move %s, %s\n", reg, s);
+}
+
+// 定值的目标寄存器, 名字在帧中时先算到$t8, 由Def_End写回
+static const char* Def(Mips* g, Operand op) {
+  int r = Home(g, op);
+  return r >= 0 ? reg_names[r] : "$t8";
+}
+
+static void Def_End(Mips* g, Operand op) {
+  if (Home(g, op) < 0)
+    Frame_Access(g, "sw", "$t8", g->off[OpMap_Index(&g->m, op)]);
+}
+
+// op := reg
+static void Store_Name(Mips* g, Operand op, const char* reg) {
+  int r = Home(g, op);
+  if (r < 0)
+    Frame_Access(g, "sw", reg, g->off[OpMap_Index(&g->m, op)]);
+  else if (strcmp(reg_names[r], reg))
+    fprintf(g->fp, "  move %s, %s\n", reg_names[r], reg);
+}
+
+static int Call_Of(const IRFunc* func, int i) {
+  while (i < func->len && func->code[i].op == IR_ARG) i++;
+  return i < func->len && func->code[i].op == IR_CALL ? i : -1;
+}
+
+// 名字到寄存器和帧中的位置
+static void Layout(Mips* g) {
+  IRFunc* func = g->func;
+  int size = OpMap_Size(&g->m), n = func->len, leaf = 1;
+  for (int i = 0; i < n; i++)
+    if (func->code[i].op == IR_CALL) leaf = 0;
+
+  // 有调用时先用$s, 跨调用的名字不必每次保存
+  int* reg = RegAlloc_Linear(func, &g->m, g->taken, NREG);
+  for (int k = 0; k < size; k++)
+    g->home[k] = reg[k] < 0 ? -1 : leaf ? reg[k] : (reg[k] + 8) % NREG;
+  free(reg);
+
+  int used[NREG] = {0};
+  for (int k = 0; k < size; k++)
+    if (g->home[k] >= 0) used[g->home[k]] = 1;
+  g->frame = 0;
+  for (int r = 0; r < NREG; r++) {
+    g->save[r] = 0;
+    if (used[r] && (r >= 8 || !leaf)) g->save[r] = -(g->frame += 4);
+  }
+
+  // 第5个起的形参用调用者压栈的位置
+  for (int k = 0; k < size; k++) g->off[k] = 0;
+  for (int p = 4; p < g->nparam; p++)
+    g->off[OpMap_Index(&g->m, func->code[p].x)] = 8 + 4 * (p - 4);
+  for (int i = 0; i < n; i++) {
+    const Instr* in = &func->code[i];
+    if (in->op == IR_DEC)
+      g->off[OpMap_Index(&g->m, in->x)] = -(g->frame += (in->y.ival + 3) & ~3);
+  }
+  for (int k = 0; k < size; k++)
+    if (g->home[k] < 0 && !g->off[k] && (g->hi[k] >= 0 || g->taken[k]))
+      g->off[k] = -(g->frame += 4);
+  g->frame = (g->frame + 7) & ~7;
+}
+
+static void Prologue(Mips* g, const Liveness* lv) {
+  IRFunc* func = g->func;
+  fprintf(g->fp, "\n%s:\n", func->name);
+  fprintf(g->fp, "  addiu $sp, $sp, -8\n  sw $ra, 4($sp)\n  sw $fp, 0($sp)\n");
+  fprintf(g->fp, "  move $fp, $sp\n");
+  if (g->frame && Fits16(-g->frame))
+    fprintf(g->fp, "  addiu $sp, $sp, %d\n", -g->frame);
+  else if (g->frame)
+    fprintf(g->fp, "  li $v1, %d\n  subu $sp, $sp, $v1\n", g->frame);
+  for (int r = 8; r < NREG; r++)
+    if (g->save[r]) Frame_Access(g, "sw", reg_names[r], g->save[r]);
+
+  for (int p = 0; p < g->nparam; p++) {
+    Operand x = func->code[p].x;
+    if (p < 4)
+      Store_Name(g, x, arg_regs[p]);
+    else if (Home(g, x) >= 0)
+      Frame_Access(g, "lw", reg_names[Home(g, x)], 8 + 4 * (p - 4));
+  }
+
+  // 进入时就活跃(先使用后定值)的名字和内存中的变量清零, DEC的区域
+  // 执行到DEC时清零
+  int size = OpMap_Size(&g->m);
+  char* skip = calloc(size + 1, 1);
+  for (int p = 0; p < g->nparam; p++)
+    skip[OpMap_Index(&g->m, func->code[p].x)] = 1;
+  for (int i = 0; i < func->len; i++)
+    if (func->code[i].op == IR_DEC)
+      skip[OpMap_Index(&g->m, func->code[i].x)] = 1;
+  for (int k = 0; k < size; k++) {
+    if (skip[k] || (!g->taken[k] && !(lv && Live_In(lv, 0, k)))) continue;
+    if (g->home[k] >= 0)
+      fprintf(g->fp, "  move %s, $zero\n", reg_names[g->home[k]]);
+    else
+      Frame_Access(g, "sw", "$zero", g->off[k]);
+  }
+  free(skip);
+}
+
+static void Epilogue(Mips* g) {
+  for (int r = 8; r < NREG; r++)
+    if (g->save[r]) Frame_Access(g, "lw", reg_names[r], g->save[r]);
+  fprintf(g->fp, "  move $sp, $fp\n  lw $ra, 4($sp)\n  lw $fp, 0($sp)\n");
+  fprintf(g->fp, "  addiu $sp, $sp, 8\n  jr $ra\n");
+}
+
+static void Binary(Mips* g, const Instr* in) {
+  Operand y = in->y, z = in->z;
+  // 加减常量用addiu, 乘2的幂用sll
+  if ((in->op == IR_ADD || in->op == IR_MUL) && y.kind == O_CONST)
+    y = in->z, z = in->y;
+  if (z.kind == O_CONST && y.kind != O_CONST &&
+      ((in->op == IR_ADD && Fits16(z.ival)) ||
+       (in->op == IR_SUB && z.ival != -32768 && Fits16(-z.ival)))) {
+    const char* a = Use(g, y, "$t8");
+    fprintf(g->fp, "  addiu %s, %s, %d\n", Def(g, in->x), a,
+            in->op == IR_ADD ? z.ival : -z.ival);
+    Def_End(g, in->x);
+    return;
+  }
+  if (in->op == IR_MUL && z.kind == O_CONST && y.kind != O_CONST &&
+      Pow2_Shift(z.ival) > 0) {
+    const char* a = Use(g, y, "$t8");
+    fprintf(g->fp, "  sll %s, %s, %d\n", Def(g, in->x), a,
+            Pow2_Shift(z.ival));
+    Def_End(g, in->x);
+    return;
+  }
+  const char* a = Use(g, y, "$t8");
+  const char* b = Use(g, z, "$t9");
+  const char* d = Def(g, in->x);
+  switch (in->op) {
+    case IR_ADD:
+      fprintf(g->fp, "  addu %s, %s, %s\n", d, a, b);
+      break;
+    case IR_SUB:
+      fprintf(g->fp, "  subu %s, %s, %s\n", d, a, b);
+      break;
+    case IR_MUL:
+      fprintf(g->fp, "  mul %s, %s, %s\n", d, a, b);
+      break;
+    case IR_DIV:
+      fprintf(g->fp, "  div %s, %s\n  mflo %s\n", a, b, d);
+      break;
+  }
+  Def_End(g, in->x);
+}
+
+// 调用: 实参就位, 保存跨调用仍活跃的$t, 返回值在$v0
+static void Call(Mips* g, int c) {
+  IRFunc* func = g->func;
+  int first = c;
+  while (first > 0 && func->code[first - 1].op == IR_ARG) first--;
+  int n = c - first;  // 最后一个ARG是第一个形参
+  if (n > 4) {
+    fprintf(g->fp, "  addiu $sp, $sp, %d\n", -4 * (n - 4));
+    for (int p = 4; p < n; p++)
+      fprintf(g->fp, "  sw %s, %d($sp)\n",
+              Use(g, func->code[c - 1 - p].x, "$t8"), 4 * (p - 4));
+  }
+  for (int p = 0; p < n && p < 4; p++)
+    Load_To(g, arg_regs[p], func->code[c - 1 - p].x);
+
+  // 返回值的名字在调用后重新定值, 不用保存
+  int live[8] = {0}, size = OpMap_Size(&g->m);
+  int x = OpMap_Index(&g->m, func->code[c].x);
+  for (int k = 0; k < size; k++)
+    if (k != x && g->home[k] >= 0 && g->home[k] < 8 &&
+        g->lo[k] < 2 * c + 1 && g->hi[k] > 2 * c + 1)
+      live[g->home[k]] = 1;
+  for (int r = 0; r < 8; r++)
+    if (live[r]) Frame_Access(g, "sw", reg_names[r], g->save[r]);
+  fprintf(g->fp, "  jal %s\n", func->code[c].y.name);
+  for (int r = 0; r < 8; r++)
+    if (live[r]) Frame_Access(g, "lw", reg_names[r], g->save[r]);
+  if (n > 4) fprintf(g->fp, "  addiu $sp, $sp, %d\n", 4 * (n - 4));
+  Store_Name(g, func->code[c].x, "$v0");
+}
+
+// DEC的区域清零
+static void Zero(Mips* g, int off, int bytes) {
+  if (bytes <= 32) {
+    for (int b = 0; b < bytes; b += 4) Frame_Access(g, "sw", "$zero", off + b);
+    return;
+  }
+  int l = zero_loops++;
+  Frame_Addr(g, "$t8", off);
+  fprintf(g->fp, "  li $t9, %d\n  addu $t9, $t8, $t9\n", bytes);
+  fprintf(g->fp, "_zero%d:\n  sw $zero, 0($t8)\n  addiu $t8, $t8, 4\n", l);
+  fprintf(g->fp, "  bne $t8, $t9, _zero%d\n", l);
+}
+
+static int Print_Func(FILE* fp, IRFunc* func) {
+  // ARG须连续地紧接CALL, PARAM须在函数开头
+  for (int i = 0, params = 1; i < func->len; i++) {
+    int op = func->code[i].op;
+    if ((op == IR_ARG && Call_Of(func, i) < 0) || (op == IR_PARAM && !params))
+      return 0;
+    if (op != IR_PARAM) params = 0;
+  }
+  Mips g = {.fp = fp, .func = func};
+  OpMap_Init(&g.m, func);
+  int size = OpMap_Size(&g.m), n = func->len;
+  g.taken = Func_AddrTaken(func, &g.m);
+  g.home = malloc((size + 1) * sizeof(int));
+  g.off = malloc((size + 1) * sizeof(int));
+  g.lo = malloc((size + 1) * sizeof(int));
+  g.hi = malloc((size + 1) * sizeof(int));
+  while (g.nparam < n && func->code[g.nparam].op == IR_PARAM) g.nparam++;
+
+  CFG* cfg = n ? CFG_Build(func) : NULL;
+  Liveness* lv = cfg ? Liveness_Build(cfg, &g.m, g.taken) : NULL;
+  if (lv) Live_Intervals(lv, g.lo, g.hi);
+  for (int k = 0; !lv && k < size; k++) g.hi[k] = -1;
+  Layout(&g);
+  Prologue(&g, lv);
+  if (lv) Liveness_Free(lv);
+  if (cfg) CFG_Free(cfg);
+
+  for (int i = g.nparam; i < n; i++) {
+    const Instr* in = &func->code[i];
+    switch (in->op) {
+      case IR_NOP:
+      case IR_ARG:  // 由CALL处理
+        break;
+      case IR_LABEL:
+        fprintf(fp, "label%d:\n", in->x.no);
+        break;
+      case IR_ASSIGN:
+        if (Home(&g, in->x) >= 0)
+          Load_To(&g, Def(&g, in->x), in->y);
+        else
+          Store_Name(&g, in->x, Use(&g, in->y, "$t8"));
+        break;
+      case IR_ADD:
+      case IR_SUB:
+      case IR_MUL:
+      case IR_DIV:
+        Binary(&g, in);
+        break;
+      case IR_ADDR:
+        Frame_Addr(&g, Def(&g, in->x), g.off[OpMap_Index(&g.m, in->y)]);
+        Def_End(&g, in->x);
+        break;
+      case IR_LOAD: {
+        const char* a = Use(&g, in->y, "$t9");
+        fprintf(fp, "  lw %s, 0(%s)\n", Def(&g, in->x), a);
+        Def_End(&g, in->x);
+        break;
+      }
+      case IR_STORE: {
+        const char* a = Use(&g, in->x, "$t9");
+        fprintf(fp, "  sw %s, 0(%s)\n", Use(&g, in->y, "$t8"), a);
+        break;
+      }
+      case IR_GOTO:
+        fprintf(fp, "  j label%d\n", in->x.no);
+        break;
+      case IR_IF: {
+        const char* a = Use(&g, in->y, "$t8");
+        const char* b = Use(&g, in->z, "$t9");
+        fprintf(fp, "  %s %s, %s, label%d\n", branch_of[in->relop], a, b,
+                in->x.no);
+        break;
+      }
+      case IR_RETURN:
+        Load_To(&g, "$v0", in->x);
+        Epilogue(&g);
+        break;
+      case IR_DEC:
+        Zero(&g, g.off[OpMap_Index(&g.m, in->x)], (in->y.ival + 3) & ~3);
+        break;
+      case IR_CALL:
+        Call(&g, i);
+        break;
+      case IR_READ:
+        fprintf(fp, "  jal read\n");
+        Store_Name(&g, in->x, "$v0");
+        break;
+      case IR_WRITE:
+        Load_To(&g, "$a0", in->x);
+        fprintf(fp, "  jal write\n");
+        break;
+      default:
+        assert(0);
+    }
+  }
+  // 执行到末尾返回0
+  int last = n ? func->code[n - 1].op : IR_NOP;
+  if (n == g.nparam || (last != IR_RETURN && last != IR_GOTO)) {
+    fprintf(fp, "  move $v0, $zero\n");
+    Epilogue(&g);
+  }
+
+  free(g.taken);
+  free(g.home);
+  free(g.off);
+  free(g.lo);
+  free(g.hi);
+  return 1;
+}
+
+int Mips_Print(FILE* fp) {
+  fputs(header, fp);
+  zero_loops = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next)
+    if (!Print_Func(fp, func)) {
+      fprintf(stderr, "mips: unsupported code in function %s\n", func->name);
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef MIPS_H
+#define MIPS_H
+
+#include "stdio.h"
+
+/*
+中间代码翻译为MIPS32汇编(SPIM):
+-- 名字用线性扫描(RegAlloc_Linear)分配到$t0-$t7, $s0-$s7, 寄存器不够
+   时才溢出到帧中; 有调用的函数先用$s, 叶函数先用$t
+-- 帧: $fp指向保存的旧$fp, 其上为$ra和第5个起的实参; 其下依次为用到
+   的$s, 跨调用时保存$t的位置, 溢出的名字, DEC的区域; $sp为帧底
+-- 调用约定: 按PARAM的顺序前4个实参在$a0-$a3, 其余由调用者压栈,
+   返回值在$v0; $s由被调用者保存, 跨调用仍活跃的$t由调用者保存
+-- $t8, $t9取常量和溢出的操作数, $v1算大偏移的地址
+-- READ, WRITE调用read, write, 它们只改动$v0, $a0
+*/
+
+// 输出整个程序, 有不支持的形式时返回非零
+extern int Mips_Print(FILE* fp);
+
+#endif
@@ -0,0 +1,429 @@
+#define _POSIX_C_SOURCE 200809L
+#include "mips_sim.h"
+
+#include "ctype.h"
+#include "mips.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+#define TEXT_BASE 0x00400000u
+#define DATA_BASE 0x10000000u
+#define STACK_TOP 0x7FFFF000u
+#define STACK_LIMIT (256u << 20)
+
+enum { V0 = 2, A0 = 4, SP = 29, RA = 31 };
+
+static const char* const reg_names[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3", "t0", "t1", "t2",
+    "t3",   "t4", "t5", "t6", "t7", "s0", "s1", "s2", "s3", "s4", "s5",
+    "s6",   "s7", "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"};
+
+// 操作码, 条件转移按比较运算符的顺序
+enum {
+  M_LI,
+  M_MOVE,
+  M_ADDIU,
+  M_ADDU,
+  M_SUBU,
+  M_MUL,
+  M_DIV,
+  M_MFLO,
+  M_SLL,
+  M_LW,
+  M_SW,
+  M_BEQ,
+  M_BNE,
+  M_BLT,
+  M_BGT,
+  M_BLE,
+  M_BGE,
+  M_J,
+  M_JAL,
+  M_JR,
+  M_SYSCALL
+};
+
+// 操作数的形式: r寄存器, i立即数, l标号, m为off(reg)
+static const struct {
+  const char* name;
+  int op;
+  const char* form;
+} mnemonics[] = {
+    {"li", M_LI, "ri"},       {"la", M_LI, "rl"},       {"move", M_MOVE, "rr"},
+    {"addiu", M_ADDIU, "rri"}, {"addu", M_ADDU, "rrr"},  {"subu", M_SUBU, "rrr"},
+    {"mul", M_MUL, "rrr"},    {"div", M_DIV, "rr"},     {"mflo", M_MFLO, "r"},
+    {"sll", M_SLL, "rri"},    {"lw", M_LW, "rm"},       {"sw", M_SW, "rm"},
+    {"beq", M_BEQ, "rrl"},    {"bne", M_BNE, "rrl"},    {"blt", M_BLT, "rrl"},
+    {"bgt", M_BGT, "rrl"},    {"ble", M_BLE, "rrl"},    {"bge", M_BGE, "rrl"},
+    {"j", M_J, "l"},          {"jal", M_JAL, "l"},      {"jr", M_JR, "r"},
+    {"syscall", M_SYSCALL, ""}};
+
+// SPIM的启动代码
+static const char* start = "__start:\n  jal main\n  li $v0, 10\n  syscall\n";
+
+typedef struct MInstr {
+  int op;
+  int r[3];
+  int imm;  // 立即数, 偏移, 转移目标的指令下标或la的地址
+} MInstr;
+
+typedef struct Label {
+  const char* name;
+  int len;
+  unsigned value;  // 指令下标或数据的地址
+} Label;
+
+typedef struct Sim {
+  MInstr* text;
+  int ntext, entry;
+  char* data;
+  int ndata;
+  Label* labels;
+  int nlabel;
+  int32_t* stack;  // stack[k]为地址STACK_TOP - 4(k + 1)处的字
+  unsigned cap;
+  FILE *in, *out;
+  long long count;
+} Sim;
+
+/* 汇编 */
+
+static int Is_Ident(int c) {
+  return isalnum(c) || c == '_' || c == '.' || c == '$';
+}
+
+static const char* Skip(const char* p) {
+  while (*p == ' ' || *p == '\t') p++;
+  return p;
+}
+
+static int Ident_Len(const char* p) {
+  int n = 0;
+  while (Is_Ident((unsigned char)p[n])) n++;
+  return n;
+}
+
+static int Label_Cmp(const void* a, const void* b) {
+  const Label *x = a, *y = b;
+  int c = memcmp(x->name, y->name, x->len < y->len ? x->len : y->len);
+  return c ? c : x->len - y->len;
+}
+
+static const Label* Find_Label(const Sim* s, const char* name, int len) {
+  Label key = {name, len, 0};
+  return bsearch(&key, s->labels, s->nlabel, sizeof(Label), Label_Cmp);
+}
+
+// 寄存器$名字或$编号, 不认识时返回-1
+static int Reg(const char* p, int len) {
+  if (len < 2 || p[0] != '$') return -1;
+  if (isdigit((unsigned char)p[1])) {
+    int r = atoi(p + 1);
+    return r < 32 ? r : -1;
+  }
+  for (int r = 0; r < 32; r++)
+    if ((int)strlen(reg_names[r]) == len - 1 &&
+        !memcmp(reg_names[r], p + 1, len - 1))
+      return r;
+  return -1;
+}
+
+// 解析一条指令的操作数, 出错返回0
+static int Operands(const Sim* s, const char* p, const char* form, MInstr* m) {
+  int nr = 0;
+  for (const char* f = form; *f; f++) {
+    p = Skip(p);
+    if (f != form) {
+      if (*p != ',') return 0;
+      p = Skip(p + 1);
+    }
+    if (*f == 'r') {
+      int len = Ident_Len(p);
+      if ((m->r[nr++] = Reg(p, len)) < 0) return 0;
+      p += len;
+    } else if (*f == 'i' || *f == 'm') {
+      char* end;
+      long v = strtol(p, &end, 10);
+      if (end == p || v < INT32_MIN || v > (long)UINT32_MAX) return 0;
+      m->imm = (int)(uint32_t)v;
+      p = end;
+      if (*f == 'm') {
+        int len = Ident_Len(p + 1);
+        if (*p != '(' || (m->r[nr++] = Reg(p + 1, len)) < 0 ||
+            p[len + 1] != ')')
+          return 0;
+        p += len + 2;
+      }
+    } else {
+      int len = Ident_Len(p);
+      const Label* l = len ? Find_Label(s, p, len) : NULL;
+      if (!l) return 0;
+      m->imm = (int)l->value;
+      p += len;
+    }
+  }
+  return *Skip(p) == '\0' || *Skip(p) == '#';
+}
+
+// .asciiz "..."
+static int Ascii(Sim* s, const char* p) {
+  if (*p != '"') return 0;
+  for (p++; *p != '"'; p++) {
+    int c = *p;
+    if (!c) return 0;
+    if (c == '\\') {
+      c = *++p;
+      c = c == 'n' ? '\n' : c == 't' ? '\t' : c == '0' ? '\0' : c;
+    }
+    s->data = realloc(s->data, s->ndata + 2);
+    s->data[s->ndata++] = (char)c;
+  }
+  s->data = realloc(s->data, s->ndata + 1);
+  s->data[s->ndata++] = '\0';
+  return 1;
+}
+
+// 第一遍收集标号和数据, 数出指令; 第二遍翻译指令
+static int Assemble(Sim* s, char** lines, int nline, int pass) {
+  int data = 0, n = 0, cap = 0, i;
+  for (i = 0; i < nline; i++) {
+    const char* p = lines[i];
+    int len = Ident_Len(p);
+    if (len && p[len] == ':') {  // 标号
+      if (!pass) {
+        if (s->nlabel == cap) {
+          cap = cap ? 2 * cap : 256;
+          s->labels = realloc(s->labels, cap * sizeof(Label));
+        }
+        s->labels[s->nlabel++] =
+            (Label){p, len, data ? DATA_BASE + s->ndata : (unsigned)n};
+      }
+      p += len + 1;
+    }
+    p = Skip(p);
+    if (!*p || *p == '#') continue;
+    len = Ident_Len(p);
+    if (*p == '.') {
+      if (len == 5 && !memcmp(p, ".data", 5))
+        data = 1;
+      else if (len == 5 && !memcmp(p, ".text", 5))
+        data = 0;
+      else if (len == 7 && !memcmp(p, ".asciiz", 7)) {
+        if (!data || (!pass && !Ascii(s, Skip(p + len)))) goto bad;
+      } else if (len != 6 || memcmp(p, ".globl", 6))
+        goto bad;
+      continue;
+    }
+    if (data) goto bad;
+    if (pass) {
+      int k = 0, nm = sizeof(mnemonics) / sizeof(mnemonics[0]);
+      while (k < nm && ((int)strlen(mnemonics[k].name) != len ||
+                        memcmp(mnemonics[k].name, p, len)))
+        k++;
+      MInstr* m = &s->text[n];
+      memset(m, 0, sizeof(MInstr));
+      if (k == nm) goto bad;
+      m->op = mnemonics[k].op;
+      if (!Operands(s, p + len, mnemonics[k].form, m)) goto bad;
+      if (mnemonics[k].form[1] == 'l' && m->op == M_LI &&
+          m->imm < (int)DATA_BASE)  // la取指令的地址
+        m->imm = TEXT_BASE + 4 * m->imm;
+    }
+    n++;
+  }
+  s->ntext = n;
+  return 1;
+bad:
+  fprintf(stderr, "mips: unsupported line %d: %s\n", i + 1, lines[i]);
+  return 0;
+}
+
+/* 执行 */
+
+static void Sim_Error(unsigned pc, const char* msg) {
+  fprintf(stderr, "runtime error at 0x%08x: %s\n", pc, msg);
+}
+
+// 地址addr处的字, 地址不合法时返回NULL并输出错误
+static int32_t* Word(Sim* s, uint32_t addr, int sp, unsigned pc) {
+  if (addr % 4 || addr < (uint32_t)sp || addr >= STACK_TOP) {
+    Sim_Error(pc, "bad address");
+    return NULL;
+  }
+  unsigned need = (STACK_TOP - addr) / 4;
+  if (need > s->cap) {
+    if (need > STACK_LIMIT / 4) {
+      Sim_Error(pc, "stack overflow");
+      return NULL;
+    }
+    unsigned cap = s->cap ? s->cap : 1024;
+    while (cap < need) cap *= 2;
+    if (cap > STACK_LIMIT / 4) cap = STACK_LIMIT / 4;
+    s->stack = realloc(s->stack, cap * sizeof(int32_t));
+    memset(s->stack + s->cap, 0, (cap - s->cap) * sizeof(int32_t));
+    s->cap = cap;
+  }
+  return &s->stack[need - 1];
+}
+
+static int Exec(Sim* s) {
+  int32_t R[32] = {0}, lo = 0;
+  int pc = s->entry;
+  long long count = 0;
+  R[SP] = (int32_t)STACK_TOP;
+  for (;;) {
+    if ((unsigned)pc >= (unsigned)s->ntext) {
+      Sim_Error(TEXT_BASE + 4 * pc, "bad jump");
+      break;
+    }
+    const MInstr* m = &s->text[pc++];
+    unsigned at = TEXT_BASE + 4 * (pc - 1);
+    int32_t* w;
+    uint32_t a;
+    count++;
+    switch (m->op) {
+      case M_LI:
+        R[m->r[0]] = m->imm;
+        break;
+      case M_MOVE:
+        R[m->r[0]] = R[m->r[1]];
+        break;
+      case M_ADDIU:
+        R[m->r[0]] = (int32_t)((uint32_t)R[m->r[1]] + (uint32_t)m->imm);
+        break;
+      case M_ADDU:
+        R[m->r[0]] = (int32_t)((uint32_t)R[m->r[1]] + (uint32_t)R[m->r[2]]);
+        break;
+      case M_SUBU:
+        R[m->r[0]] = (int32_t)((uint32_t)R[m->r[1]] - (uint32_t)R[m->r[2]]);
+        break;
+      case M_MUL:
+        R[m->r[0]] = (int32_t)(uint32_t)((int64_t)R[m->r[1]] * R[m->r[2]]);
+        break;
+      case M_DIV:  // 除以0时LO不变
+        if (R[m->r[1]] == -1)
+          lo = (int32_t)(0u - (uint32_t)R[m->r[0]]);
+        else if (R[m->r[1]])
+          lo = R[m->r[0]] / R[m->r[1]];
+        break;
+      case M_MFLO:
+        R[m->r[0]] = lo;
+        break;
+      case M_SLL:
+        R[m->r[0]] = (int32_t)((uint32_t)R[m->r[1]] << (m->imm & 31));
+        break;
+      case M_LW:
+      case M_SW:
+        a = (uint32_t)R[m->r[1]] + (uint32_t)m->imm;
+        if (!(w = Word(s, a, R[SP], at))) goto fail;
+        if (m->op == M_LW)
+          R[m->r[0]] = *w;
+        else
+          *w = R[m->r[0]];
+        break;
+      case M_BEQ:
+      case M_BNE:
+      case M_BLT:
+      case M_BGT:
+      case M_BLE:
+      case M_BGE: {
+        int32_t x = R[m->r[0]], y = R[m->r[1]];
+        int taken[] = {x == y, x != y, x < y, x > y, x <= y, x >= y};
+        if (taken[m->op - M_BEQ]) pc = m->imm;
+        break;
+      }
+      case M_JAL:
+        R[RA] = (int32_t)(TEXT_BASE + 4 * pc);
+        // fall through
+      case M_J:
+        pc = m->imm;
+        break;
+      case M_JR:
+        a = (uint32_t)R[m->r[0]] - TEXT_BASE;
+        if (a % 4) {
+          Sim_Error(at, "bad jump");
+          goto fail;
+        }
+        pc = (int)(a / 4);
+        break;
+      case M_SYSCALL:
+        if (R[V0] == 1)
+          fprintf(s->out, "%d", R[A0]);
+        else if (R[V0] == 4) {
+          a = (uint32_t)R[A0] - DATA_BASE;
+          if (a >= (uint32_t)s->ndata) {
+            Sim_Error(at, "bad address");
+            goto fail;
+          }
+          fputs(s->data + a, s->out);
+        } else if (R[V0] == 5) {
+          int v = 0;
+          if (fscanf(s->in, "%d", &v) != 1) v = 0;
+          R[V0] = v;
+        } else if (R[V0] == 10) {
+          s->count = count;
+          return 0;
+        } else {
+          Sim_Error(at, "unsupported syscall");
+          goto fail;
+        }
+        break;
+    }
+    R[0] = 0;
+  }
+fail:
+  s->count = count;
+  return 1;
+}
+
+int Mips_Run(FILE* in, FILE* out, FILE* report) {
+  char* src = NULL;
+  size_t len = 0;
+  FILE* fp = open_memstream(&src, &len);
+  int status = Mips_Print(fp);
+  fputs(start, fp);
+  fclose(fp);
+  if (status) {
+    free(src);
+    return status;
+  }
+
+  // 按行切开, 第一遍之后标号排序以便查找
+  int nline = 0, cap = 1024;
+  char** lines = malloc(cap * sizeof(char*));
+  for (char* p = src; *p;) {
+    if (nline == cap) lines = realloc(lines, (cap *= 2) * sizeof(char*));
+    lines[nline++] = p;
+    char* e = strchr(p, '\n');
+    if (!e) break;
+    *e = '\0';
+    p = e + 1;
+  }
+  Sim s = {.in = in, .out = out};
+  status = 1;
+  if (Assemble(&s, lines, nline, 0)) {
+    qsort(s.labels, s.nlabel, sizeof(Label), Label_Cmp);
+    s.text = malloc((s.ntext + 1) * sizeof(MInstr));
+    const Label* entry = Find_Label(&s, "__start", 7);
+    if (Assemble(&s, lines, nline, 1)) {
+      struct timespec t0, t1;
+      s.entry = (int)entry->value;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      status = Exec(&s);
+      fflush(out);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      if (report)
+        fprintf(report, "mips     instructions %lld, time %.3f s\n", s.count,
+                (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    }
+  }
+  free(s.text);
+  free(s.data);
+  free(s.labels);
+  free(s.stack);
+  free(lines);
+  free(src);
+  return status;
+}
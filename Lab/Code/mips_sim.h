@@ -0,0 +1,22 @@
+#ifndef MIPS_SIM_H
+#define MIPS_SIM_H
+
+#include "stdio.h"
+
+/*
+MIPS32汇编的模拟器, 没有SPIM时代替它检查--mips的输出:
+-- 先用Mips_Print输出汇编文本, 再汇编并执行这段文本, 只认Mips_Print
+   用到的指令, 伪指令和伪操作, 遇到别的报错
+-- 与SPIM相同: 从jal main开始, .data在0x10000000, syscall 1, 4, 5, 10
+   分别为输出整数, 输出字符串, 读整数和退出; div除以0不陷入
+-- 栈顶为0x7FFFF000, 向下增长, 不超过256MB, 超过时报栈溢出; lw, sw的
+   地址须按字对齐, 且在$sp之上的栈中(即活跃的帧), 否则为bad address,
+   与解释器的规则相同
+-- 计数: 每条指令和伪指令计一条
+*/
+
+// 执行当前上下文中的程序, read读in, write写out(含提示符); 出错返回
+// 非零, report非空时输出执行的指令数和用时
+extern int Mips_Run(FILE* in, FILE* out, FILE* report);
+
+#endif
@@ -0,0 +1,328 @@
+#include "opt.h"
+
+#include "assert.h"
+#include "callgraph.h"
+#include "stdlib.h"
+#include "string.h"
+
+void OpMap_Init(OpMap* m, const IRFunc* func) {
+  int tmax = -1, vmax = -1;
+  m->tmin = m->vmin = 0x7FFFFFFF;
+  for (int i = 0; i < func->len; i++) {
+    const Operand* ops = &func->code[i].x;
+    for (int k = 0; k < 3; k++) {
+      if (ops[k].kind == O_TEMP) {
+        if (ops[k].no < m->tmin) m->tmin = ops[k].no;
+        if (ops[k].no > tmax) tmax = ops[k].no;
+      } else if (ops[k].kind == O_VAR) {
+        if (ops[k].no < m->vmin) m->vmin = ops[k].no;
+        if (ops[k].no > vmax) vmax = ops[k].no;
+      }
+    }
+  }
+  m->tcnt = tmax < 0 ? 0 : tmax - m->tmin + 1;
+  m->vcnt = vmax < 0 ? 0 : vmax - m->vmin + 1;
+}
+
+int OpMap_Index(const OpMap* m, Operand op) {
+  if (op.kind == O_TEMP) {
+    unsigned i = op.no - m->tmin;
+    return i < (unsigned)m->tcnt ? (int)i : -1;
+  } else if (op.kind == O_VAR) {
+    unsigned i = op.no - m->vmin;
+    return i < (unsigned)m->vcnt ? m->tcnt + (int)i : -1;
+  }
+  return -1;
+}
+
+int Op_Equal(Operand a, Operand b) {
+  if (a.kind != b.kind) return 0;
+  switch (a.kind) {
+    case O_NONE:
+      return 1;
+    case O_FCONST:
+      return a.fval == b.fval;
+    case O_FUNC:
+      return a.name == b.name;
+    default:
+      return a.no == b.no;
+  }
+}
+
+Operand* Instr_Def(Instr* in) {
+  switch (in->op) {
+    case IR_ASSIGN:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_ADDR:
+    case IR_LOAD:
+    case IR_CALL:
+    case IR_READ:
+    case IR_PARAM:
+      return &in->x;
+    default:
+      return NULL;
+  }
+}
+
+int Instr_Uses(Instr* in, Operand** uses) {
+  switch (in->op) {
+    case IR_ASSIGN:
+    case IR_LOAD:
+      uses[0] = &in->y;
+      return 1;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_IF:
+      uses[0] = &in->y;
+      uses[1] = &in->z;
+      return 2;
+    case IR_STORE:
+      uses[0] = &in->x;
+      uses[1] = &in->y;
+      return 2;
+    case IR_RETURN:
+    case IR_ARG:
+    case IR_WRITE:
+      uses[0] = &in->x;
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+int Instr_IsPure(const Instr* in) {
+  switch (in->op) {
+    case IR_ASSIGN:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_ADDR:
+    case IR_LOAD:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+int Instr_IsJump(const Instr* in) {
+  return in->op == IR_GOTO || in->op == IR_IF || in->op == IR_RETURN;
+}
+
+// 放在内存中的变量: 被取过地址或者DEC声明的, 不能当作普通的值来跟踪
+char* Func_AddrTaken(const IRFunc* func, const OpMap* m) {
+  char* taken = calloc(OpMap_Size(m) + 1, 1);
+  for (int i = 0; i < func->len; i++) {
+    const Instr* in = &func->code[i];
+    int k = -1;
+    if (in->op == IR_ADDR) k = OpMap_Index(m, in->y);
+    if (in->op == IR_DEC) k = OpMap_Index(m, in->x);
+    if (k >= 0) taken[k] = 1;
+  }
+  return taken;
+}
+
+// 32位补码运算, 除零不折叠
+int Fold_Arith(int op, int a, int b, int* r) {
+  switch (op) {
+    case IR_ADD:
+      *r = (int)((unsigned)a + (unsigned)b);
+      return 1;
+    case IR_SUB:
+      *r = (int)((unsigned)a - (unsigned)b);
+      return 1;
+    case IR_MUL:
+      *r = (int)((unsigned)a * (unsigned)b);
+      return 1;
+    case IR_DIV:
+      if (b == 0 || (a == (int)0x80000000 && b == -1)) return 0;
+      *r = a / b;
+      return 1;
+  }
+  return 0;
+}
+
+int Fold_Relop(int relop, int a, int b) {
+  switch (relop) {
+    case RELOP_EQ:
+      return a == b;
+    case RELOP_NE:
+      return a != b;
+    case RELOP_LT:
+      return a < b;
+    case RELOP_GT:
+      return a > b;
+    case RELOP_LE:
+      return a <= b;
+    default:
+      return a >= b;
+  }
+}
+
+int Loop_Precede(const IRFunc* func, const CFG* cfg, int l) {
+  int h = cfg->loops[l].header;
+  if (h == 0) return 1;
+  int op = func->code[cfg->blocks[h - 1].last - 1].op;
+  return op == IR_GOTO || op == IR_RETURN || !CFG_Dominates(cfg, h, h - 1);
+}
+
+int Loop_Redirect(IRFunc* func, const CFG* cfg, int l) {
+  const Block* h = &cfg->blocks[cfg->loops[l].header];
+  Operand head = func->code[h->first].x;
+  int label = 0;
+  for (int p = 0; p < h->npred; p++) {
+    Instr* jmp = &func->code[cfg->blocks[h->pred[p]].last - 1];
+    // 循环内的前驱都被循环头支配
+    if (CFG_Dominates(cfg, cfg->loops[l].header, h->pred[p]) ||
+        (jmp->op != IR_GOTO && jmp->op != IR_IF) || !Op_Equal(jmp->x, head))
+      continue;
+    if (!label) label = IR_NewLabel();
+    jmp->x = OpLabel(label);
+  }
+  return label;
+}
+
+void IR_Compact(IRFunc* func) {
+  int n = 0;
+  for (int i = 0; i < func->len; i++)
+    if (func->code[i].op != IR_NOP) func->code[n++] = func->code[i];
+  func->len = n;
+}
+
+// 块内非最后一次的定值只在本块内使用, 换成新的临时变量. 翻译时复用的
+// t := &v; t := t + o 拆开后, 值编号和外提才能分别处理各个值
+int Opt_Split(IRFunc* func) {
+  OpMap m;
+  OpMap_Init(&m, func);
+  char* taken = Func_AddrTaken(func, &m);
+  int n = func->len, size = OpMap_Size(&m);
+  int temp = m.tcnt ? m.tmin + m.tcnt : 1;
+  char* later = calloc(n + 1, 1);  // 之后在块内还会重新定值
+  int* stamp = malloc((size + 1) * sizeof(int));
+  int* last = malloc((size + 1) * sizeof(int));
+  Operand* ren = malloc((size + 1) * sizeof(Operand));
+  Operand* u[2];
+  int changed = 0;
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int j = 0; j < size; j++) stamp[j] = -1;
+    int block = 0;
+    for (int i = 0; i < n; i++) {
+      Instr* in = &func->code[i];
+      if (in->op == IR_LABEL) block++;
+      if (pass) {
+        int k = Instr_Uses(in, u);
+        while (k--) {
+          int j = OpMap_Index(&m, *u[k]);
+          if (j >= 0 && stamp[j] == block) *u[k] = ren[j];
+        }
+      }
+      Operand* d = Instr_Def(in);
+      int j = d ? OpMap_Index(&m, *d) : -1;
+      if (j >= 0 && !taken[j]) {
+        if (!pass) {
+          if (stamp[j] == block) later[last[j]] = 1;
+          stamp[j] = block;
+          last[j] = i;
+        } else if (later[i]) {
+          // 本块中随后的使用都改为新名字, 直到下一次定值
+          ren[j] = *d = OpTemp(temp++);
+          stamp[j] = block;
+          changed = 1;
+        } else
+          stamp[j] = -1;
+      }
+      if (Instr_IsJump(in)) block++;
+    }
+  }
+
+  free(taken);
+  free(later);
+  free(stamp);
+  free(last);
+  free(ren);
+  return changed;
+}
+
+// x := x + c 这样对自身的使用不能使x有用, 否则只剩自增的归纳变量删不掉
+static int Self_Use(Instr* in, Operand* u) {
+  return Instr_IsPure(in) && u != &in->x && Op_Equal(*u, in->x);
+}
+
+// 删除结果无人使用的无副作用指令
+int Opt_Dead(IRFunc* func) {
+  OpMap m;
+  OpMap_Init(&m, func);
+  char* taken = Func_AddrTaken(func, &m);
+  int* uses = calloc(OpMap_Size(&m) + 1, sizeof(int));
+  Operand* u[2];
+
+  for (int i = 0; i < func->len; i++) {
+    int n = Instr_Uses(&func->code[i], u);
+    for (int k = 0; k < n; k++) {
+      int j = OpMap_Index(&m, *u[k]);
+      if (j >= 0 && !Self_Use(&func->code[i], u[k])) uses[j]++;
+    }
+  }
+
+  // 逆序扫描, 删除一条指令后其操作数的定值随后也可能变为无用
+  int changed = 0;
+  for (int i = func->len - 1; i >= 0; i--) {
+    Instr* in = &func->code[i];
+    if (!Instr_IsPure(in)) continue;
+    int d = OpMap_Index(&m, in->x);
+    if (d < 0 || taken[d] || uses[d]) continue;
+    int n = Instr_Uses(in, u);
+    for (int k = 0; k < n; k++) {
+      int j = OpMap_Index(&m, *u[k]);
+      if (j >= 0 && !Self_Use(in, u[k])) uses[j]--;
+    }
+    in->op = IR_NOP;
+    changed = 1;
+  }
+
+  free(taken);
+  free(uses);
+  if (changed) IR_Compact(func);
+  return changed;
+}
+
+void Optimize(int level) {
+  if (level <= 0) return;
+  // 自底向上: 被调用的函数先优化, 内联进调用者后再优化调用者
+  CallGraph* cg = CallGraph_Build();
+  for (int k = 0; k < cg->nfunc; k++) {
+    IRFunc* func = cg->funcs[k];
+    Opt_Inline(func, cg);
+    // 一轮有改动就再来一轮, 至多OPT_ROUNDS轮, 并且指令数连续两轮没有降到
+    // 新低就停: 大函数上后面的轮次只有零星的改动, 每轮却都要遍历整个函数;
+    // 外提和归纳变量会先让指令变多一轮, 下一轮才删掉, 所以容许一轮不降
+    int changed = 1, min = func->len, stale = 0;
+    for (int round = 0; changed && round < OPT_ROUNDS; round++) {
+      changed = Opt_Split(func);
+      changed |= Opt_Mem2Reg(func);
+      changed |= Opt_Lvn(func);
+      changed |= Opt_Const(func);
+      changed |= Opt_Sccp(func);
+      changed |= Opt_Copy(func);
+      changed |= Opt_Jump(func);
+      changed |= Opt_Licm(func);
+      changed |= Opt_Iv(func);
+      changed |= Opt_Dead(func);
+      if (func->len < min) {
+        min = func->len;
+        stale = 0;
+      } else if (++stale == 2)
+        break;
+    }
+  }
+  CallGraph_Free(cg);
+  // 不再优化后才复用槽位, 以免合并的名字妨碍内联进来后的优化
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next) Opt_Slot(func);
+  IR_RenumberLabels();
+}
@@ -0,0 +1,91 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "cfg.h"
+#include "ir.h"
+
+/*
+中间代码优化:
+-- 各遍均以函数为单位, 就地改写IRFunc的指令数组
+-- 删除指令时先改为IR_NOP, 由IR_Compact统一清除
+-- 返回值非零表示有改动
+*/
+
+// 函数内临时变量和变量编号的稠密映射
+typedef struct OpMap {
+  int tmin, tcnt;  // 临时变量 t[tmin, tmin + tcnt)
+  int vmin, vcnt;  // 变量 v[vmin, vmin + vcnt)
+} OpMap;
+
+extern void OpMap_Init(OpMap* m, const IRFunc* func);
+extern int OpMap_Index(const OpMap* m, Operand op);
+
+static inline int OpMap_Size(const OpMap* m) { return m->tcnt + m->vcnt; }
+
+// 位集
+#define WORD_BITS (8 * sizeof(unsigned long))
+#define BITSET_WORDS(n) (((n) + WORD_BITS - 1) / WORD_BITS)
+
+static inline void Bit_Set(unsigned long* set, int i) {
+  set[i / WORD_BITS] |= 1UL << (i % WORD_BITS);
+}
+
+static inline void Bit_Clear(unsigned long* set, int i) {
+  set[i / WORD_BITS] &= ~(1UL << (i % WORD_BITS));
+}
+
+static inline int Bit_Test(const unsigned long* set, int i) {
+  return (set[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+}
+
+extern int Op_Equal(Operand a, Operand b);
+extern Operand* Instr_Def(Instr* in);
+extern int Instr_Uses(Instr* in, Operand** uses);
+extern int Instr_IsPure(const Instr* in);
+extern int Instr_IsJump(const Instr* in);
+extern char* Func_AddrTaken(const IRFunc* func, const OpMap* m);
+extern void IR_Compact(IRFunc* func);
+extern int Fold_Arith(int op, int a, int b, int* r);
+extern int Fold_Relop(int relop, int a, int b);
+
+// c为2的k次方(k >= 1)时返回k, 否则为-1; 乘c可以改为左移k位
+static inline int Pow2_Shift(int c) {
+  if (c < 2 || (c & (c - 1))) return -1;
+  int k = 0;
+  while (c >>= 1) k++;
+  return k;
+}
+
+// 循环的前置块, 按建图时的指令判断:
+// Loop_Precede: 前置块能否直接放在循环头之前, 即前面的块在循环外或者不会顺序执行进来
+// Loop_Redirect: 循环外跳到循环头的改为跳到新标号并返回它, 没有这样的跳转为0
+extern int Loop_Precede(const IRFunc* func, const CFG* cfg, int l);
+extern int Loop_Redirect(IRFunc* func, const CFG* cfg, int l);
+
+// 各遍
+extern int Opt_Split(IRFunc* func);
+extern int Opt_Dead(IRFunc* func);
+extern int Opt_Const(IRFunc* func);
+extern int Opt_Mem2Reg(IRFunc* func);
+extern int Opt_Copy(IRFunc* func);
+extern int Opt_Jump(IRFunc* func);
+extern int Opt_Lvn(IRFunc* func);
+extern int Opt_Sccp(IRFunc* func);
+extern int Opt_Licm(IRFunc* func);
+extern int Opt_Iv(IRFunc* func);
+
+// 内联: 被调用的函数不超过opt_inline_limit条指令时展开, 为0时不内联
+// opt_inline_limit是线程局部的, 各线程可以用不同的设置编译
+#define OPT_INLINE_LIMIT 32
+typedef struct CallGraph CallGraph;
+extern __thread int opt_inline_limit;
+extern int Opt_Inline(IRFunc* func, const CallGraph* cg);
+
+// 槽位复用: 活跃区间不重叠的临时变量共用一个名字, 函数内重新编号
+extern int Opt_Slot(IRFunc* func);
+
+// 按优化级别对所有函数运行各遍; 各遍对一个函数至多重复OPT_ROUNDS轮
+#define OPT_ROUNDS 8
+extern void Optimize(int level);
+
+#endif
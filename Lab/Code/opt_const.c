@@ -0,0 +1,178 @@
+#include "assert.h"
+#include "cfg.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+常量折叠与常量传播:
+-- 全局: 只有一处定值且为常量赋值的临时变量(或不在内存中的变量),
+   其所有使用都替换为该常量
+-- 基本块内: 顺序跟踪已知为常量的值, 替换使用并折叠整型运算
+-- 操作数均为常量的条件跳转变为GOTO或删除, 随后删除不可达的代码
+*/
+
+typedef struct Value {
+  int block;  // 在哪个基本块中得知, 不是当前块则无效
+  Operand c;
+} Value;
+
+static int Is_Int(Operand op) { return op.kind == O_CONST; }
+static int Is_Const(Operand op) {
+  return op.kind == O_CONST || op.kind == O_FCONST;
+}
+
+// 代数化简: x+0, x-0, x*1, x/1 变为复制, x*0 变为常量, x*2 变为 x+x
+static int Simplify(Instr* in) {
+  Operand y = in->y, z = in->z;
+  switch (in->op) {
+    case IR_ADD:
+      if (Is_Int(y) && y.ival == 0) {
+        in->y = z;
+        break;
+      }
+      // fall through
+    case IR_SUB:
+      if (Is_Int(z) && z.ival == 0) break;
+      return 0;
+    case IR_MUL:
+      // 乘2改为自加, 目标上加法比乘法便宜
+      if (Is_Int(y) != Is_Int(z) && (Is_Int(y) ? y : z).ival == 2) {
+        in->op = IR_ADD;
+        in->y = in->z = Is_Int(y) ? z : y;
+        return 1;
+      }
+      if (Is_Int(y) && y.ival == 1) {
+        in->y = z;
+        break;
+      }
+      if (Is_Int(z) && z.ival == 1) break;
+      if ((Is_Int(y) && y.ival == 0) || (Is_Int(z) && z.ival == 0)) {
+        in->y = OpConst(0);
+        break;
+      }
+      return 0;
+    case IR_DIV:
+      if (Is_Int(z) && z.ival == 1) break;
+      return 0;
+    default:
+      return 0;
+  }
+  in->op = IR_ASSIGN;
+  in->z = OpNone();
+  return 1;
+}
+
+// 删除不可达的基本块(保留DEC)
+static int Remove_Unreachable(IRFunc* func) {
+  if (!func->len) return 0;
+  CFG* cfg = CFG_Build(func);
+  int changed = 0;
+  for (int k = 0; k < cfg->nblock; k++) {
+    const Block* b = &cfg->blocks[k];
+    if (b->rpo >= 0) continue;
+    for (int i = b->first; i < b->last; i++)
+      if (func->code[i].op != IR_DEC && func->code[i].op != IR_NOP) {
+        func->code[i].op = IR_NOP;
+        changed = 1;
+      }
+  }
+  CFG_Free(cfg);
+  return changed;
+}
+
+int Opt_Const(IRFunc* func) {
+  OpMap m;
+  OpMap_Init(&m, func);
+  int size = OpMap_Size(&m);
+  char* taken = Func_AddrTaken(func, &m);
+  int* defs = calloc(size + 1, sizeof(int));
+  Operand* single = malloc((size + 1) * sizeof(Operand));
+  Value* known = malloc((size + 1) * sizeof(Value));
+  for (int j = 0; j < size; j++) known[j].block = -1;
+
+  // 统计定值
+  for (int i = 0; i < func->len; i++) {
+    Instr* in = &func->code[i];
+    Operand* d = Instr_Def(in);
+    int j = d ? OpMap_Index(&m, *d) : -1;
+    if (j < 0) continue;
+    defs[j]++;
+    single[j] = in->op == IR_ASSIGN ? in->y : OpNone();
+  }
+
+  int changed = 0, block = 0;
+  Operand* u[2];
+  for (int i = 0; i < func->len; i++) {
+    Instr* in = &func->code[i];
+    if (in->op == IR_LABEL) block++;
+
+    // 替换使用, 指针位置(*x := y 的 x, x := *y 的 y)除外
+    int n = in->op == IR_LOAD ? 0 : Instr_Uses(in, u);
+    for (int k = 0; k < n; k++) {
+      if (in->op == IR_STORE && u[k] == &in->x) continue;
+      int j = OpMap_Index(&m, *u[k]);
+      if (j < 0 || taken[j]) continue;
+      if (defs[j] == 1 && Is_Const(single[j])) {
+        *u[k] = single[j];
+        changed = 1;
+      } else if (known[j].block == block) {
+        *u[k] = known[j].c;
+        changed = 1;
+      }
+    }
+
+    // 折叠
+    switch (in->op) {
+      case IR_ADD:
+      case IR_SUB:
+      case IR_MUL:
+      case IR_DIV: {
+        int r;
+        if (Is_Int(in->y) && Is_Int(in->z) &&
+            Fold_Arith(in->op, in->y.ival, in->z.ival, &r)) {
+          in->op = IR_ASSIGN;
+          in->y = OpConst(r);
+          in->z = OpNone();
+          changed = 1;
+        } else if (Simplify(in))
+          changed = 1;
+        break;
+      }
+      case IR_IF:
+        if (Is_Int(in->y) && Is_Int(in->z)) {
+          if (Fold_Relop(in->relop, in->y.ival, in->z.ival)) {
+            in->op = IR_GOTO;
+            in->y = in->z = OpNone();
+          } else
+            in->op = IR_NOP;
+          changed = 1;
+        }
+        break;
+    }
+    if (in->op == IR_ASSIGN && Op_Equal(in->x, in->y)) {
+      in->op = IR_NOP;
+      changed = 1;
+    }
+
+    // 记录定值
+    Operand* d = Instr_Def(in);
+    int j = d ? OpMap_Index(&m, *d) : -1;
+    if (j >= 0 && !taken[j]) {
+      if (in->op == IR_ASSIGN && Is_Const(in->y)) {
+        known[j].block = block;
+        known[j].c = in->y;
+      } else
+        known[j].block = -1;
+    }
+    if (Instr_IsJump(in)) block++;
+  }
+
+  changed |= Remove_Unreachable(func);
+  free(taken);
+  free(defs);
+  free(single);
+  free(known);
+  if (changed) IR_Compact(func);
+  return changed;
+}
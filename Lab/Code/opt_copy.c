@@ -0,0 +1,363 @@
+#include "assert.h"
+#include "cfg.h"
+#include "liveness.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+复制传播与无用赋值删除:
+-- 复制指 x := y, x 和 y 都是不在内存中的临时变量或变量
+-- 按"可用复制"数据流求出每处可用的复制(所有路径上都执行过
+   x := y, 之后 x 和 y 都未被重新定值), 把对 x 的使用改为 y
+-- 同一时刻以某个名字为 x 的可用复制至多一个, 块内用名字到复制的映射
+   顺序扫描; 块间只传播可能用到的复制, 即 x 在块出口活跃, 或者 x 是
+   另一个这样的复制的 y, 集合的大小不超过块出口活跃的名字数
+-- 再按活跃变量分析删除结果不再活跃的无副作用指令
+*/
+
+typedef struct Copies {
+  int n;
+  int* at;       // 指令 -> 复制编号, 不是复制为-1
+  int *x, *y;    // 复制 -> x, y的OpMap下标
+  Operand* src;  // 复制 -> 改写前的y
+} Copies;
+
+// 顺序扫描中的可用复制; y被重新定值后复制失效, 用定值次数判断
+typedef struct Avail {
+  int epoch;  // 每扫描一个块加一
+  int* stamp;  // 名字 -> copy[名字]在第几次扫描中写入
+  int* copy;   // 名字 -> 以它为x的可用复制, 没有为-1
+  int* ver;    // 名字 -> 定值的次数
+  int* yver;   // 复制 -> 变为可用时y的定值次数
+} Avail;
+
+static int Is_Copy(const Instr* in, const OpMap* m, const char* taken) {
+  if (in->op != IR_ASSIGN || Op_Equal(in->x, in->y)) return 0;
+  int x = OpMap_Index(m, in->x), y = OpMap_Index(m, in->y);
+  return x >= 0 && y >= 0 && !taken[x] && !taken[y];
+}
+
+static void Copies_Build(Copies* cs, const IRFunc* func, const OpMap* m,
+                         const char* taken) {
+  cs->n = 0;
+  cs->at = malloc((func->len + 1) * sizeof(int));
+  for (int i = 0; i < func->len; i++)
+    cs->at[i] = Is_Copy(&func->code[i], m, taken) ? cs->n++ : -1;
+
+  cs->x = malloc((cs->n + 1) * sizeof(int));
+  cs->y = malloc((cs->n + 1) * sizeof(int));
+  cs->src = malloc((cs->n + 1) * sizeof(Operand));
+  for (int i = 0; i < func->len; i++) {
+    int c = cs->at[i];
+    if (c < 0) continue;
+    cs->x[c] = OpMap_Index(m, func->code[i].x);
+    cs->y[c] = OpMap_Index(m, func->code[i].y);
+    cs->src[c] = func->code[i].y;
+  }
+}
+
+static void Copies_Free(Copies* cs) {
+  free(cs->at);
+  free(cs->x);
+  free(cs->y);
+  free(cs->src);
+}
+
+static void Avail_Init(Avail* a, int size, int ncopy) {
+  a->epoch = 0;
+  a->stamp = calloc(size + 1, sizeof(int));
+  a->copy = malloc((size + 1) * sizeof(int));
+  a->ver = calloc(size + 1, sizeof(int));
+  a->yver = malloc((ncopy + 1) * sizeof(int));
+}
+
+static void Avail_Free(Avail* a) {
+  free(a->stamp);
+  free(a->copy);
+  free(a->ver);
+  free(a->yver);
+}
+
+static void Avail_Put(Avail* a, const Copies* cs, int c) {
+  a->stamp[cs->x[c]] = a->epoch;
+  a->copy[cs->x[c]] = c;
+  a->yver[c] = a->ver[cs->y[c]];
+}
+
+// 以名字j为x的可用复制, 没有为-1
+static int Avail_Get(const Avail* a, const Copies* cs, int j) {
+  if (a->stamp[j] != a->epoch) return -1;
+  int c = a->copy[j];
+  return c >= 0 && a->yver[c] == a->ver[cs->y[c]] ? c : -1;
+}
+
+// 顺序执行第i条指令: 定值使涉及该名字的复制失效, 复制指令本身生成;
+// 返回定值的名字, 没有为-1
+static int Transfer(Avail* a, const Copies* cs, const OpMap* m, Instr* in,
+                    int i) {
+  Operand* d = Instr_Def(in);
+  int j = d ? OpMap_Index(m, *d) : -1;
+  if (j < 0) return -1;
+  a->ver[j]++;
+  a->stamp[j] = a->epoch;
+  a->copy[j] = -1;
+  if (cs->at[i] >= 0) Avail_Put(a, cs, cs->at[i]);
+  return j;
+}
+
+// 块间的可用复制, 集合都是升序的复制编号
+typedef struct Flow {
+  CFG* cfg;
+  const Copies* cs;
+  Liveness* lv;
+  int *def_at, *defs;  // 块b中定值的名字为defs[def_at[b], def_at[b + 1])
+  int *gen_at, *gen;   // 块b末尾仍可用的复制, 同上
+  int** out;           // 块出口的集合, 还未求出为NULL
+  int* nout;
+  int* mark;  // 名字 -> 最近在哪个块中定值
+  // 求可能用到的复制时: 名字 -> 集合中以它为x的复制的下标, round为
+  // 第几次求, kept标记留下的下标, queue为待处理的下标
+  int *pos, *pos_round, round;
+  char* kept;
+  int* queue;
+} Flow;
+
+static int Cmp_Int(const void* a, const void* b) {
+  return *(const int*)a - *(const int*)b;
+}
+
+// 块b入口的集合: 已求出的前驱出口集合之交, 入口块和没有前驱的块为空集
+static int Meet(Flow* f, int b, int* in) {
+  const Block* blk = &f->cfg->blocks[b];
+  int n = -1;
+  if (b == 0) return 0;
+  for (int p = 0; p < blk->npred; p++) {
+    int a = blk->pred[p];
+    if (!f->out[a]) continue;
+    if (n < 0) {
+      n = f->nout[a];
+      memcpy(in, f->out[a], n * sizeof(int));
+      continue;
+    }
+    int k = 0;
+    for (int s = 0, t = 0; s < n && t < f->nout[a];) {
+      if (in[s] < f->out[a][t])
+        s++;
+      else if (in[s] > f->out[a][t])
+        t++;
+      else
+        in[k++] = in[s++], t++;
+    }
+    n = k;
+  }
+  return n < 0 ? 0 : n;
+}
+
+// 块b出口的集合: gen | (in - kill), 只留下可能用到的复制
+static int Out(Flow* f, int b, const int* in, int nin, int* out) {
+  const Copies* cs = f->cs;
+  for (int k = f->def_at[b]; k < f->def_at[b + 1]; k++)
+    f->mark[f->defs[k]] = b;
+  int n = 0, s = 0, t = f->gen_at[b];
+  while (s < nin || t < f->gen_at[b + 1]) {
+    if (t == f->gen_at[b + 1] || (s < nin && in[s] < f->gen[t])) {
+      int c = in[s++];
+      if (f->mark[cs->x[c]] != b && f->mark[cs->y[c]] != b) out[n++] = c;
+    } else
+      out[n++] = f->gen[t++];
+  }
+
+  // 从x在出口活跃的复制出发, 沿y找以它为x的复制
+  f->round++;
+  int head = 0, tail = 0;
+  for (int k = 0; k < n; k++) {
+    int x = cs->x[out[k]];
+    f->pos[x] = k;
+    f->pos_round[x] = f->round;
+    f->kept[k] = Live_Out(f->lv, b, x);
+    if (f->kept[k]) f->queue[tail++] = k;
+  }
+  while (head < tail) {
+    int y = cs->y[out[f->queue[head++]]];
+    if (f->pos_round[y] != f->round || f->kept[f->pos[y]]) continue;
+    f->kept[f->pos[y]] = 1;
+    f->queue[tail++] = f->pos[y];
+  }
+  int k = 0;
+  for (int t = 0; t < n; t++)
+    if (f->kept[t]) out[k++] = out[t];
+  return k;
+}
+static int Propagate(IRFunc* func, CFG* cfg, const OpMap* m,
+                     const char* taken) {
+  Copies cs;
+  Copies_Build(&cs, func, m, taken);
+  if (!cs.n) {
+    Copies_Free(&cs);
+    return 0;
+  }
+
+  int size = OpMap_Size(m), nb = cfg->nblock;
+  Flow f = {.cfg = cfg, .cs = &cs};
+  f.lv = Liveness_Build(cfg, m, taken);
+  f.def_at = malloc((nb + 1) * sizeof(int));
+  f.defs = malloc((func->len + 1) * sizeof(int));
+  f.gen_at = malloc((nb + 1) * sizeof(int));
+  f.gen = malloc((func->len + 1) * sizeof(int));
+  f.out = calloc(nb + 1, sizeof(int*));
+  f.nout = malloc((nb + 1) * sizeof(int));
+  f.mark = malloc((size + 1) * sizeof(int));
+  f.pos = malloc((size + 1) * sizeof(int));
+  f.pos_round = calloc(size + 1, sizeof(int));
+  f.kept = malloc(cs.n + 1);
+  f.queue = malloc((cs.n + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) f.mark[j] = -1;
+  Avail a;
+  Avail_Init(&a, size, cs.n);
+
+  // 每块定值的名字和末尾仍可用的复制
+  int nd = 0, ng = 0;
+  for (int b = 0; b < nb; b++) {
+    f.def_at[b] = nd;
+    f.gen_at[b] = ng;
+    a.epoch++;
+    for (int i = cfg->blocks[b].first; i < cfg->blocks[b].last; i++) {
+      int j = Transfer(&a, &cs, m, &func->code[i], i);
+      if (j >= 0 && f.mark[j] != b) f.mark[j] = b, f.defs[nd++] = j;
+    }
+    for (int k = f.def_at[b]; k < nd; k++) {
+      int c = Avail_Get(&a, &cs, f.defs[k]);
+      if (c >= 0) f.gen[ng++] = c;
+    }
+    qsort(f.gen + f.gen_at[b], ng - f.gen_at[b], sizeof(int), Cmp_Int);
+  }
+  f.def_at[nb] = nd;
+  f.gen_at[nb] = ng;
+
+  // 不可达的块入口为空集, 只求一次; 可达的块按逆后序迭代至不动点,
+  // 还未求出的前驱(回边)不参与交
+  int* in = malloc((cs.n + 1) * sizeof(int));
+  int* out = malloc((cs.n + 1) * sizeof(int));
+  for (int b = 0; b < nb; b++)
+    if (cfg->blocks[b].rpo < 0) {
+      f.nout[b] = Out(&f, b, in, 0, out);
+      f.out[b] = malloc((f.nout[b] + 1) * sizeof(int));
+      memcpy(f.out[b], out, f.nout[b] * sizeof(int));
+    }
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int k = 0; k < cfg->nreach; k++) {
+      int b = cfg->order[k];
+      int n = Out(&f, b, in, Meet(&f, b, in), out);
+      if (f.out[b] && n == f.nout[b] && !memcmp(out, f.out[b], n * sizeof(int)))
+        continue;
+      f.out[b] = realloc(f.out[b], (n + 1) * sizeof(int));
+      memcpy(f.out[b], out, n * sizeof(int));
+      f.nout[b] = n;
+      changed = 1;
+    }
+  }
+
+  // 改写使用, 沿复制链一直替换到源头
+  // 复制本身的y也会被改写, 而可用性是按原来的复制求的, 所以取src
+  int rewrote = 0;
+  Operand* u[2];
+  for (int b = 0; b < nb; b++) {
+    int nin = cfg->blocks[b].rpo < 0 ? 0 : Meet(&f, b, in);
+    a.epoch++;
+    for (int k = 0; k < nin; k++) Avail_Put(&a, &cs, in[k]);
+    for (int i = cfg->blocks[b].first; i < cfg->blocks[b].last; i++) {
+      Instr* ins = &func->code[i];
+      int n = Instr_Uses(ins, u);
+      for (int k = 0; k < n; k++) {
+        int j = OpMap_Index(m, *u[k]);
+        while (j >= 0 && !taken[j]) {
+          int c = Avail_Get(&a, &cs, j);
+          if (c < 0) break;
+          *u[k] = cs.src[c];
+          rewrote = 1;
+          j = OpMap_Index(m, *u[k]);
+        }
+      }
+      Transfer(&a, &cs, m, ins, i);
+    }
+  }
+
+  for (int b = 0; b < nb; b++) free(f.out[b]);
+  free(f.out);
+  free(f.nout);
+  free(f.def_at);
+  free(f.defs);
+  free(f.gen_at);
+  free(f.gen);
+  free(f.mark);
+  free(f.pos);
+  free(f.pos_round);
+  free(f.kept);
+  free(f.queue);
+  free(in);
+  free(out);
+  Liveness_Free(f.lv);
+  Avail_Free(&a);
+  Copies_Free(&cs);
+  return rewrote;
+}
+
+// 逆序扫描每个基本块, 删除定值不活跃的无副作用指令
+static int Remove_Dead(IRFunc* func, CFG* cfg, const OpMap* m,
+                       const char* taken) {
+  Liveness* lv = Liveness_Build(cfg, m, taken);
+  int size = OpMap_Size(m);
+  // seen[j] == b + 1 时 live[j] 是块b内当前的活跃性, 否则取块出口的
+  int* seen = calloc(size + 1, sizeof(int));
+  char* live = malloc(size + 1);
+  int changed = 0;
+  Operand* u[2];
+
+  for (int b = 0; b < cfg->nblock; b++)
+    for (int i = cfg->blocks[b].last - 1; i >= cfg->blocks[b].first; i--) {
+      Instr* in = &func->code[i];
+      Operand* d = Instr_Def(in);
+      int j = d ? OpMap_Index(m, *d) : -1;
+      if (j >= 0 && !taken[j]) {
+        int alive = seen[j] == b + 1 ? live[j] : Live_Out(lv, b, j);
+        if (!alive && Instr_IsPure(in)) {
+          in->op = IR_NOP;
+          changed = 1;
+          continue;
+        }
+        seen[j] = b + 1;
+        live[j] = 0;
+      }
+      int n = Instr_Uses(in, u);
+      for (int k = 0; k < n; k++) {
+        int t = OpMap_Index(m, *u[k]);
+        if (t < 0) continue;
+        seen[t] = b + 1;
+        live[t] = 1;
+      }
+    }
+
+  free(seen);
+  free(live);
+  Liveness_Free(lv);
+  return changed;
+}
+
+int Opt_Copy(IRFunc* func) {
+  if (!func->len) return 0;
+  OpMap m;
+  OpMap_Init(&m, func);
+  char* taken = Func_AddrTaken(func, &m);
+  CFG* cfg = CFG_Build(func);
+
+  int changed = Propagate(func, cfg, &m, taken);
+  changed |= Remove_Dead(func, cfg, &m, taken);
+
+  CFG_Free(cfg);
+  free(taken);
+  if (changed) IR_Compact(func);
+  return changed;
+}
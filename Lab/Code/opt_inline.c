@@ -0,0 +1,152 @@
+#include "assert.h"
+#include "callgraph.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+函数内联:
+-- Optimize按调用图自底向上处理函数, 被调用的函数先优化完, 以它当时
+   的指令数与opt_inline_limit比较, 决定是否内联进调用者
+-- 递归的函数(在调用图的环上)不内联, 也不内联进自身
+-- 被调用函数的 vN, tN 和标号都换成调用者中新的编号
+-- ARG与PARAM一一对应(最后一个ARG是第一个形参), 内联为形参 := 实参;
+   数组和结构体的实参本来就是地址, 照样赋值即可
+-- RETURN r 改为 x := r 并跳到调用之后
+*/
+
+__thread int opt_inline_limit = OPT_INLINE_LIMIT;
+
+typedef struct Inliner {
+  IRFunc* func;
+  Instr* code;  // 新的指令数组
+  int len, cap;
+  int temp, var;  // 调用者中下一个新的编号
+} Inliner;
+
+static void Put(Inliner* il, Instr in) {
+  if (il->len == il->cap) {
+    il->cap = il->cap ? 2 * il->cap : 64;
+    il->code = realloc(il->code, il->cap * sizeof(Instr));
+  }
+  il->code[il->len++] = in;
+}
+
+static int Params(const IRFunc* func) {
+  int n = 0;
+  while (n < func->len && func->code[n].op == IR_PARAM) n++;
+  return n;
+}
+
+// 第i条CALL能否内联, nargs为它前面连续的ARG数
+static const IRFunc* Inlinable(const CallGraph* cg, const IRFunc* func,
+                               const Instr* call, int nargs) {
+  int k = CallGraph_Find(cg, call->y.name);
+  if (k < 0 || cg->recursive[k]) return NULL;
+  const IRFunc* callee = cg->funcs[k];
+  if (callee == func || callee->len > opt_inline_limit ||
+      Params(callee) != nargs)
+    return NULL;
+  return callee;
+}
+
+typedef struct Rename {
+  OpMap m;
+  int temp, var;   // 新编号的起点
+  int lmin, *label;
+} Rename;
+
+static Operand Map(const Rename* rn, Operand op) {
+  switch (op.kind) {
+    case O_TEMP:
+      return OpTemp(rn->temp + op.no - rn->m.tmin);
+    case O_VAR:
+      return OpVar(rn->var + op.no - rn->m.vmin);
+    case O_LABEL:
+      return OpLabel(rn->label[op.no - rn->lmin]);
+    default:
+      return op;
+  }
+}
+
+// 展开 ARG a_n; ...; ARG a_1; x := CALL callee
+static void Expand(Inliner* il, const IRFunc* callee, const Instr* args,
+                   int nargs, Operand x) {
+  Rename rn;
+  OpMap_Init(&rn.m, callee);
+  rn.temp = il->temp;
+  rn.var = il->var;
+  il->temp += rn.m.tcnt;
+  il->var += rn.m.vcnt;
+  int lmax = -1;
+  rn.lmin = 0x7FFFFFFF;
+  for (int i = 0; i < callee->len; i++)
+    if (callee->code[i].op == IR_LABEL) {
+      if (callee->code[i].x.no < rn.lmin) rn.lmin = callee->code[i].x.no;
+      if (callee->code[i].x.no > lmax) lmax = callee->code[i].x.no;
+    }
+  rn.label = malloc((lmax >= rn.lmin ? lmax - rn.lmin + 1 : 1) * sizeof(int));
+  for (int i = 0; i < callee->len; i++)
+    if (callee->code[i].op == IR_LABEL)
+      rn.label[callee->code[i].x.no - rn.lmin] = IR_NewLabel();
+
+  for (int p = 0; p < nargs; p++)
+    Put(il, (Instr){.op = IR_ASSIGN,
+                    .x = Map(&rn, callee->code[p].x),
+                    .y = args[nargs - 1 - p].x});
+  int end = 0;
+  for (int i = nargs; i < callee->len; i++) {
+    Instr in = callee->code[i];
+    in.x = Map(&rn, in.x);
+    in.y = Map(&rn, in.y);
+    in.z = Map(&rn, in.z);
+    if (in.op != IR_RETURN) {
+      Put(il, in);
+      continue;
+    }
+    Put(il, (Instr){.op = IR_ASSIGN, .x = x, .y = in.x});
+    if (i == callee->len - 1) continue;
+    if (!end) end = IR_NewLabel();
+    Put(il, (Instr){.op = IR_GOTO, .x = OpLabel(end)});
+  }
+  if (end) Put(il, (Instr){.op = IR_LABEL, .x = OpLabel(end)});
+  free(rn.label);
+}
+
+int Opt_Inline(IRFunc* func, const CallGraph* cg) {
+  if (opt_inline_limit <= 0) return 0;
+  int n = func->len, any = 0;
+  for (int i = 0; i < n && !any; i++)
+    if (func->code[i].op == IR_CALL) {
+      int j = i;
+      while (j > 0 && func->code[j - 1].op == IR_ARG) j--;
+      any = Inlinable(cg, func, &func->code[i], i - j) != NULL;
+    }
+  if (!any) return 0;
+
+  Inliner il = {func, NULL, 0, 0};
+  OpMap m;
+  OpMap_Init(&m, func);
+  il.temp = m.tcnt ? m.tmin + m.tcnt : 1;
+  il.var = m.vcnt ? m.vmin + m.vcnt : 1;
+  for (int i = 0; i < n; i++) {
+    int j = i;
+    while (j < n && func->code[j].op == IR_ARG) j++;
+    const IRFunc* callee = NULL;
+    if (j < n && func->code[j].op == IR_CALL)
+      callee = Inlinable(cg, func, &func->code[j], j - i);
+    if (callee) {
+      Expand(&il, callee, &func->code[i], j - i, func->code[j].x);
+      i = j;
+      continue;
+    }
+    // 不内联时连同前面的ARG原样保留
+    for (; i < j; i++) Put(&il, func->code[i]);
+    if (i < n) Put(&il, func->code[i]);
+  }
+  free(func->code);
+  func->code = il.code;
+  func->len = il.len;
+  func->cap = il.cap;
+  return 1;
+}
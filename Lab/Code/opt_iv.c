@@ -0,0 +1,319 @@
+#include "assert.h"
+#include "cfg.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+归纳变量的强度削弱:
+-- 基本归纳变量: 循环内只有一处定值 i := i ± c, 或者翻译出的
+   t := i ± c; i := t (c为整型常量)
+-- 导出的归纳变量 j = a * i + b (a为常量, b循环不变): 由 k * 常量,
+   k + k, k ± 不变量 或 不变量 - k 得到, 其中k是基本归纳变量, 或者是同一块中
+   更早定值且其间i没有更新的导出归纳变量
+-- 从乘法导出的(下标乘宽度, 再加上基址等)改用新的临时变量s: 前置块中
+   按原来的运算求出初值, i每次更新后接着 s := s + a * c, 循环内的
+   定值改为 j := s, 乘法随后由复制传播和死代码删除去掉
+-- 只在j还有别的用处时才建立s; 只被其他导出变量使用的中间结果
+   只在前置块中计算一次
+-- 插入的指令登记后按位置一次性重建指令数组
+*/
+
+typedef struct IV {
+  int loop;   // 在哪个循环中是归纳变量
+  int basic;  // 所属的基本归纳变量
+  int scale;  // basic增加1时的增量
+  int step;   // 基本归纳变量每次更新的增量
+  int def;    // 定值(基本归纳变量为更新)的指令
+  int src;    // 由哪个归纳变量导出, 基本归纳变量为-1
+  int pos;    // src在定值指令中是y(0), z(1)还是两者(2)
+  int mul;    // 由乘法导出
+  int users;  // 作为其他导出变量的src被使用的次数
+  int need;   // 前置块中要求出初值
+  Operand init;  // 前置块中的初值, 建立了s时就是s
+} IV;
+
+typedef struct Strength {
+  IRFunc* func;
+  CFG* cfg;
+  const OpMap* m;
+  const char* taken;
+  int loop;
+  int *dstamp, *dcnt, *def_at;  // 名字在当前循环中的定值次数和位置
+  int* skip;  // 基本归纳变量更新中的 t, 不再作为导出变量
+  int* uses;  // 名字在函数中被使用的次数
+  IV* iv;
+  int *order, norder;  // 当前循环中的导出归纳变量, 按导出的顺序
+  int temp;            // 下一个新的临时变量
+  // 插入的指令, key为 2 * 位置 + (0: 位置之前的指令之后, 1: 前置块)
+  Instr* ins;
+  int *key, nins, cap;
+} Strength;
+
+static void Emit(Strength* st, int key, Instr in) {
+  if (st->nins == st->cap) {
+    st->cap = st->cap ? 2 * st->cap : 64;
+    st->ins = realloc(st->ins, st->cap * sizeof(Instr));
+    st->key = realloc(st->key, st->cap * sizeof(int));
+  }
+  st->ins[st->nins] = in;
+  st->key[st->nins++] = key;
+}
+
+static int Name(const Strength* st, Operand op) {
+  int j = OpMap_Index(st->m, op);
+  return j >= 0 && !st->taken[j] ? j : -1;
+}
+
+static int Defs(const Strength* st, int j) {
+  return st->dstamp[j] == st->loop ? st->dcnt[j] : 0;
+}
+
+// 循环内不变: 常量, 或者在循环内没有定值
+static int Invariant(const Strength* st, Operand op) {
+  if (op.kind == O_CONST || op.kind == O_FCONST) return 1;
+  int j = Name(st, op);
+  return j >= 0 && !Defs(st, j);
+}
+
+// i := i + c, i := c + i, i := i - c 的增量, 不是返回0
+static int Step(const Instr* in, Operand x) {
+  if (in->op == IR_ADD && Op_Equal(in->y, x) && in->z.kind == O_CONST)
+    return in->z.ival;
+  if (in->op == IR_ADD && Op_Equal(in->z, x) && in->y.kind == O_CONST)
+    return in->y.ival;
+  if (in->op == IR_SUB && Op_Equal(in->y, x) && in->z.kind == O_CONST)
+    return (int)(0u - (unsigned)in->z.ival);
+  return 0;
+}
+
+static void Find_Basic(Strength* st, int i) {
+  Instr* in = &st->func->code[i];
+  Operand* d = Instr_Def(in);
+  int j = d ? Name(st, *d) : -1;
+  if (j < 0 || Defs(st, j) != 1) return;
+  int step = Step(in, in->x), t = -1;
+  if (in->op == IR_ASSIGN && (t = Name(st, in->y)) >= 0 && Defs(st, t) == 1) {
+    int at = st->def_at[t];
+    if (at < i && st->cfg->block_of[at] == st->cfg->block_of[i])
+      step = Step(&st->func->code[at], in->x);
+  }
+  if (!step) return;
+  IV* v = &st->iv[j];
+  memset(v, 0, sizeof(IV));
+  v->loop = st->loop;
+  v->basic = j;
+  v->scale = 1;
+  v->step = step;
+  v->def = i;
+  v->src = -1;
+  v->init = in->x;
+  if (t >= 0) st->skip[t] = st->loop;
+}
+
+// 在第i条指令处能否把op当作归纳变量使用
+static int Usable(const Strength* st, Operand op, int i) {
+  int k = Name(st, op);
+  if (k < 0 || st->iv[k].loop != st->loop) return -1;
+  const IV* v = &st->iv[k];
+  if (v->src < 0) return k;
+  // 导出变量的值只在定值所在的块中, 到基本归纳变量更新为止有效
+  int upd = st->iv[v->basic].def;
+  const int* block_of = st->cfg->block_of;
+  if (block_of[v->def] != block_of[i] || v->def > i) return -1;
+  if (block_of[upd] == block_of[i] && upd > v->def && upd < i) return -1;
+  return k;
+}
+
+static void Find_Derived(Strength* st, int i) {
+  Instr* in = &st->func->code[i];
+  if (in->op != IR_ADD && in->op != IR_SUB && in->op != IR_MUL) return;
+  int j = Name(st, in->x);
+  if (j < 0 || Defs(st, j) != 1 || st->skip[j] == st->loop ||
+      st->iv[j].loop == st->loop)
+    return;
+  int ky = Usable(st, in->y, i), kz = Usable(st, in->z, i);
+  int k = -1, pos = 0;
+  unsigned scale = 0;
+  if (in->op == IR_ADD && ky >= 0 && ky == kz) {
+    // 常量折叠把 k * 2 改成了 k + k, 加法本身不必削弱
+    k = ky;
+    pos = 2;
+    scale = 2u * (unsigned)st->iv[k].scale;
+  } else if (in->op == IR_MUL) {
+    if (ky >= 0 && in->z.kind == O_CONST) {
+      k = ky;
+      scale = (unsigned)st->iv[k].scale * (unsigned)in->z.ival;
+    } else if (kz >= 0 && in->y.kind == O_CONST) {
+      k = kz;
+      pos = 1;
+      scale = (unsigned)st->iv[k].scale * (unsigned)in->y.ival;
+    }
+  } else if (ky >= 0 && Invariant(st, in->z)) {
+    k = ky;
+    scale = st->iv[k].scale;
+  } else if (kz >= 0 && Invariant(st, in->y)) {
+    k = kz;
+    pos = 1;
+    scale = st->iv[k].scale;
+    if (in->op == IR_SUB) scale = 0u - scale;
+  }
+  if (k < 0) return;
+  IV* v = &st->iv[j];
+  memset(v, 0, sizeof(IV));
+  v->loop = st->loop;
+  v->basic = st->iv[k].basic;
+  v->scale = (int)scale;
+  v->def = i;
+  v->src = k;
+  v->pos = pos;
+  v->mul = in->op == IR_MUL || st->iv[k].mul;
+  st->iv[k].users++;
+  st->order[st->norder++] = j;
+}
+
+static int Reduce_Loop(Strength* st, int l) {
+  IRFunc* func = st->func;
+  CFG* cfg = st->cfg;
+  const Loop* loop = &cfg->loops[l];
+  st->loop = l;
+  st->norder = 0;
+  for (int k = 0; k < loop->nblock; k++) {
+    const Block* blk = &cfg->blocks[loop->blocks[k]];
+    for (int i = blk->first; i < blk->last; i++) {
+      Operand* d = Instr_Def(&func->code[i]);
+      int j = d ? OpMap_Index(st->m, *d) : -1;
+      if (j < 0) continue;
+      if (st->dstamp[j] != l) {
+        st->dstamp[j] = l;
+        st->dcnt[j] = 0;
+      }
+      st->dcnt[j]++;
+      st->def_at[j] = i;
+    }
+  }
+  // 只处理最内层属于本循环的指令
+  for (int k = 0; k < loop->nblock; k++) {
+    const Block* blk = &cfg->blocks[loop->blocks[k]];
+    if (blk->loop != l) continue;
+    for (int i = blk->first; i < blk->last; i++) Find_Basic(st, i);
+  }
+  for (int k = 0; k < loop->nblock; k++) {
+    const Block* blk = &cfg->blocks[loop->blocks[k]];
+    if (blk->loop != l) continue;
+    for (int i = blk->first; i < blk->last; i++) Find_Derived(st, i);
+  }
+
+  // 需要建立s的导出变量, 以及求它们的初值要用到的
+  int nmat = 0;
+  for (int k = 0; k < st->norder; k++) {
+    int j = st->order[k];
+    if (!st->iv[j].mul || st->uses[j] <= st->iv[j].users) continue;
+    nmat++;
+    for (int a = j; a >= 0 && st->iv[a].src >= 0 && !st->iv[a].need;
+         a = st->iv[a].src)
+      st->iv[a].need = 1;
+  }
+  if (!nmat) return 0;
+
+  int pre = 2 * cfg->blocks[loop->header].first + 1;
+  int label = Loop_Redirect(func, cfg, l);
+  if (label) Emit(st, pre, (Instr){.op = IR_LABEL, .x = OpLabel(label)});
+  for (int k = 0; k < st->norder; k++) {
+    IV* v = &st->iv[st->order[k]];
+    if (!v->need) continue;
+    Instr* in = &func->code[v->def];
+    Instr c = *in;
+    v->init = c.x = OpTemp(st->temp++);
+    if (v->pos != 1) c.y = st->iv[v->src].init;
+    if (v->pos != 0) c.z = st->iv[v->src].init;
+    Emit(st, pre, c);
+    if (!v->mul || st->uses[st->order[k]] <= v->users) continue;
+    // j := s, 基本归纳变量更新后 s := s + a * c
+    in->op = IR_ASSIGN;
+    in->y = v->init;
+    in->z = OpNone();
+    int inc = (int)((unsigned)v->scale * (unsigned)st->iv[v->basic].step);
+    if (inc)
+      Emit(st, 2 * (st->iv[v->basic].def + 1),
+           (Instr){.op = IR_ADD, .x = v->init, .y = v->init, .z = OpConst(inc)});
+  }
+  return 1;
+}
+
+// 按key稳定地把登记的指令插入指令数组
+static void Apply(Strength* st) {
+  IRFunc* func = st->func;
+  int n = func->len, nkey = 2 * n + 2;
+  int* first = calloc(nkey + 1, sizeof(int));
+  int* idx = malloc((st->nins + 1) * sizeof(int));
+  for (int k = 0; k < st->nins; k++) first[st->key[k] + 1]++;
+  for (int k = 1; k <= nkey; k++) first[k] += first[k - 1];
+  for (int k = 0; k < st->nins; k++) idx[first[st->key[k]]++] = k;
+  // first[key]现在是下一个key的起点
+  Instr* code = malloc((n + st->nins + 1) * sizeof(Instr));
+  int len = 0, k = 0;
+  for (int i = 0; i <= n; i++) {
+    while (k < first[2 * i + 1]) code[len++] = st->ins[idx[k++]];
+    if (i < n) code[len++] = func->code[i];
+  }
+  assert(len == n + st->nins);
+  free(func->code);
+  func->code = code;
+  func->len = func->cap = len;
+  free(first);
+  free(idx);
+}
+
+int Opt_Iv(IRFunc* func) {
+  if (!func->len) return 0;
+  CFG* cfg = CFG_Build(func);
+  if (!cfg->nloop) {
+    CFG_Free(cfg);
+    return 0;
+  }
+  OpMap m;
+  OpMap_Init(&m, func);
+  int size = OpMap_Size(&m);
+  Strength st;
+  memset(&st, 0, sizeof(st));
+  st.func = func;
+  st.cfg = cfg;
+  st.m = &m;
+  st.taken = Func_AddrTaken(func, &m);
+  st.dstamp = malloc((size + 1) * sizeof(int));
+  st.dcnt = malloc((size + 1) * sizeof(int));
+  st.def_at = malloc((size + 1) * sizeof(int));
+  st.skip = malloc((size + 1) * sizeof(int));
+  st.uses = calloc(size + 1, sizeof(int));
+  st.iv = malloc((size + 1) * sizeof(IV));
+  st.order = malloc((size + 1) * sizeof(int));
+  st.temp = m.tcnt ? m.tmin + m.tcnt : 1;
+  for (int j = 0; j < size; j++) st.dstamp[j] = st.skip[j] = st.iv[j].loop = -1;
+  Operand* u[2];
+  for (int i = 0; i < func->len; i++) {
+    int n = Instr_Uses(&func->code[i], u);
+    for (int k = 0; k < n; k++) {
+      int j = OpMap_Index(&m, *u[k]);
+      if (j >= 0) st.uses[j]++;
+    }
+  }
+
+  int changed = 0;
+  for (int l = 0; l < cfg->nloop; l++)
+    if (Loop_Precede(func, cfg, l)) changed |= Reduce_Loop(&st, l);
+  if (changed) Apply(&st);
+
+  free((char*)st.taken);
+  free(st.dstamp);
+  free(st.dcnt);
+  free(st.def_at);
+  free(st.skip);
+  free(st.uses);
+  free(st.iv);
+  free(st.order);
+  free(st.ins);
+  free(st.key);
+  CFG_Free(cfg);
+  return changed;
+}
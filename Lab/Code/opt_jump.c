@@ -0,0 +1,231 @@
+#include "assert.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+控制流整理:
+-- 相邻的标号合并为一个, 跳转链 GOTO L1; L1: GOTO L2 直接跳到L2,
+   跳到RETURN的GOTO换成该RETURN
+-- IF c GOTO L1; GOTO L2; LABEL L1 改为 IF !c GOTO L2
+-- 删除跳到下一条的跳转, 无条件跳转之后到下一个标号之前的代码,
+   以及没有被引用的标号, 直线代码由此合并到一起
+-- 循环回边 GOTO L; L: IF c GOTO X 复制条件改为 IF c GOTO X; GOTO F
+   (X在循环之外, F为条件不成立时的下一条), 整理后每轮循环只剩一个
+   条件跳转
+*/
+
+static const int relop_not[] = {RELOP_NE, RELOP_EQ, RELOP_GE,
+                                RELOP_LE, RELOP_GT, RELOP_LT};
+
+typedef struct Labels {
+  int lmin, cnt;
+  int* where;  // 标号 -> 指令下标
+  int* next;   // 下标 -> 此后(含)第一条不是标号或IR_NOP的指令
+} Labels;
+
+static void Labels_Build(Labels* ls, const IRFunc* func) {
+  int n = func->len, lmax = -1;
+  ls->lmin = 0x7FFFFFFF;
+  for (int i = 0; i < n; i++)
+    if (func->code[i].op == IR_LABEL) {
+      if (func->code[i].x.no < ls->lmin) ls->lmin = func->code[i].x.no;
+      if (func->code[i].x.no > lmax) lmax = func->code[i].x.no;
+    }
+  ls->cnt = lmax < 0 ? 0 : lmax - ls->lmin + 1;
+  ls->where = malloc((ls->cnt + 1) * sizeof(int));
+  ls->next = malloc((n + 1) * sizeof(int));
+  for (int i = 0; i < n; i++)
+    if (func->code[i].op == IR_LABEL)
+      ls->where[func->code[i].x.no - ls->lmin] = i;
+}
+
+static void Labels_Next(Labels* ls, const IRFunc* func) {
+  int n = func->len;
+  ls->next[n] = n;
+  for (int i = n - 1; i >= 0; i--) {
+    int op = func->code[i].op;
+    ls->next[i] = op == IR_LABEL || op == IR_NOP ? ls->next[i + 1] : i;
+  }
+}
+
+static int Where(const Labels* ls, int label) {
+  return ls->where[label - ls->lmin];
+}
+
+// 第i条之后直到标号label之间没有实际的指令
+static int Falls_To(const Labels* ls, int i, int label) {
+  int w = Where(ls, label);
+  return w > i && ls->next[i + 1] > w;
+}
+
+static void Labels_Free(Labels* ls) {
+  free(ls->where);
+  free(ls->next);
+}
+
+// 合并相邻的标号并穿过跳转链
+static int Thread(IRFunc* func, Labels* ls) {
+  int n = func->len, changed = 0;
+  int* canon = malloc((ls->cnt + 1) * sizeof(int));
+  int first = -1;
+  for (int i = 0; i < n; i++) {
+    Instr* in = &func->code[i];
+    if (in->op == IR_LABEL) {
+      if (first < 0) first = in->x.no;
+      canon[in->x.no - ls->lmin] = first;
+    } else if (in->op != IR_NOP)
+      first = -1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    Instr* in = &func->code[i];
+    if (in->op != IR_GOTO && in->op != IR_IF) continue;
+    int label = canon[in->x.no - ls->lmin];
+    // 跳转链上的环(死循环)只走有限步
+    for (int hop = 0; hop < 64; hop++) {
+      const Instr* to = &func->code[ls->next[Where(ls, label)]];
+      if (ls->next[Where(ls, label)] == n || to->op != IR_GOTO) break;
+      int l = canon[to->x.no - ls->lmin];
+      if (l == label) break;
+      label = l;
+    }
+    if (label != in->x.no) {
+      in->x.no = label;
+      changed = 1;
+    }
+    int j = ls->next[Where(ls, label)];
+    if (in->op == IR_GOTO && j < n && func->code[j].op == IR_RETURN) {
+      *in = func->code[j];
+      changed = 1;
+    }
+  }
+  free(canon);
+  return changed;
+}
+
+// IF c GOTO L1; GOTO L2; LABEL L1  =>  IF !c GOTO L2
+static int Invert(IRFunc* func, Labels* ls) {
+  int n = func->len, changed = 0;
+  for (int i = 0; i < n; i++) {
+    Instr* in = &func->code[i];
+    if (in->op != IR_IF) continue;
+    int j = ls->next[i + 1];
+    if (j == n || func->code[j].op != IR_GOTO || !Falls_To(ls, j, in->x.no))
+      continue;
+    in->relop = relop_not[in->relop];
+    in->x = func->code[j].x;
+    func->code[j].op = IR_NOP;
+    changed = 1;
+  }
+  return changed;
+}
+
+// 删除跳到下一条的跳转和无条件跳转之后不可达的指令
+static int Remove_Jumps(IRFunc* func, Labels* ls) {
+  int n = func->len, changed = 0;
+  for (int i = 0; i < n; i++) {
+    Instr* in = &func->code[i];
+    if ((in->op == IR_GOTO || in->op == IR_IF) && Falls_To(ls, i, in->x.no)) {
+      in->op = IR_NOP;
+      changed = 1;
+    } else if (in->op == IR_GOTO || in->op == IR_RETURN) {
+      for (int j = i + 1; j < n && func->code[j].op != IR_LABEL; j++)
+        if (func->code[j].op != IR_NOP && func->code[j].op != IR_DEC) {
+          func->code[j].op = IR_NOP;
+          changed = 1;
+        }
+    }
+  }
+  return changed;
+}
+
+static int Remove_Labels(IRFunc* func, Labels* ls) {
+  int n = func->len, changed = 0;
+  char* used = calloc(ls->cnt + 1, 1);
+  for (int i = 0; i < n; i++) {
+    const Instr* in = &func->code[i];
+    if (in->op == IR_GOTO || in->op == IR_IF) used[in->x.no - ls->lmin] = 1;
+  }
+  for (int i = 0; i < n; i++) {
+    Instr* in = &func->code[i];
+    if (in->op == IR_LABEL && !used[in->x.no - ls->lmin]) {
+      in->op = IR_NOP;
+      changed = 1;
+    }
+  }
+  free(used);
+  return changed;
+}
+
+// 回边 GOTO L; L: IF c GOTO X  =>  IF c GOTO X; GOTO F
+static int Rotate(IRFunc* func, Labels* ls) {
+  int n = func->len, extra = 0;
+  // at[j]: 第j条前需要插入的新标号; cond[i]: 第i条GOTO要复制的IF
+  int* at = calloc(n + 1, sizeof(int));
+  int* cond = malloc((n + 1) * sizeof(int));
+  for (int i = 0; i < n; i++) {
+    cond[i] = -1;
+    Instr* in = &func->code[i];
+    if (in->op != IR_GOTO || Where(ls, in->x.no) > i) continue;
+    int j = ls->next[Where(ls, in->x.no)];
+    // 循环体为空时复制条件没有意义, 还会反复旋转
+    if (j >= i || func->code[j].op != IR_IF || ls->next[j + 1] >= i) continue;
+    // 只旋转单个条件构成的测试: 条件跳出循环(目标在[L, i]之外),
+    // 不成立时落到只有这一个前驱的循环体; 否则会产生多入口的循环
+    int x = Where(ls, func->code[j].x.no);
+    if ((x >= Where(ls, in->x.no) && x <= i) ||
+        func->code[j + 1].op == IR_LABEL)
+      continue;
+    cond[i] = j;
+    extra++;
+    if (!at[j + 1]) {
+      at[j + 1] = IR_NewLabel();
+      extra++;
+    }
+  }
+  if (!extra) {
+    free(at);
+    free(cond);
+    return 0;
+  }
+
+  Instr* code = malloc((n + extra) * sizeof(Instr));
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (at[i]) code[m++] = (Instr){.op = IR_LABEL, .x = OpLabel(at[i])};
+    if (cond[i] < 0) {
+      code[m++] = func->code[i];
+      continue;
+    }
+    int j = cond[i];
+    code[m++] = func->code[j];
+    code[m] = func->code[i];
+    code[m++].x = OpLabel(at[j + 1]);
+  }
+  free(func->code);
+  func->code = code;
+  func->len = func->cap = m;
+  free(at);
+  free(cond);
+  return 1;
+}
+
+int Opt_Jump(IRFunc* func) {
+  if (!func->len) return 0;
+  Labels ls;
+  Labels_Build(&ls, func);
+  Labels_Next(&ls, func);
+
+  int changed = Thread(func, &ls);
+  changed |= Invert(func, &ls);
+  Labels_Next(&ls, func);
+  changed |= Remove_Jumps(func, &ls);
+  changed |= Remove_Labels(func, &ls);
+  // 循环旋转只在其余整理都已完成时进行, 此时下标仍然有效
+  if (!changed) changed = Rotate(func, &ls);
+
+  Labels_Free(&ls);
+  if (changed) IR_Compact(func);
+  return changed;
+}
@@ -0,0 +1,242 @@
+#include "assert.h"
+#include "cfg.h"
+#include "liveness.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+循环不变代码外提:
+-- 无副作用的运算, 若每个运算数是常量, 在循环外定值, 或者只有一个
+   已判为不变的循环内定值, 则是循环不变的
+-- 外提到前置块还要求结果在循环内只定值一次, 在循环头不活跃, 并且
+   在它活跃的每个出口之前必然已经执行
+-- 读内存(包括直接读放在内存中的变量)只在循环中没有写内存和CALL,
+   且该指令每次进入循环都会执行时外提; 除法只在除数为常量且不是0和
+   -1时外提
+-- 每次只外提出最内层的循环, 再往外由不动点迭代的下一轮完成
+-- 前置块放在循环头之前, 从循环外跳来的改为跳到前置块; 若循环头前面
+   的块在循环内且会顺序执行下来, 则放到函数末尾, 最后跳回循环头
+*/
+
+typedef struct Licm {
+  IRFunc* func;
+  CFG* cfg;
+  Liveness* lv;
+  const OpMap* m;
+  const char* taken;
+  int loop, writes;  // 当前循环, 循环中是否写内存
+  int* mark;         // 块 -> 最近一次包含它的循环
+  int *dstamp, *dcnt, *def_at;  // 名字在当前循环中的定值次数和位置
+  int* decl;                    // 名字的DEC在哪个循环中
+  int* hoist;                   // 指令 -> 外提出的循环, 不外提为-1
+  int *exit_from, *exit_to, nexit;  // 离开循环的边, RETURN的目标为-1
+} Licm;
+
+static int Invariant(const Licm* lc, Operand op) {
+  if (op.kind != O_TEMP && op.kind != O_VAR) return 1;
+  int j = OpMap_Index(lc->m, op);
+  if (lc->dstamp[j] != lc->loop) return !lc->taken[j] || !lc->writes;
+  return lc->dcnt[j] == 1 && lc->hoist[lc->def_at[j]] == lc->loop;
+}
+
+// 块b是否在每条离开循环的路径上
+static int Always(const Licm* lc, int b) {
+  for (int e = 0; e < lc->nexit; e++)
+    if (!CFG_Dominates(lc->cfg, b, lc->exit_from[e])) return 0;
+  return lc->nexit > 0;
+}
+
+static int Can_Hoist(const Licm* lc, int i) {
+  Instr* in = &lc->func->code[i];
+  int b = lc->cfg->block_of[i];
+  if (!Instr_IsPure(in)) return 0;
+  int j = OpMap_Index(lc->m, in->x);
+  if (j < 0 || lc->taken[j] || lc->dcnt[j] != 1) return 0;
+  Operand* u[2];
+  int n = Instr_Uses(in, u);
+  switch (in->op) {
+    case IR_ADDR:
+      // 循环中的DEC每次执行都分配新的空间
+      if (lc->decl[OpMap_Index(lc->m, in->y)] == lc->loop) return 0;
+      break;
+    case IR_LOAD:
+      if (lc->writes || !Always(lc, b)) return 0;
+      break;
+    case IR_DIV:
+      if (in->z.kind == O_CONST && (in->z.ival == 0 || in->z.ival == -1))
+        return 0;
+      if (in->z.kind != O_CONST && in->z.kind != O_FCONST) return 0;
+      break;
+  }
+  for (int k = 0; k < n; k++)
+    if (!Invariant(lc, *u[k])) return 0;
+
+  // 进入循环时的值不能被覆盖, 出口处看到的值也不能变
+  if (Live_In(lc->lv, lc->cfg->loops[lc->loop].header, j)) return 0;
+  for (int e = 0; e < lc->nexit; e++)
+    if (lc->exit_to[e] >= 0 && Live_In(lc->lv, lc->exit_to[e], j) &&
+        !CFG_Dominates(lc->cfg, b, lc->exit_from[e]))
+      return 0;
+  return 1;
+}
+
+// 统计循环中的定值, DEC, 写内存和出口
+static void Scan_Loop(Licm* lc, const Loop* loop) {
+  IRFunc* func = lc->func;
+  lc->writes = lc->nexit = 0;
+  for (int k = 0; k < loop->nblock; k++) lc->mark[loop->blocks[k]] = lc->loop;
+  for (int k = 0; k < loop->nblock; k++) {
+    const Block* blk = &lc->cfg->blocks[loop->blocks[k]];
+    for (int i = blk->first; i < blk->last; i++) {
+      Instr* in = &func->code[i];
+      if (in->op == IR_STORE || in->op == IR_CALL) lc->writes = 1;
+      if (in->op == IR_DEC) lc->decl[OpMap_Index(lc->m, in->x)] = lc->loop;
+      Operand* d = Instr_Def(in);
+      int j = d ? OpMap_Index(lc->m, *d) : -1;
+      if (j < 0) continue;
+      if (lc->taken[j]) lc->writes = 1;
+      if (lc->dstamp[j] != lc->loop) {
+        lc->dstamp[j] = lc->loop;
+        lc->dcnt[j] = 0;
+      }
+      lc->dcnt[j]++;
+      lc->def_at[j] = i;
+    }
+    for (int s = 0; s < blk->nsucc; s++)
+      if (lc->mark[blk->succ[s]] != lc->loop) {
+        lc->exit_from[lc->nexit] = loop->blocks[k];
+        lc->exit_to[lc->nexit++] = blk->succ[s];
+      }
+    if (func->code[blk->last - 1].op == IR_RETURN) {
+      lc->exit_from[lc->nexit] = loop->blocks[k];
+      lc->exit_to[lc->nexit++] = -1;
+    }
+  }
+}
+
+int Opt_Licm(IRFunc* func) {
+  if (!func->len) return 0;
+  CFG* cfg = CFG_Build(func);
+  if (!cfg->nloop) {
+    CFG_Free(cfg);
+    return 0;
+  }
+  OpMap m;
+  OpMap_Init(&m, func);
+  int n = func->len, size = OpMap_Size(&m), nb = cfg->nblock;
+  Licm lc;
+  lc.func = func;
+  lc.cfg = cfg;
+  lc.m = &m;
+  lc.taken = Func_AddrTaken(func, &m);
+  lc.lv = Liveness_Build(cfg, &m, lc.taken);
+  lc.mark = malloc((nb + 1) * sizeof(int));
+  lc.dstamp = malloc((size + 1) * sizeof(int));
+  lc.decl = malloc((size + 1) * sizeof(int));
+  lc.dcnt = malloc((size + 1) * sizeof(int));
+  lc.def_at = malloc((size + 1) * sizeof(int));
+  lc.hoist = malloc((n + 1) * sizeof(int));
+  lc.exit_from = malloc((2 * nb + 1) * sizeof(int));
+  lc.exit_to = malloc((2 * nb + 1) * sizeof(int));
+  for (int b = 0; b < nb; b++) lc.mark[b] = -1;
+  for (int j = 0; j < size; j++) lc.dstamp[j] = lc.decl[j] = -1;
+  for (int i = 0; i < n; i++) lc.hoist[i] = -1;
+  // 外提的指令按判定的顺序排列, 每个循环一段
+  int* list = malloc((n + 1) * sizeof(int));
+  int* start = calloc(cfg->nloop + 2, sizeof(int));
+  int* pre_label = calloc(cfg->nloop + 1, sizeof(int));
+  char* at_end = calloc(cfg->nloop + 1, 1);
+  char* pre_at = calloc(nb + 1, 1);  // 块前面有前置块
+  int nlist = 0, extra = 0;
+  Instr* tail = &func->code[n - 1];
+  int can_append = tail->op == IR_GOTO || tail->op == IR_RETURN;
+
+  // 内层循环编号较大, 但各循环只处理最内层属于它的指令, 顺序无关
+  for (int l = 0; l < cfg->nloop; l++) {
+    const Loop* loop = &cfg->loops[l];
+    int h = loop->header;
+    start[l] = nlist;
+    lc.loop = l;
+    Scan_Loop(&lc, loop);
+    if (func->code[cfg->blocks[h].first].op != IR_LABEL) continue;
+    int here = Loop_Precede(func, cfg, l);
+    if (!here && !can_append) continue;
+
+    int more = 1;
+    while (more) {
+      more = 0;
+      for (int k = 0; k < loop->nblock; k++) {
+        const Block* blk = &cfg->blocks[loop->blocks[k]];
+        if (blk->loop != l) continue;
+        for (int i = blk->first; i < blk->last; i++)
+          if (lc.hoist[i] < 0 && Can_Hoist(&lc, i)) {
+            lc.hoist[i] = l;
+            list[nlist++] = i;
+            more = 1;
+          }
+      }
+    }
+    if (nlist == start[l]) continue;
+
+    // 循环外跳到循环头的改为跳到前置块
+    pre_label[l] = Loop_Redirect(func, cfg, l);
+    if (!here) {
+      at_end[l] = 1;
+      extra += 2;
+    } else {
+      pre_at[h] = 1;
+      extra += pre_label[l] != 0;
+    }
+  }
+  start[cfg->nloop] = nlist;
+  int changed = 0;
+
+  if (nlist) {
+    Instr* code = malloc((n + extra + 1) * sizeof(Instr));
+    int len = 0;
+    for (int i = 0; i < n; i++) {
+      int b = cfg->block_of[i];
+      if (i == cfg->blocks[b].first && pre_at[b]) {
+        int l = cfg->blocks[b].loop;
+        if (pre_label[l])
+          code[len++] = (Instr){.op = IR_LABEL, .x = OpLabel(pre_label[l])};
+        for (int k = start[l]; k < start[l + 1]; k++)
+          code[len++] = func->code[list[k]];
+      }
+      if (lc.hoist[i] < 0) code[len++] = func->code[i];
+    }
+    for (int l = 0; l < cfg->nloop; l++) {
+      if (!at_end[l]) continue;
+      code[len++] = (Instr){.op = IR_LABEL, .x = OpLabel(pre_label[l])};
+      for (int k = start[l]; k < start[l + 1]; k++)
+        code[len++] = func->code[list[k]];
+      code[len++] = (Instr){
+          .op = IR_GOTO,
+          .x = func->code[cfg->blocks[cfg->loops[l].header].first].x};
+    }
+    assert(len == n + extra);
+    free(func->code);
+    func->code = code;
+    func->len = func->cap = len;
+    changed = 1;
+  }
+
+  free((char*)lc.taken);
+  Liveness_Free(lc.lv);
+  free(lc.mark);
+  free(lc.dstamp);
+  free(lc.decl);
+  free(lc.dcnt);
+  free(lc.def_at);
+  free(lc.hoist);
+  free(lc.exit_from);
+  free(lc.exit_to);
+  free(list);
+  free(start);
+  free(pre_label);
+  free(at_end);
+  free(pre_at);
+  CFG_Free(cfg);
+  return changed;
+}
@@ -0,0 +1,256 @@
+#include "assert.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+基本块内的值编号:
+-- 每个名字, 常量和表达式(运算符 + 操作数的值编号)对应一个值编号,
+   同一块中重复的运算和取地址改为复制已有的结果
+-- 读内存 *p 的编号还带上内存的"版本": 取地址得到的指针记住所指的
+   变量(基址), 写入基址为v的指针只使v的版本失效, 基址未知的写入和
+   CALL使所有版本失效
+-- *p := y 之后的 x := *p 直接改为 x := y
+-- 放在内存中的变量每次读都是新值, 直接定值(如PARAM)算作写入
+*/
+
+typedef struct Entry {
+  int block;  // 不是当前块则为空
+  int key[4];
+  int vn;
+} Entry;
+
+typedef struct LVN {
+  const OpMap* m;
+  const char* taken;
+  int block, nvn;
+  Entry* table;
+  unsigned mask;
+  int *name_block, *name_vn;  // 名字在当前块中的值编号
+  Operand* rep;               // 值编号 -> 持有该值的名字或常量
+  int* base;                  // 值编号 -> 指向的变量, 未知为-1
+  int *epoch, epoch_any, epoch_all;
+} LVN;
+
+static int New_VN(LVN* lv, Operand rep, int base) {
+  lv->rep[lv->nvn] = rep;
+  lv->base[lv->nvn] = base;
+  return lv->nvn++;
+}
+
+static Entry* Find(LVN* lv, const int key[4]) {
+  unsigned h = 2166136261u;
+  for (int k = 0; k < 4; k++) h = (h ^ (unsigned)key[k]) * 16777619u;
+  for (h &= lv->mask;; h = (h + 1) & lv->mask) {
+    Entry* e = &lv->table[h];
+    if (e->block != lv->block || !memcmp(e->key, key, sizeof(e->key)))
+      return e;
+  }
+}
+
+static int Lookup(LVN* lv, int k0, int k1, int k2, int k3, int* vn) {
+  int key[4] = {k0, k1, k2, k3};
+  Entry* e = Find(lv, key);
+  if (e->block != lv->block) return 0;
+  *vn = e->vn;
+  return 1;
+}
+
+static void Insert(LVN* lv, int k0, int k1, int k2, int k3, int vn) {
+  int key[4] = {k0, k1, k2, k3};
+  Entry* e = Find(lv, key);
+  e->block = lv->block;
+  memcpy(e->key, key, sizeof(key));
+  e->vn = vn;
+}
+
+static int Op_VN(LVN* lv, Operand op) {
+  int vn;
+  if (op.kind == O_CONST || op.kind == O_FCONST) {
+    int bits = op.ival;  // 浮点常量按位比较
+    if (op.kind == O_FCONST) memcpy(&bits, &op.fval, sizeof(bits));
+    if (!Lookup(lv, -op.kind, bits, 0, 0, &vn)) {
+      vn = New_VN(lv, op, -1);
+      Insert(lv, -op.kind, bits, 0, 0, vn);
+    }
+    return vn;
+  }
+  int j = OpMap_Index(lv->m, op);
+  assert(j >= 0);
+  if (lv->taken[j]) return New_VN(lv, OpNone(), -1);
+  if (lv->name_block[j] != lv->block) {
+    lv->name_block[j] = lv->block;
+    lv->name_vn[j] = New_VN(lv, op, -1);
+  }
+  return lv->name_vn[j];
+}
+
+// 值编号vn现在是否还有名字(或常量)持有
+static int Rep_Valid(LVN* lv, int vn) {
+  Operand r = lv->rep[vn];
+  if (r.kind == O_CONST || r.kind == O_FCONST) return 1;
+  int j = OpMap_Index(lv->m, r);
+  return j >= 0 && !lv->taken[j] && lv->name_block[j] == lv->block &&
+         lv->name_vn[j] == vn;
+}
+
+static void Define(LVN* lv, Operand x, int vn) {
+  int j = OpMap_Index(lv->m, x);
+  if (j < 0) return;
+  if (lv->taken[j]) {
+    // 直接写内存中的变量
+    lv->epoch[j]++;
+    lv->epoch_all++;
+    return;
+  }
+  lv->name_block[j] = lv->block;
+  lv->name_vn[j] = vn;
+  if (!Rep_Valid(lv, vn)) lv->rep[vn] = x;
+}
+
+// 读内存的键: 基址已知时取该变量的版本, 否则取所有写入的计数
+static void Load_Key(LVN* lv, int p, int key[4]) {
+  int b = lv->base[p];
+  key[0] = IR_LOAD;
+  key[1] = p;
+  key[2] = b >= 0 ? lv->epoch[b] : lv->epoch_all;
+  key[3] = b >= 0 ? lv->epoch_any : -1;
+}
+
+static void Store(LVN* lv, int p) {
+  int b = p >= 0 ? lv->base[p] : -1;
+  if (b >= 0)
+    lv->epoch[b]++;
+  else
+    lv->epoch_any++;
+  lv->epoch_all++;
+}
+
+static int Number(LVN* lv, Instr* in) {
+  int changed = 0, vn;
+  switch (in->op) {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV: {
+      int a = Op_VN(lv, in->y), b = Op_VN(lv, in->z);
+      // 指针加减偏移仍指向同一个变量
+      int ba = lv->base[a], bb = lv->base[b], base = -1;
+      if ((in->op == IR_ADD || in->op == IR_SUB) && (ba >= 0) != (bb >= 0))
+        base = ba >= 0 ? ba : bb;
+      if ((in->op == IR_ADD || in->op == IR_MUL) && a > b) {
+        int t = a;
+        a = b;
+        b = t;
+      }
+      if (Lookup(lv, in->op, a, b, 0, &vn) && Rep_Valid(lv, vn)) {
+        in->op = IR_ASSIGN;
+        in->y = lv->rep[vn];
+        in->z = OpNone();
+        changed = 1;
+      } else {
+        vn = New_VN(lv, in->x, base);
+        Insert(lv, in->op, a, b, 0, vn);
+      }
+      Define(lv, in->x, vn);
+      break;
+    }
+    case IR_ADDR: {
+      int v = OpMap_Index(lv->m, in->y);
+      if (Lookup(lv, IR_ADDR, v, 0, 0, &vn) && Rep_Valid(lv, vn)) {
+        in->op = IR_ASSIGN;
+        in->y = lv->rep[vn];
+        changed = 1;
+      } else {
+        vn = New_VN(lv, in->x, v);
+        Insert(lv, IR_ADDR, v, 0, 0, vn);
+      }
+      Define(lv, in->x, vn);
+      break;
+    }
+    case IR_LOAD: {
+      int key[4];
+      Load_Key(lv, Op_VN(lv, in->y), key);
+      if (Lookup(lv, key[0], key[1], key[2], key[3], &vn) &&
+          Rep_Valid(lv, vn)) {
+        in->op = IR_ASSIGN;
+        in->y = lv->rep[vn];
+        changed = 1;
+      } else {
+        vn = New_VN(lv, in->x, -1);
+        Insert(lv, key[0], key[1], key[2], key[3], vn);
+      }
+      Define(lv, in->x, vn);
+      break;
+    }
+    case IR_STORE: {
+      int p = Op_VN(lv, in->x), y = Op_VN(lv, in->y), key[4];
+      Store(lv, p);
+      // 随后从同一地址读出的就是y
+      Load_Key(lv, p, key);
+      Insert(lv, key[0], key[1], key[2], key[3], y);
+      break;
+    }
+    case IR_ASSIGN:
+      Define(lv, in->x, Op_VN(lv, in->y));
+      break;
+    case IR_CALL:
+      // 被调用的函数可能通过传入的指针写任何地方
+      lv->epoch_any++;
+      lv->epoch_all++;
+      // fall through
+    default: {
+      Operand* d = Instr_Def(in);
+      if (d) Define(lv, *d, New_VN(lv, *d, -1));
+    }
+  }
+  return changed;
+}
+
+int Opt_Lvn(IRFunc* func) {
+  OpMap m;
+  OpMap_Init(&m, func);
+  int size = OpMap_Size(&m), n = func->len;
+  LVN lv;
+  lv.m = &m;
+  lv.taken = Func_AddrTaken(func, &m);
+  lv.block = 0;
+  lv.nvn = 0;
+  // 每条指令至多引入3个新的值编号, 散列表的装填率不超过1/2
+  unsigned cap = 64;
+  while (cap < 8u * (n + 1)) cap <<= 1;
+  lv.table = malloc(cap * sizeof(Entry));
+  for (unsigned h = 0; h < cap; h++) lv.table[h].block = -1;
+  lv.mask = cap - 1;
+  lv.name_block = malloc((size + 1) * sizeof(int));
+  lv.name_vn = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) lv.name_block[j] = -1;
+  lv.rep = malloc((3 * n + 1) * sizeof(Operand));
+  lv.base = malloc((3 * n + 1) * sizeof(int));
+  lv.epoch = calloc(size + 1, sizeof(int));
+  lv.epoch_any = lv.epoch_all = 0;
+
+  // 值编号只在块内有效, 每个块从头编号
+  int changed = 0;
+  for (int i = 0; i < n; i++) {
+    Instr* in = &func->code[i];
+    if (in->op == IR_LABEL) {
+      lv.block++;
+      lv.nvn = 0;
+    }
+    changed |= Number(&lv, in);
+    if (Instr_IsJump(in)) {
+      lv.block++;
+      lv.nvn = 0;
+    }
+  }
+
+  free((char*)lv.taken);
+  free(lv.table);
+  free(lv.name_block);
+  free(lv.name_vn);
+  free(lv.rep);
+  free(lv.base);
+  free(lv.epoch);
+  return changed;
+}
@@ -0,0 +1,114 @@
+#include "assert.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+标量变量提升(mem2reg):
+翻译时变量一律放在内存中, 赋值为 t := &v; *t := y
+若变量大小为4, 且每个 t := &v 的 t 只有这一处定值并且只用作
+*t := y 或 x := *t 的指针, 则地址不会逃逸, 改写为:
+-- *t := y  =>  v := y
+-- x := *t  =>  x := v
+-- 删除 t := &v 以及 DEC v 4
+*/
+
+// 指针位置上的临时变量若指向可提升的变量, 返回该变量
+static Operand* Promoted(const OpMap* m, Operand t, const int* defs,
+                         const char* ptr_only, Operand* addr_of,
+                         const char* promote) {
+  int j = OpMap_Index(m, t);
+  if (j < 0 || t.kind != O_TEMP || defs[j] != 1 || !ptr_only[j]) return NULL;
+  int v = OpMap_Index(m, addr_of[j]);
+  return v >= 0 && promote[v] ? &addr_of[j] : NULL;
+}
+
+int Opt_Mem2Reg(IRFunc* func) {
+  OpMap m;
+  OpMap_Init(&m, func);
+  int size = OpMap_Size(&m);
+  // 临时变量: 定值次数, 是否只用作指针, 所取地址的变量
+  int* defs = calloc(size + 1, sizeof(int));
+  char* ptr_only = malloc(size + 1);
+  Operand* addr_of = calloc(size + 1, sizeof(Operand));
+  // 变量: 能否提升
+  char* promote = malloc(size + 1);
+  memset(ptr_only, 1, size + 1);
+  memset(promote, 1, size + 1);
+  Operand* u[2];
+
+  for (int i = 0; i < func->len; i++) {
+    Instr* in = &func->code[i];
+    Operand* d = Instr_Def(in);
+    int j = d ? OpMap_Index(&m, *d) : -1;
+    if (j >= 0 && d->kind == O_TEMP) {
+      defs[j]++;
+      if (in->op == IR_ADDR)
+        addr_of[j] = in->y;
+      else
+        ptr_only[j] = 0;
+    }
+    int n = Instr_Uses(in, u);
+    for (int k = 0; k < n; k++) {
+      int t = OpMap_Index(&m, *u[k]);
+      if (t < 0 || u[k]->kind != O_TEMP) continue;
+      int as_ptr = (in->op == IR_STORE && u[k] == &in->x) ||
+                   (in->op == IR_LOAD && u[k] == &in->y);
+      // *t := t 这样既作指针又作值的也算逃逸
+      if (!as_ptr || (in->op == IR_STORE && Op_Equal(in->x, in->y)))
+        ptr_only[t] = 0;
+    }
+    if (in->op == IR_DEC && in->y.ival != 4) {
+      int v = OpMap_Index(&m, in->x);
+      if (v >= 0) promote[v] = 0;
+    }
+  }
+
+  // 地址逃逸(或取地址的临时变量被重复定值)的变量不能提升
+  for (int i = 0; i < func->len; i++) {
+    Instr* in = &func->code[i];
+    if (in->op != IR_ADDR) continue;
+    int j = OpMap_Index(&m, in->x), v = OpMap_Index(&m, in->y);
+    if (v >= 0 && (j < 0 || in->x.kind != O_TEMP || defs[j] != 1 ||
+                   !ptr_only[j]))
+      promote[v] = 0;
+  }
+
+  int changed = 0;
+  for (int i = 0; i < func->len; i++) {
+    Instr* in = &func->code[i];
+    Operand* var;
+    switch (in->op) {
+      case IR_DEC:
+      case IR_ADDR: {
+        int v = OpMap_Index(&m, in->op == IR_DEC ? in->x : in->y);
+        if (v >= 0 && promote[v]) {
+          in->op = IR_NOP;
+          changed = 1;
+        }
+        break;
+      }
+      case IR_STORE:
+        if ((var = Promoted(&m, in->x, defs, ptr_only, addr_of, promote))) {
+          in->op = IR_ASSIGN;
+          in->x = *var;
+          changed = 1;
+        }
+        break;
+      case IR_LOAD:
+        if ((var = Promoted(&m, in->y, defs, ptr_only, addr_of, promote))) {
+          in->op = IR_ASSIGN;
+          in->y = *var;
+          changed = 1;
+        }
+        break;
+    }
+  }
+
+  free(defs);
+  free(ptr_only);
+  free(addr_of);
+  free(promote);
+  if (changed) IR_Compact(func);
+  return changed;
+}
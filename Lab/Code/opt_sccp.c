@@ -0,0 +1,269 @@
+#include "assert.h"
+#include "opt.h"
+#include "ssa.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+稀疏条件常量传播(Wegman, Zadeck):
+-- 在SSA上同时求可执行的边和各版本的格值(未定/常量/变化)
+-- phi只合并来自可执行边的参数, 所以只在不可执行的路径上被改写的
+   变量(包括经过while回边的)仍是常量
+-- 之后把常量代入使用, 折叠条件跳转, 删除不可执行的块
+*/
+
+enum { TOP, CONST, BOTTOM };
+
+typedef struct Value {
+  int state;
+  Operand c;
+} Value;
+
+typedef struct SCCP {
+  SSA* ssa;
+  CFG* cfg;
+  Value* val;   // 版本 -> 格值
+  char* edge;   // 前驱表的下标 -> 该边是否可执行
+  char* exec;   // 块是否可执行
+  int *users, *user_first;  // 版本 -> 使用它的指令(>= 0)或phi(-1-p)
+  int *ework, nework;       // 有边新变为可执行的块
+  int *vwork, nvwork;       // 格值降低了的版本
+} SCCP;
+
+static Value Eval(const SCCP* sc, Operand op) {
+  Value v = {BOTTOM, op};
+  if (op.kind == O_CONST || op.kind == O_FCONST)
+    v.state = CONST;
+  else {
+    int id = SSA_Id(sc->ssa, op);
+    if (id >= 0) v = sc->val[id];
+  }
+  return v;
+}
+
+static Value Meet(Value a, Value b) {
+  if (a.state == TOP) return b;
+  if (b.state == TOP) return a;
+  if (a.state == CONST && b.state == CONST && Op_Equal(a.c, b.c)) return a;
+  a.state = BOTTOM;
+  return a;
+}
+
+static void Lower(SCCP* sc, int id, Value v) {
+  if (id < 0 || v.state == sc->val[id].state) return;
+  assert(v.state > sc->val[id].state);
+  sc->val[id] = v;
+  sc->vwork[sc->nvwork++] = id;
+}
+
+// 块from到第s个后继的边变为可执行
+static void Add_Edge(SCCP* sc, int from, int s) {
+  int b = sc->cfg->blocks[from].succ[s];
+  const Block* to = &sc->cfg->blocks[b];
+  for (int k = 0; k < to->npred; k++) {
+    int e = to->pred + k - sc->cfg->pred_buf;
+    if (to->pred[k] != from || sc->edge[e]) continue;
+    sc->edge[e] = 1;
+    sc->ework[sc->nework++] = b;
+  }
+}
+
+static void Visit_Phi(SCCP* sc, int p) {
+  const Phi* phi = &sc->ssa->phis[p];
+  const Block* b = &sc->cfg->blocks[phi->block];
+  Value v = {TOP};
+  for (int k = 0; k < Phi_NArg(sc->ssa, phi); k++) {
+    // 入口块多出的参数对应的边总是可执行的
+    if (k < b->npred && !sc->edge[b->pred + k - sc->cfg->pred_buf]) continue;
+    if (phi->arg[k] >= 0) v = Meet(v, sc->val[phi->arg[k]]);
+  }
+  Lower(sc, phi->dst, v);
+}
+
+static void Visit_Instr(SCCP* sc, int i) {
+  Instr* in = &sc->ssa->func->code[i];
+  int b = sc->cfg->block_of[i];
+  Value v = {BOTTOM}, y, z;
+  switch (in->op) {
+    case IR_ASSIGN:
+      v = Eval(sc, in->y);
+      break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+      y = Eval(sc, in->y);
+      z = Eval(sc, in->z);
+      if (y.state == BOTTOM || z.state == BOTTOM)
+        v.state = BOTTOM;
+      else if (y.state == TOP || z.state == TOP)
+        v.state = TOP;
+      else if (y.c.kind == O_CONST && z.c.kind == O_CONST &&
+               Fold_Arith(in->op, y.c.ival, z.c.ival, &v.c.ival)) {
+        v.state = CONST;
+        v.c.kind = O_CONST;
+      }
+      break;
+    case IR_IF:
+      y = Eval(sc, in->y);
+      z = Eval(sc, in->z);
+      if (y.state == TOP || z.state == TOP) return;
+      if (y.state == CONST && z.state == CONST && y.c.kind == O_CONST &&
+          z.c.kind == O_CONST) {
+        int taken = Fold_Relop(in->relop, y.c.ival, z.c.ival);
+        if (taken || sc->cfg->blocks[b].nsucc > 1) Add_Edge(sc, b, !taken);
+      } else
+        for (int s = 0; s < sc->cfg->blocks[b].nsucc; s++) Add_Edge(sc, b, s);
+      return;
+    case IR_GOTO:
+      Add_Edge(sc, b, 0);
+      return;
+  }
+  Operand* d = Instr_Def(in);
+  if (d) Lower(sc, SSA_Id(sc->ssa, *d), v);
+  // 块末尾不是跳转时顺序执行到下一块
+  if (i == sc->cfg->blocks[b].last - 1 && in->op != IR_RETURN &&
+      sc->cfg->blocks[b].nsucc)
+    Add_Edge(sc, b, 0);
+}
+
+static void Visit_Block(SCCP* sc, int b) {
+  const Block* blk = &sc->cfg->blocks[b];
+  for (int p = sc->ssa->phi_first[b]; p < sc->ssa->phi_first[b + 1]; p++)
+    Visit_Phi(sc, p);
+  if (sc->exec[b]) return;
+  sc->exec[b] = 1;
+  for (int i = blk->first; i < blk->last; i++) Visit_Instr(sc, i);
+}
+
+// 使用表: 指令中的使用和phi的参数
+static void Build_Users(SCCP* sc) {
+  SSA* ssa = sc->ssa;
+  IRFunc* func = ssa->func;
+  int* first = sc->user_first = calloc(ssa->nname + 2, sizeof(int));
+  Operand* u[2];
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < func->len; i++) {
+      int n = Instr_Uses(&func->code[i], u);
+      for (int k = 0; k < n; k++) {
+        int id = SSA_Id(ssa, *u[k]);
+        if (id < 0) continue;
+        if (pass)
+          sc->users[first[id + 1]++] = i;
+        else
+          first[id + 2]++;
+      }
+    }
+    for (int p = 0; p < ssa->nphi; p++)
+      for (int k = 0; k < Phi_NArg(ssa, &ssa->phis[p]); k++) {
+        int id = ssa->phis[p].arg[k];
+        if (id < 0) continue;
+        if (pass)
+          sc->users[first[id + 1]++] = -1 - p;
+        else
+          first[id + 2]++;
+      }
+    if (!pass) {
+      for (int id = 2; id < ssa->nname + 2; id++) first[id] += first[id - 1];
+      sc->users = malloc((first[ssa->nname + 1] + 1) * sizeof(int));
+    }
+  }
+}
+
+static void Propagate(SCCP* sc) {
+  Visit_Block(sc, 0);
+  while (sc->nework || sc->nvwork) {
+    if (sc->nework) {
+      Visit_Block(sc, sc->ework[--sc->nework]);
+      continue;
+    }
+    int id = sc->vwork[--sc->nvwork];
+    for (int k = sc->user_first[id]; k < sc->user_first[id + 1]; k++) {
+      int u = sc->users[k];
+      if (u < 0 && sc->exec[sc->ssa->phis[-1 - u].block])
+        Visit_Phi(sc, -1 - u);
+      else if (u >= 0 && sc->exec[sc->cfg->block_of[u]])
+        Visit_Instr(sc, u);
+    }
+  }
+}
+
+static int Rewrite(SCCP* sc) {
+  IRFunc* func = sc->ssa->func;
+  int changed = 0;
+  Operand* u[2];
+  for (int b = 0; b < sc->cfg->nblock; b++) {
+    const Block* blk = &sc->cfg->blocks[b];
+    for (int i = blk->first; i < blk->last; i++) {
+      Instr* in = &func->code[i];
+      if (!sc->exec[b]) {
+        if (in->op != IR_DEC && in->op != IR_NOP) {
+          in->op = IR_NOP;
+          changed = 1;
+        }
+        continue;
+      }
+      // 代入常量, 指针位置除外
+      int n = in->op == IR_LOAD ? 0 : Instr_Uses(in, u);
+      for (int k = 0; k < n; k++) {
+        if (in->op == IR_STORE && u[k] == &in->x) continue;
+        Value v = Eval(sc, *u[k]);
+        if (v.state == CONST && SSA_Id(sc->ssa, *u[k]) >= 0) {
+          *u[k] = v.c;
+          changed = 1;
+        }
+      }
+      Value v = Eval(sc, in->x);
+      if (Instr_IsPure(in) && SSA_Id(sc->ssa, in->x) >= 0 &&
+          v.state == CONST && (in->op != IR_ASSIGN || !Op_Equal(in->y, v.c))) {
+        in->op = IR_ASSIGN;
+        in->y = v.c;
+        in->z = OpNone();
+        changed = 1;
+      }
+      if (in->op == IR_IF && in->y.kind == O_CONST && in->z.kind == O_CONST) {
+        if (Fold_Relop(in->relop, in->y.ival, in->z.ival)) {
+          in->op = IR_GOTO;
+          in->y = in->z = OpNone();
+        } else
+          in->op = IR_NOP;
+        changed = 1;
+      }
+    }
+  }
+  return changed;
+}
+
+int Opt_Sccp(IRFunc* func) {
+  if (!func->len) return 0;
+  SCCP sc;
+  sc.ssa = SSA_Build(func);
+  sc.cfg = sc.ssa->cfg;
+  int nname = sc.ssa->nname, nb = sc.cfg->nblock;
+  int nedge = sc.cfg->blocks[nb - 1].pred + sc.cfg->blocks[nb - 1].npred -
+              sc.cfg->pred_buf;
+  sc.val = malloc((nname + 1) * sizeof(Value));
+  // 入口处的值未知, 其余版本从"未定"开始
+  for (int id = 0; id < nname; id++)
+    sc.val[id].state = sc.ssa->def[id] == -1 ? BOTTOM : TOP;
+  sc.edge = calloc(nedge + 1, 1);
+  sc.exec = calloc(nb + 1, 1);
+  sc.ework = malloc((nedge + 1) * sizeof(int));
+  sc.vwork = malloc((2 * nname + 1) * sizeof(int));
+  sc.nework = sc.nvwork = 0;
+  Build_Users(&sc);
+
+  Propagate(&sc);
+  int changed = Rewrite(&sc);
+
+  free(sc.val);
+  free(sc.edge);
+  free(sc.exec);
+  free(sc.ework);
+  free(sc.vwork);
+  free(sc.users);
+  free(sc.user_first);
+  SSA_Destruct(sc.ssa);
+  if (changed) IR_Compact(func);
+  return changed;
+}
@@ -0,0 +1,80 @@
+#include "assert.h"
+#include "cfg.h"
+#include "liveness.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+
+/*
+临时变量的槽位复用, 在所有优化之后对每个函数做一次:
+-- 不在内存中的临时变量和变量按活跃区间分配槽位, 区间不重叠的共用
+   一个槽位, 槽位在函数内从t1起编号
+-- 活跃区间见Live_Intervals, 同一条指令中最后一次使用的名字和新定值
+   的名字可以共用槽位; 形参的区间都从函数开头算起, 互不共用
+-- 放在内存中的变量(DEC, 取过地址)不共用, 在函数内从v1起重新编号
+*/
+
+int Opt_Slot(IRFunc* func) {
+  if (!func->len) return 0;
+  OpMap m;
+  OpMap_Init(&m, func);
+  int size = OpMap_Size(&m), n = func->len, npos = 2 * n + 2;
+  if (!size) return 0;
+  char* taken = Func_AddrTaken(func, &m);
+  CFG* cfg = CFG_Build(func);
+  Liveness* lv = Liveness_Build(cfg, &m, taken);
+
+  int* lo = malloc((size + 1) * sizeof(int));
+  int* hi = malloc((size + 1) * sizeof(int));
+  Live_Intervals(lv, lo, hi);
+
+  // 按区间起点扫描, 终点已过的槽位放回空闲栈
+  int* start = malloc((npos + 1) * sizeof(int));  // 起点的链表
+  int* stop = malloc((npos + 1) * sizeof(int));   // 终点的链表
+  int* snext = malloc((size + 1) * sizeof(int));
+  int* enext = malloc((size + 1) * sizeof(int));
+  for (int p = 0; p <= npos; p++) start[p] = stop[p] = -1;
+  for (int j = size - 1; j >= 0; j--) {
+    if (hi[j] < 0 || taken[j]) continue;
+    snext[j] = start[lo[j]], start[lo[j]] = j;
+    enext[j] = stop[hi[j]], stop[hi[j]] = j;
+  }
+  Operand* ren = malloc((size + 1) * sizeof(Operand));
+  int* slot = malloc((size + 1) * sizeof(int));
+  int* free_slots = malloc((size + 1) * sizeof(int));
+  int nfree = 0, nslot = 0, nvar = 0;
+  for (int j = 0; j < size; j++) ren[j] = OpNone();
+  for (int p = 0; p <= npos; p++) {
+    if (p > 0)
+      for (int j = stop[p - 1]; j >= 0; j = enext[j])
+        free_slots[nfree++] = slot[j];
+    for (int j = start[p]; j >= 0; j = snext[j]) {
+      slot[j] = nfree ? free_slots[--nfree] : ++nslot;
+      ren[j] = OpTemp(slot[j]);
+    }
+  }
+  // 内存中的变量按出现顺序编号
+  for (int i = 0; i < n; i++) {
+    Operand* ops = &func->code[i].x;
+    for (int t = 0; t < 3; t++) {
+      int j = OpMap_Index(&m, ops[t]);
+      if (j < 0) continue;
+      if (ren[j].kind == O_NONE) ren[j] = OpVar(++nvar);
+      ops[t] = ren[j];
+    }
+  }
+
+  free(start);
+  free(stop);
+  free(snext);
+  free(enext);
+  free(ren);
+  free(slot);
+  free(free_slots);
+  free(lo);
+  free(hi);
+  free(taken);
+  Liveness_Free(lv);
+  CFG_Free(cfg);
+  return 1;
+}
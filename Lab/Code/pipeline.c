@@ -0,0 +1,82 @@
+#include "pipeline.h"
+
+#include "arena.h"
+#include "compiler.h"
+#include "lexical_syntax.h"
+#include "pthread.h"
+
+typedef struct Item {
+  struct ast* extdef;  // NULL表示分析结束
+  Arena blocks;        // 随extdef移交的结点
+} Item;
+
+struct Pipeline {
+  Compiler* c;
+  Pipeline_Stage stage;
+  void* arg;
+  // 环形队列
+  Item items[PIPELINE_DEPTH];
+  int head, count;
+  pthread_mutex_t lock;
+  pthread_cond_t nonempty, nonfull;
+};
+
+static void Put(Pipeline* p, Item* item) {
+  pthread_mutex_lock(&p->lock);
+  while (p->count == PIPELINE_DEPTH) pthread_cond_wait(&p->nonfull, &p->lock);
+  p->items[(p->head + p->count) % PIPELINE_DEPTH] = *item;
+  p->count++;
+  pthread_cond_signal(&p->nonempty);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void Take(Pipeline* p, Item* item) {
+  pthread_mutex_lock(&p->lock);
+  while (p->count == 0) pthread_cond_wait(&p->nonempty, &p->lock);
+  *item = p->items[p->head];
+  p->head = (p->head + 1) % PIPELINE_DEPTH;
+  p->count--;
+  pthread_cond_signal(&p->nonfull);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void* Translator(void* arg) {
+  Pipeline* p = arg;
+  ctx = p->c;
+  for (;;) {
+    Item item;
+    Take(p, &item);
+    if (!item.extdef) break;
+    p->stage(item.extdef, p->arg);
+    Arena_Release(&item.blocks);
+  }
+  return NULL;
+}
+
+void Pipeline_Push(Pipeline* p, struct ast* extdef, int detach) {
+  if (ctx->error_type) return;
+  Item item = {.extdef = extdef};
+  // 否则向前看符号的结点也在块中, 这些块留到下一个ExtDef一起移交
+  if (detach) Arena_Detach(&ctx->ast_arena, &item.blocks);
+  Put(p, &item);
+}
+
+void Pipeline_Run(FILE* fp, Pipeline_Stage stage, void* arg) {
+  Pipeline p = {.c = ctx, .stage = stage, .arg = arg};
+  pthread_mutex_init(&p.lock, NULL);
+  pthread_cond_init(&p.nonempty, NULL);
+  pthread_cond_init(&p.nonfull, NULL);
+  pthread_t thread;
+  pthread_create(&thread, NULL, Translator, &p);
+
+  ctx->pipeline = &p;
+  build_syntax_tree(fp);
+  ctx->pipeline = NULL;
+  Item end = {.extdef = NULL};
+  Put(&p, &end);
+  pthread_join(thread, NULL);
+
+  pthread_mutex_destroy(&p.lock);
+  pthread_cond_destroy(&p.nonempty);
+  pthread_cond_destroy(&p.nonfull);
+}
@@ -0,0 +1,31 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "stdio.h"
+
+/*
+流水线: 边分析边翻译
+-- 当前线程做词法, 语法分析, 每归约出一个ExtDef就放进有界队列,
+   不再等整棵语法树建好
+-- 第二个线程按顺序取出ExtDef交给stage翻译, 然后释放它的结点; 内存
+   只与队列长度和最大的ExtDef有关
+-- 两个线程共用当前的编译上下文: 分析只用扫描器, 语法树区域和驻留表,
+   翻译只用符号表和中间代码, 互不相交; 结点经队列的锁对翻译线程可见
+-- 出现词法, 语法错误后不再翻译, 已翻译的部分不撤销
+*/
+
+#define PIPELINE_DEPTH 16  // 队列中最多的ExtDef数
+
+typedef struct Pipeline Pipeline;
+struct ast;
+
+// 在翻译线程中对每个ExtDef调用
+typedef void (*Pipeline_Stage)(struct ast* extdef, void* arg);
+
+// 分析fp, 每个ExtDef由翻译线程调用stage(extdef, arg); 全部翻译完才返回
+extern void Pipeline_Run(FILE* fp, Pipeline_Stage stage, void* arg);
+// 分析器归约出extdef时调用; detach为1时, 语法树区域中已分配的块都属于
+// 已放入的ExtDef, 随extdef移交, 翻译后释放
+extern void Pipeline_Push(Pipeline* p, struct ast* extdef, int detach);
+
+#endif
@@ -0,0 +1,102 @@
+#include "regalloc.h"
+
+#include "assert.h"
+#include "cfg.h"
+#include "liveness.h"
+#include "stdlib.h"
+#include "string.h"
+
+// 按循环深度加权的出现次数, 每深一层乘10
+static double* Weights(const CFG* cfg, const OpMap* m) {
+  IRFunc* func = cfg->func;
+  double* weight = calloc(OpMap_Size(m) + 1, sizeof(double));
+  for (int b = 0; b < cfg->nblock; b++) {
+    const Block* blk = &cfg->blocks[b];
+    double w = 1;
+    for (int d = blk->loop >= 0 ? cfg->loops[blk->loop].depth : 0; d > 0; d--)
+      w *= 10;
+    for (int i = blk->first; i < blk->last; i++) {
+      const Operand* ops = &func->code[i].x;
+      for (int t = 0; t < 3; t++) {
+        int j = OpMap_Index(m, ops[t]);
+        if (j >= 0) weight[j] += w;
+      }
+    }
+  }
+  return weight;
+}
+
+// 定值位置p的指令若是 x := y [op z], 返回y的下标
+static int Hint(const IRFunc* func, const OpMap* m, int p) {
+  if (!(p & 1)) return -1;
+  const Instr* in = &func->code[p / 2];
+  switch (in->op) {
+    case IR_ASSIGN:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+      return OpMap_Index(m, in->y);
+    default:
+      return -1;
+  }
+}
+
+int* RegAlloc_Linear(IRFunc* func, const OpMap* m, const char* taken,
+                     int nreg) {
+  int size = OpMap_Size(m), npos = 2 * func->len + 2;
+  int* home = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) home[j] = -1;
+  if (!func->len || !size) return home;
+
+  CFG* cfg = CFG_Build(func);
+  Liveness* lv = Liveness_Build(cfg, m, taken);
+  int* lo = malloc((size + 1) * sizeof(int));
+  int* hi = malloc((size + 1) * sizeof(int));
+  Live_Intervals(lv, lo, hi);
+  double* weight = Weights(cfg, m);
+
+  // 起点的链表
+  int* start = malloc((npos + 1) * sizeof(int));
+  int* next = malloc((size + 1) * sizeof(int));
+  for (int p = 0; p <= npos; p++) start[p] = -1;
+  for (int j = size - 1; j >= 0; j--)
+    if (hi[j] >= 0 && !taken[j]) next[j] = start[lo[j]], start[lo[j]] = j;
+
+  int* owner = malloc((nreg + 1) * sizeof(int));  // 寄存器 -> 名字
+  for (int r = 0; r < nreg; r++) owner[r] = -1;
+  for (int p = 0; p <= npos; p++) {
+    if (start[p] < 0) continue;
+    for (int r = 0; r < nreg; r++)
+      if (owner[r] >= 0 && hi[owner[r]] < p) owner[r] = -1;
+    for (int j = start[p]; j >= 0; j = next[j]) {
+      int r = -1, y = Hint(func, m, p);
+      if (y >= 0 && home[y] >= 0 && owner[home[y]] < 0) r = home[y];
+      for (int k = 0; k < nreg && r < 0; k++)
+        if (owner[k] < 0) r = k;
+      if (r < 0) {
+        // 溢出最不常用的, 一样时溢出结束得晚的
+        int victim = j;
+        for (int k = 0; k < nreg; k++) {
+          int o = owner[k];
+          if (weight[o] < weight[victim] ||
+              (weight[o] == weight[victim] && hi[o] > hi[victim]))
+            victim = o, r = k;
+        }
+        if (victim == j) continue;
+        home[victim] = -1;
+      }
+      owner[r] = j;
+      home[j] = r;
+    }
+  }
+
+  free(owner);
+  free(start);
+  free(next);
+  free(weight);
+  free(lo);
+  free(hi);
+  Liveness_Free(lv);
+  CFG_Free(cfg);
+  return home;
+}
@@ -0,0 +1,21 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ir.h"
+#include "opt.h"
+
+/*
+线性扫描寄存器分配:
+-- 活跃区间见Live_Intervals, 放在内存中的名字不分配
+-- 按起点的顺序扫描, 终点已过的区间释放寄存器
+-- x := y 或 x := y op z 中y的区间在这里结束时, x优先用y的寄存器,
+   省去一次传送
+-- 没有空闲的寄存器时, 在当前区间和占着寄存器的区间中溢出按循环深度
+   加权的出现次数最少的一个, 溢出的名字整个区间都在内存中
+*/
+
+// 返回 名字 -> 寄存器编号[0, nreg), 溢出的为-1
+extern int* RegAlloc_Linear(IRFunc* func, const OpMap* m, const char* taken,
+                            int nreg);
+
+#endif
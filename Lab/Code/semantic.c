@@ -1,38 +1,46 @@
 #include "semantic.h"
 
 #include "assert.h"
+#include "compiler.h"
+#include "intern.h"
+#include "ir.h"
+#include "stdarg.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
 
-#define translate_printf printf
+int new_vtemp() { return ++ctx->vtemp; }
 
-int new_vtemp() {
-  static int vtemp = 0;
-  return ++vtemp;
-}
-
-int new_temp() {
-  static int temp = 0;
-  return ++temp;
-}
+int new_temp() { return ++ctx->temp; }
 
-int new_label() {
-  static int label = 0;
-  return ++label;
-}
+int new_label() { return ++ctx->label; }
 
 const Type INT = {.tkind = T_INT, .left_val = 0, .type_size = 4};
 const Type FLOAT = {.tkind = T_FLOAT, .left_val = 0, .type_size = 4};
+// 出错的表达式的类型, 外层表达式见到它不再重复报错
+static const Type WRONG = {.tkind = T_WRONG};
 static Type* LType_INT();
 static Type* LType_FLOAT();
 static Type* LType_UKST();
+static int Args_Fit(struct ast* node, FieldList* fl);
+
+// 翻译时遇到的语义错误: 输出到diag, 编译失败但继续翻译以报告后面的错误
+static const Type* Semantic_Error(int type, int lineno, const char* fmt,
+                                  ...) {
+  fprintf(ctx->diag, "Error type %d at Line %d: ", type, lineno);
+  va_list v;
+  va_start(v, fmt);
+  vfprintf(ctx->diag, fmt, v);
+  va_end(v);
+  fprintf(ctx->diag, ".\n");
+  ctx->sem_error = 1;
+  return &WRONG;
+}
 
 void Program(struct ast* node) {
-  // 初始化全局符号表
-  Symtab_Init();
+  eval_semantic_begin();
   ExtDefList(node->children[0]);
-  Symtab_Uninit();
+  eval_semantic_end();
 }
 
 void ExtDefList(struct ast* node) {
@@ -53,10 +61,10 @@ void ExtDef(struct ast* node) {
   // type == NULL: 结构体的定义冲突
   if (!type) return;
 
-  if (!strcmp(node->children[1]->name, "ExtDecList")) {
+  if (node->kind == N_EXTDEF_VAR) {
     // ExtDef -> Specifier . ExtDecList SEMI
     ExtDecList(node->children[1], type);
-  } else if (!strcmp(node->children[1]->name, "SEMI")) {
+  } else if (node->kind == N_EXTDEF_STRUCT) {
     // ExtDef -> Specifier . SEMI
   } else {
     // ExtDef -> Specifier . FunDec SEMI
@@ -65,7 +73,7 @@ void ExtDef(struct ast* node) {
 
     func->pfunc->rtype = type;
 
-    if (!strcmp(node->children[2]->name, "SEMI")) {
+    if (node->kind == N_EXTDEF_FUNDEC) {
       // ExtDef -> Specifier FunDec . SEMI
       func->pfunc->fdec_kind = F_DECLARATION;
       Insert_Symtab(func);
@@ -74,20 +82,18 @@ void ExtDef(struct ast* node) {
       func->pfunc->fdec_kind = F_DEFINITION;
       Insert_Symtab(func);
 
-      translate_printf("FUNCTION %s :\n", func->sbname);
+      IR_NewFunc(func->sbname);
       FieldList* fl = func->pfunc->params;
       while (fl) {
         fl->sym->pvar->vname = new_vtemp();
         fl->sym->pvar->isParam = 1;
-        translate_printf("PARAM v%d\n", fl->sym->pvar->vname);
+        IR_Emit1(IR_PARAM, OpVar(fl->sym->pvar->vname));
         fl = fl->next;
       }
 
       FunDecDotCompSt(func);
       CompSt(node->children[2], type);
       FunDecCompStDot(NULL);
-
-      translate_printf("\n");
     }
   }
 }
@@ -108,9 +114,9 @@ void ExtDecList(struct ast* node, const Type* type) {
 }
 
 const Type* Specifier(struct ast* node) {
-  if (!strcmp(node->children[0]->name, "TYPE")) {
+  if (node->kind == N_SPECIFIER_TYPE) {
     // Specifier -> TYPE
-    if (!strcmp(node->children[0]->id_name, "int"))
+    if (node->children[0]->id_name == ctx->name_int)
       return &INT;
     else
       return &FLOAT;
@@ -120,17 +126,17 @@ const Type* Specifier(struct ast* node) {
 }
 
 const Type* StructSpecifier(struct ast* node) {
-  char stname[MAX_NAME_LEN];
-  if (!strcmp(node->children[1]->name, "OptTag")) {
+  const char* stname;
+  if (node->kind == N_STRUCTSPECIFIER_DEF) {
     // StructSpecifier -> STRUCT OptTag LC DefList RC
-    OptTag(node->children[1], stname);
+    stname = OptTag(node->children[1]);
 
     // 符号定义素质五连
-    Symbol* st = malloc(sizeof(Symbol));
-    strcpy(st->sbname, stname);
+    Symbol* st = Arena_Alloc(&ctx->sym_arena, sizeof(Symbol));
+    st->sbname = stname;
     st->skind = S_STRUCTNAME;
     st->dec_lineno = node->lineno;
-    st->pstruct = malloc(sizeof(StructName));
+    st->pstruct = Arena_Alloc(&ctx->sym_arena, sizeof(StructName));
 
     st->pstruct->stdec_kind = ST_UNDEFINED;
 
@@ -144,7 +150,7 @@ const Type* StructSpecifier(struct ast* node) {
     return BuildStructure(st->pstruct->this_symtab, stname);
   } else {
     // StructSpecifier -> STRUCT Tag
-    Tag(node->children[1], stname);
+    stname = Tag(node->children[1]);
 
     Symbol* st = Query_Symtab(stname);
     if (!st || st->skind != S_STRUCTNAME ||
@@ -155,29 +161,31 @@ const Type* StructSpecifier(struct ast* node) {
   }
 }
 
-void OptTag(struct ast* node, char* ans_name) {
-  static int unname_cnt = 0;
+const char* OptTag(struct ast* node) {
   if (node->num != -1)
     // OptTag -> ID
-    ID(node->children[0], ans_name);
+    return ID(node->children[0]);
   else {
     // OptTag -> empty
-    sprintf(ans_name, "unname(%d)", unname_cnt++);
+    // 名字各不相同, 不必驻留; 流水线模式下驻留表只由分析线程使用
+    char ans_name[32];
+    sprintf(ans_name, "unname(%d)", ctx->unname_cnt++);
+    return Arena_Strdup(&ctx->sym_arena, ans_name);
   }
 }
 
-void Tag(struct ast* node, char* ans_name) {
+const char* Tag(struct ast* node) {
   // Tag -> ID
-  ID(node->children[0], ans_name);
+  return ID(node->children[0]);
 }
 
 Symbol* FunDec(struct ast* node) {
   // 符号定义素质五连
-  Symbol* func = malloc(sizeof(Symbol));
-  ID(node->children[0], func->sbname);
+  Symbol* func = Arena_Alloc(&ctx->sym_arena, sizeof(Symbol));
+  func->sbname = ID(node->children[0]);
   func->skind = S_FUNCTIONNAME;
   func->dec_lineno = node->lineno;
-  func->pfunc = malloc(sizeof(FuncName));
+  func->pfunc = Arena_Alloc(&ctx->sym_arena, sizeof(FuncName));
 
   FunDecLP();
   if (node->num == 4) {
@@ -254,8 +262,8 @@ void Dec(struct ast* node, const Type* type) {
     if (!Symtab_mode()) {
       sb->pvar->vname = new_vtemp();
       sb->pvar->isParam = 0;
-      translate_printf("DEC v%d %d\n", sb->pvar->vname,
-                       sb->pvar->vtype->type_size);
+      IR_Emit2(IR_DEC, OpVar(sb->pvar->vname),
+               OpConst(sb->pvar->vtype->type_size));
     }
   } else {
     // Dec -> VarDec ASSIGNOP Exp
@@ -264,13 +272,13 @@ void Dec(struct ast* node, const Type* type) {
     if (!Symtab_mode()) {
       sb->pvar->vname = new_vtemp();
       sb->pvar->isParam = 0;
-      translate_printf("DEC v%d %d\n", sb->pvar->vname,
-                       sb->pvar->vtype->type_size);
+      IR_Emit2(IR_DEC, OpVar(sb->pvar->vname),
+               OpConst(sb->pvar->vtype->type_size));
       int t1 = new_temp();
       int t2 = new_temp();
       Exp(node->children[0], t1, LEFT);
       Exp(node->children[2], t2, RIGHT);
-      translate_printf("*t%d := t%d\n", t1, t2);
+      IR_Emit2(IR_STORE, OpTemp(t1), OpTemp(t2));
     }
   }
 }
@@ -285,7 +293,7 @@ const Symbol* VarDec(struct ast* node, const Type* type) {
   Type* arr = NULL;
   while (node->num == 4) {
     int size = node->children[2]->int_value;
-    arr = malloc(sizeof(Type));
+    arr = Arena_Alloc(&ctx->sym_arena, sizeof(Type));
     arr->tkind = T_ARRAY;
     arr->left_val = 1;
     arr->array.type = type;
@@ -297,15 +305,12 @@ const Symbol* VarDec(struct ast* node, const Type* type) {
   }
 
   // VarDec -> ID
-  char vname[MAX_NAME_LEN];
-  ID(node->children[0], vname);
-
   // 符号定义素质五连
-  Symbol* sb = malloc(sizeof(Symbol));
-  strcpy(sb->sbname, vname);
+  Symbol* sb = Arena_Alloc(&ctx->sym_arena, sizeof(Symbol));
+  sb->sbname = ID(node->children[0]);
   sb->skind = S_VARIABLE;
   sb->dec_lineno = node->lineno;
-  sb->pvar = malloc(sizeof(Var));
+  sb->pvar = Arena_Alloc(&ctx->sym_arena, sizeof(Var));
 
   sb->pvar->vtype = type;
   Insert_Symtab(sb);
@@ -324,84 +329,93 @@ void StmtList(struct ast* node, const Type* ret_type) {
 }
 
 void Stmt(struct ast* node, const Type* ret_type) {
-  if (!strcmp(node->children[0]->name, "Exp")) {
-    // Stmt -> Exp SEMI
-    int t1 = new_temp();
-    Exp(node->children[0], t1, RIGHT);
-  } else if (!strcmp(node->children[0]->name, "CompSt")) {
-    DotCompSt();
-    CompSt(node->children[0], ret_type);
-    CompStDot();
-  } else if (!strcmp(node->children[0]->name, "RETURN")) {
-    // Stmt -> RETURN Exp SEMI
-    // 判断RETURN的类型和函数是否相容
-    int t1 = new_temp();
-    Exp(node->children[1], t1, RIGHT);
-    translate_printf("RETURN t%d\n", t1);
-  } else if (!strcmp(node->children[0]->name, "IF")) {
-    if (node->num == 5) {
+  switch (node->kind) {
+    case N_STMT_EXP: {
+      // Stmt -> Exp SEMI
+      int t1 = new_temp();
+      Exp(node->children[0], t1, RIGHT);
+      break;
+    }
+    case N_STMT_COMPST:
+      DotCompSt();
+      CompSt(node->children[0], ret_type);
+      CompStDot();
+      break;
+    case N_STMT_RETURN: {
+      // Stmt -> RETURN Exp SEMI
+      // 判断RETURN的类型和函数是否相容
+      int t1 = new_temp();
+      Exp(node->children[1], t1, RIGHT);
+      IR_Emit1(IR_RETURN, OpTemp(t1));
+      break;
+    }
+    case N_STMT_IF: {
       // Stmt -> IF LP Exp RP Stmt
       int l1 = new_label();
       int l2 = new_label();
       Cond(node->children[2], l1, l2);
-      translate_printf("LABEL label%d :\n", l1);
+      IR_Emit1(IR_LABEL, OpLabel(l1));
       Stmt(node->children[4], ret_type);
-      translate_printf("LABEL label%d :\n", l2);
-    } else if (node->num == 7) {
+      IR_Emit1(IR_LABEL, OpLabel(l2));
+      break;
+    }
+    case N_STMT_IFELSE: {
       // Stmt -> IF LP Exp RP Stmt ELSE Stmt
       int l1 = new_label();
       int l2 = new_label();
       int l3 = new_label();
       Cond(node->children[2], l1, l2);
-      translate_printf("LABEL label%d :\n", l1);
+      IR_Emit1(IR_LABEL, OpLabel(l1));
       Stmt(node->children[4], ret_type);
-      translate_printf("GOTO label%d\n", l3);
-      translate_printf("LABEL label%d :\n", l2);
+      IR_Emit1(IR_GOTO, OpLabel(l3));
+      IR_Emit1(IR_LABEL, OpLabel(l2));
       Stmt(node->children[6], ret_type);
-      translate_printf("LABEL label%d :\n", l3);
+      IR_Emit1(IR_LABEL, OpLabel(l3));
+      break;
     }
-  } else if (!strcmp(node->children[0]->name, "WHILE")) {
-    // Stmt -> WHILE LP Exp RP Stmt
-    int l1 = new_label();
-    int l2 = new_label();
-    int l3 = new_label();
-    translate_printf("LABEL label%d :\n", l1);
-    Cond(node->children[2], l2, l3);
-    translate_printf("LABEL label%d :\n", l2);
-    Stmt(node->children[4], ret_type);
-    translate_printf("GOTO label%d\n", l1);
-    translate_printf("LABEL label%d :\n", l3);
-  } else {
-    assert(0);
+    case N_STMT_WHILE: {
+      // Stmt -> WHILE LP Exp RP Stmt
+      int l1 = new_label();
+      int l2 = new_label();
+      int l3 = new_label();
+      IR_Emit1(IR_LABEL, OpLabel(l1));
+      Cond(node->children[2], l2, l3);
+      IR_Emit1(IR_LABEL, OpLabel(l2));
+      Stmt(node->children[4], ret_type);
+      IR_Emit1(IR_GOTO, OpLabel(l1));
+      IR_Emit1(IR_LABEL, OpLabel(l3));
+      break;
+    }
+    default:
+      assert(0);
   }
 }
 
 void Cond(struct ast* node, int ltrue, int lfalse) {
-  if (node->num == 2) {
-    if (!strcmp(node->children[0]->name, "NOT")) {
+  switch (node->kind) {
+    case N_EXP_NOT:
       Cond(node->children[1], lfalse, ltrue);
       return;
-    }
-  } else if (node->num == 3) {
-    if (!strcmp(node->children[1]->name, "RELOP")) {
+    case N_EXP_RELOP: {
       int t1 = new_temp();
       int t2 = new_temp();
       Exp(node->children[0], t1, RIGHT);
       Exp(node->children[2], t2, RIGHT);
-      translate_printf("IF t%d %s t%d GOTO label%d\n", t1,
-                       node->children[1]->id_name, t2, ltrue);
-      translate_printf("GOTO label%d\n", lfalse);
+      IR_EmitIf(node->children[1]->int_value, OpTemp(t1), OpTemp(t2), ltrue);
+      IR_Emit1(IR_GOTO, OpLabel(lfalse));
       return;
-    } else if (!strcmp(node->children[1]->name, "AND")) {
+    }
+    case N_EXP_AND: {
       int l1 = new_label();
       Cond(node->children[0], l1, lfalse);
-      translate_printf("LABEL label%d :\n", l1);
+      IR_Emit1(IR_LABEL, OpLabel(l1));
       Cond(node->children[2], ltrue, lfalse);
       return;
-    } else if (!strcmp(node->children[1]->name, "OR")) {
+    }
+    case N_EXP_OR: {
       int l1 = new_label();
       Cond(node->children[0], ltrue, l1);
-      translate_printf("LABEL label%d :\n", l1);
+      IR_Emit1(IR_LABEL, OpLabel(l1));
       Cond(node->children[2], ltrue, lfalse);
       return;
     }
@@ -410,16 +424,13 @@ void Cond(struct ast* node, int ltrue, int lfalse) {
   // default
   int t1 = new_temp();
   Exp(node, t1, RIGHT);
-  translate_printf("IF t%d != #0 GOTO label%d\n", t1, ltrue);
-  translate_printf("GOTO label%d\n", lfalse);
+  IR_EmitIf(RELOP_NE, OpTemp(t1), OpConst(0), ltrue);
+  IR_Emit1(IR_GOTO, OpLabel(lfalse));
 }
 
 const Type* Exp(struct ast* node, int place, int addr) {
-  if (node->num == 3 && !strcmp(node->children[0]->name, "Exp") &&
-      !strcmp(node->children[2]->name, "Exp")) {
-    // 双目运算符
-
-    if (!strcmp(node->children[1]->name, "ASSIGNOP")) {
+  switch (node->kind) {
+    case N_EXP_ASSIGNOP: {
       // 赋值运算
 
       // translate
@@ -427,161 +438,198 @@ const Type* Exp(struct ast* node, int place, int addr) {
       int t2 = new_temp();
       Exp(node->children[0], t1, LEFT);
       Exp(node->children[2], t2, RIGHT);
-      translate_printf("*t%d := t%d\n", t1, t2);
-      translate_printf("t%d := t%d\n", place, t2);
-
-    } else if (!strcmp(node->children[1]->name, "AND") ||
-               !strcmp(node->children[1]->name, "OR") ||
-               !strcmp(node->children[1]->name, "RELOP")) {
-      // 与运算和或运算以及比较运算
+      IR_Emit2(IR_STORE, OpTemp(t1), OpTemp(t2));
+      IR_Emit2(IR_ASSIGN, OpTemp(place), OpTemp(t2));
+      break;
+    }
+    case N_EXP_AND:
+    case N_EXP_OR:
+    case N_EXP_RELOP:
+    case N_EXP_NOT: {
+      // 与运算和或运算以及比较运算, 逻辑非
 
       // translate
       int l1 = new_label();
       int l2 = new_label();
-      translate_printf("t%d := #0\n", place);
+      IR_Emit2(IR_ASSIGN, OpTemp(place), OpConst(0));
       Cond(node, l1, l2);
-      translate_printf("LABEL label%d :\n", l1);
-      translate_printf("t%d := #1\n", place);
-      translate_printf("LABEL label%d :\n", l2);
-    } else {  // 加减乘除
+      IR_Emit1(IR_LABEL, OpLabel(l1));
+      IR_Emit2(IR_ASSIGN, OpTemp(place), OpConst(1));
+      IR_Emit1(IR_LABEL, OpLabel(l2));
+      break;
+    }
+    case N_EXP_PLUS:
+    case N_EXP_MINUS:
+    case N_EXP_STAR:
+    case N_EXP_DIV: {
+      // 加减乘除
       int t1 = new_temp();
       int t2 = new_temp();
       Exp(node->children[0], t1, RIGHT);
       Exp(node->children[2], t2, RIGHT);
-      if (!strcmp(node->children[1]->name, "PLUS"))
-        translate_printf("t%d := t%d + t%d\n", place, t1, t2);
-      else if (!strcmp(node->children[1]->name, "MINUS"))
-        translate_printf("t%d := t%d - t%d\n", place, t1, t2);
-      else if (!strcmp(node->children[1]->name, "STAR"))
-        translate_printf("t%d := t%d * t%d\n", place, t1, t2);
-      else if (!strcmp(node->children[1]->name, "DIV"))
-        translate_printf("t%d := t%d / t%d\n", place, t1, t2);
+      int op = node->kind == N_EXP_PLUS    ? IR_ADD
+               : node->kind == N_EXP_MINUS ? IR_SUB
+               : node->kind == N_EXP_STAR  ? IR_MUL
+                                           : IR_DIV;
+      IR_Emit(op, OpTemp(place), OpTemp(t1), OpTemp(t2));
+      break;
     }
-  } else if (node->num == 3 && !strcmp(node->children[0]->name, "LP")) {
-    // Exp -> LP Exp RP
-    return Exp(node->children[1], place, addr);
-  } else if (!strcmp(node->children[0]->name, "MINUS")) {
-    // Exp -> MINUS
-
-    // translate
-    int t1 = new_temp();
+    case N_EXP_PAREN:
+      // Exp -> LP Exp RP
+      return Exp(node->children[1], place, addr);
+    case N_EXP_NEG: {
+      // Exp -> MINUS
 
-    Exp(node->children[1], t1, addr);
-    translate_printf("t%d := #0 - t%d\n", place, t1);
+      // translate
+      int t1 = new_temp();
 
-  } else if (!strcmp(node->children[0]->name, "NOT")) {
-    // Exp -> NOT
+      Exp(node->children[1], t1, addr);
+      IR_Emit(IR_SUB, OpTemp(place), OpConst(0), OpTemp(t1));
+      break;
+    }
+    case N_EXP_CALL: {
+      // Exp -> ID LP RP
+      // Exp -> ID LP Args RP
+      const char* fname = ID(node->children[0]);
+      Symbol* func = Query_Symtab(fname);
+      int lineno = node->children[0]->lineno;
+      if (fname != ctx->name_read && fname != ctx->name_write) {
+        if (!func)
+          return Semantic_Error(2, lineno, "Undefined function \"%s\"",
+                                fname);
+        if (func->skind != S_FUNCTIONNAME)
+          return Semantic_Error(11, lineno, "\"%s\" is not a function",
+                                fname);
+        if (!Args_Fit(node->num == 4 ? node->children[2] : NULL,
+                      func->pfunc->params))
+          return Semantic_Error(
+              9, lineno, "Function \"%s\" is not applicable for arguments",
+              fname);
+      }
 
-    // translate
-    int l1 = new_label();
-    int l2 = new_label();
-    translate_printf("t%d := #0\n", place);
-    Cond(node, l1, l2);
-    translate_printf("LABEL label%d :\n", l1);
-    translate_printf("t%d := #1\n", place);
-    translate_printf("LABEL label%d :\n", l2);
-
-  } else if (node->num > 2 && !strcmp(node->children[0]->name, "ID") &&
-             !strcmp(node->children[1]->name, "LP")) {
-    // Exp -> ID LP RP
-    // Exp -> ID LP Args RP
-    char fname[MAX_NAME_LEN];
-    ID(node->children[0], fname);
-    Symbol* func = Query_Symtab(fname);
-
-    if (node->num == 4) {
-      // translate
-      if (!strcmp(node->children[0]->id_name, "write")) {
-        int t1 = new_temp();
-        Exp(node->children[2]->children[0], t1, RIGHT);
-        translate_printf("WRITE t%d\n", t1);
-      } else {
-        struct ArgList* arglist = Args(node->children[2], func->pfunc->params);
-        while (arglist) {
-          translate_printf("ARG t%d\n", arglist->place);
-          arglist = arglist->next;
+      if (node->num == 4) {
+        // translate
+        if (fname == ctx->name_write) {
+          int t1 = new_temp();
+          Exp(node->children[2]->children[0], t1, RIGHT);
+          IR_Emit1(IR_WRITE, OpTemp(t1));
+        } else {
+          struct ArgList* arglist =
+              Args(node->children[2], func->pfunc->params);
+          while (arglist) {
+            IR_Emit1(IR_ARG, OpTemp(arglist->place));
+            arglist = arglist->next;
+          }
+          IR_Emit2(IR_CALL, OpTemp(place), OpFunc(fname));
         }
-        translate_printf("t%d := CALL %s\n", place, fname);
-      }
-    } else if (node->num == 3) {
-      // 无参数的函数
+      } else {
+        // 无参数的函数
 
-      // translate
-      if (!strcmp(node->children[0]->id_name, "read"))
-        translate_printf("READ t%d\n", place);
-      else
-        translate_printf("t%d := CALL %s\n", place, fname);
+        // translate
+        if (fname == ctx->name_read)
+          IR_Emit1(IR_READ, OpTemp(place));
+        else
+          IR_Emit2(IR_CALL, OpTemp(place), OpFunc(fname));
+      }
+      break;
     }
-  } else if (node->num == 4 && !strcmp(node->children[1]->name, "LB") &&
-             !strcmp(node->children[3]->name, "RB")) {
-    // Exp -> Exp LB Exp RB
-    int t1 = new_temp();
-    int t2 = new_temp();
-    const Type* arr = Exp(node->children[0], t1, LEFT);
-    Exp(node->children[2], t2, RIGHT);
-    assert(arr);
-    assert(arr->tkind == T_ARRAY);
-    int width = arr->array.type->type_size;
-    translate_printf("t%d := t%d * #%d\n", t2, t2, width);
-    translate_printf("t%d := t%d + t%d\n", t1, t1, t2);
-    if (addr == LEFT)
-      translate_printf("t%d := t%d\n", place, t1);
-    else
-      translate_printf("t%d := *t%d\n", place, t1);
+    case N_EXP_INDEX: {
+      // Exp -> Exp LB Exp RB
+      int t1 = new_temp();
+      int t2 = new_temp();
+      const Type* arr = Exp(node->children[0], t1, LEFT);
+      Exp(node->children[2], t2, RIGHT);
+      if (arr == &WRONG) return arr;
+      if (!arr || arr->tkind != T_ARRAY) {
+        struct ast* base = node->children[0];
+        if (base->kind == N_EXP_ID)
+          return Semantic_Error(10, node->lineno, "\"%s\" is not an array",
+                                ID(base->children[0]));
+        return Semantic_Error(10, node->lineno, "Illegal use of \"[]\"");
+      }
+      int width = arr->array.type->type_size;
+      IR_Emit(IR_MUL, OpTemp(t2), OpTemp(t2), OpConst(width));
+      IR_Emit(IR_ADD, OpTemp(t1), OpTemp(t1), OpTemp(t2));
+      if (addr == LEFT)
+        IR_Emit2(IR_ASSIGN, OpTemp(place), OpTemp(t1));
+      else
+        IR_Emit2(IR_LOAD, OpTemp(place), OpTemp(t1));
 
-    return arr->array.type;
-  } else if (node->num == 3 && !strcmp(node->children[1]->name, "DOT")) {
-    // 域变量访问
-    char varname[MAX_NAME_LEN];
-    int t1 = new_temp();
-    const Type* type = Exp(node->children[0], t1, LEFT);
-    ID(node->children[2], varname);
-    FieldList* fl = type->field;
-    while (fl) {
-      assert(fl->sym);
-      if (!strcmp(fl->sym->sbname, varname)) break;
-      fl = fl->next;
+      return arr->array.type;
     }
-    assert(fl);
-    translate_printf("t%d := t%d + #%d\n", t1, t1, fl->bias);
-    if (addr == LEFT)
-      translate_printf("t%d := t%d\n", place, t1);
-    else
-      translate_printf("t%d := *t%d\n", place, t1);
-
-    return fl->sym->pvar->vtype;
+    case N_EXP_DOT: {
+      // 域变量访问
+      int t1 = new_temp();
+      const Type* type = Exp(node->children[0], t1, LEFT);
+      const char* varname = ID(node->children[2]);
+      if (type == &WRONG) return type;
+      if (!type || type->tkind != T_STRUCTURE)
+        return Semantic_Error(13, node->lineno, "Illegal use of \".\"");
+      FieldList* fl = type->field;
+      while (fl) {
+        assert(fl->sym);
+        if (fl->sym->sbname == varname) break;
+        fl = fl->next;
+      }
+      if (!fl)
+        return Semantic_Error(14, node->children[2]->lineno,
+                              "Non-existent field \"%s\"", varname);
+      IR_Emit(IR_ADD, OpTemp(t1), OpTemp(t1), OpConst(fl->bias));
+      if (addr == LEFT)
+        IR_Emit2(IR_ASSIGN, OpTemp(place), OpTemp(t1));
+      else
+        IR_Emit2(IR_LOAD, OpTemp(place), OpTemp(t1));
 
-  } else if (!strcmp(node->children[0]->name, "ID") && node->num == 1) {
-    // 标识符
-    char sbname[MAX_NAME_LEN];
-    ID(node->children[0], sbname);
-    Symbol* sb = Query_Symtab(sbname);
+      return fl->sym->pvar->vtype;
+    }
+    case N_VARDEC:
+      // Dec -> VarDec ASSIGNOP Exp 中的 VarDec -> ID, 同标识符
+    case N_EXP_ID: {
+      // 标识符
+      Symbol* sb = Query_Symtab(ID(node->children[0]));
+      if (!sb || sb->skind != S_VARIABLE)
+        return Semantic_Error(1, node->children[0]->lineno,
+                              "Undefined variable \"%s\"",
+                              ID(node->children[0]));
 
-    // translate
-    // 要求左值时，将变量的地址返回，若其本身就是地址则忽略
-    if (addr == LEFT &&
-        (sb->pvar->vtype->tkind == T_INT || sb->pvar->vtype->tkind == T_FLOAT ||
-         sb->pvar->isParam == 0))
-      translate_printf("t%d := &v%d\n", place, sb->pvar->vname);
-    else
-      translate_printf("t%d := v%d\n", place, sb->pvar->vname);
+      // translate
+      // 要求左值时，将变量的地址返回，若其本身就是地址则忽略
+      if (addr == LEFT && (sb->pvar->vtype->tkind == T_INT ||
+                           sb->pvar->vtype->tkind == T_FLOAT ||
+                           sb->pvar->isParam == 0))
+        IR_Emit2(IR_ADDR, OpTemp(place), OpVar(sb->pvar->vname));
+      else
+        IR_Emit2(IR_ASSIGN, OpTemp(place), OpVar(sb->pvar->vname));
 
-    return sb->pvar->vtype;
-  } else if (!strcmp(node->children[0]->name, "INT")) {
-    // translate
-    int value = node->children[0]->int_value;
-    translate_printf("t%d := #%d\n", place, value);
-  } else if (!strcmp(node->children[0]->name, "FLOAT")) {
-    // translate
-    float value = node->children[0]->float_value;
-    translate_printf("t%d := #%f\n", place, value);
-  } else {
-    assert(0);
+      return sb->pvar->vtype;
+    }
+    case N_EXP_INT: {
+      // translate
+      int value = node->children[0]->int_value;
+      IR_Emit2(IR_ASSIGN, OpTemp(place), OpConst(value));
+      break;
+    }
+    case N_EXP_FLOAT: {
+      // translate
+      float value = node->children[0]->float_value;
+      IR_Emit2(IR_ASSIGN, OpTemp(place), OpFConst(value));
+      break;
+    }
+    default:
+      assert(0);
   }
 
   return NULL;
 }
 
+// 实参的个数是否与形参相同, node为NULL时没有实参
+static int Args_Fit(struct ast* node, FieldList* fl) {
+  for (; node && fl; fl = fl->next)
+    // Args -> Exp COMMA Args | Exp
+    node = node->num == 3 ? node->children[2] : NULL;
+  return !node && !fl;
+}
+
 struct ArgList* Args(struct ast* node, FieldList* fl) {
   struct ArgList* ret = NULL;
   while (fl) {
@@ -591,7 +639,8 @@ struct ArgList* Args(struct ast* node, FieldList* fl) {
       Exp(node->children[0], t1, LEFT);
     else
       Exp(node->children[0], t1, RIGHT);
-    struct ArgList* arglist = malloc(sizeof(struct ArgList));
+    struct ArgList* arglist =
+        Arena_Alloc(&ctx->sym_arena, sizeof(struct ArgList));
     arglist->place = t1;
     arglist->next = ret;
     ret = arglist;
@@ -602,15 +651,26 @@ struct ArgList* Args(struct ast* node, FieldList* fl) {
   return ret;
 }
 
-void ID(struct ast* node, char* ans_name) { strcpy(ans_name, node->id_name); }
+const char* ID(struct ast* node) { return node->id_name; }
 
 void eval_semantic(struct ast* root) {
   // eval_syntax_tree(root, 0);
   Program(root);
 }
 
+void eval_semantic_begin() {
+  ctx->name_int = Intern("int");
+  ctx->name_read = Intern("read");
+  ctx->name_write = Intern("write");
+
+  // 初始化全局符号表
+  Symtab_Init();
+}
+
+void eval_semantic_end() { Symtab_Uninit(); }
+
 static Type* LType_INT() {
-  Type* type = malloc(sizeof(Type));
+  Type* type = Arena_Alloc(&ctx->sym_arena, sizeof(Type));
   type->tkind = T_INT;
   type->left_val = 1;
   type->type_size = 4;
@@ -619,7 +679,7 @@ static Type* LType_INT() {
 }
 
 static Type* LType_FLOAT() {
-  Type* type = malloc(sizeof(Type));
+  Type* type = Arena_Alloc(&ctx->sym_arena, sizeof(Type));
   type->tkind = T_FLOAT;
   type->left_val = 1;
   type->type_size = 4;
@@ -628,7 +688,7 @@ static Type* LType_FLOAT() {
 }
 
 static Type* LType_UKST() {
-  Type* type = malloc(sizeof(Type));
+  Type* type = Arena_Alloc(&ctx->sym_arena, sizeof(Type));
   type->tkind = T_STRUCTURE;
   type->left_val = 1;
   // nouse
@@ -11,8 +11,8 @@ void ExtDecList(struct ast* node, const Type* type);
 
 const Type* Specifier(struct ast* node);
 const Type* StructSpecifier(struct ast* node);
-void OptTag(struct ast* node, char* ans_name);
-void Tag(struct ast* node, char* ans_name);
+const char* OptTag(struct ast* node);
+const char* Tag(struct ast* node);
 
 Symbol* FunDec(struct ast* node);
 void CompSt(struct ast* node, const Type* rtype);
@@ -30,7 +30,7 @@ const Symbol* VarDec(struct ast* node, const Type* type);
 const Type* Exp(struct ast* node, int place, int addr);
 struct ArgList* Args(struct ast* node, FieldList* params);
 
-void ID(struct ast* node, char* ans_name);
+const char* ID(struct ast* node);
 
 void Cond(struct ast* node, int ltrue, int lfalse);
 
@@ -44,4 +44,7 @@ struct ArgList {
 
 /* 接口 */
 void eval_semantic(struct ast* root);
+// 流水线模式: 在两者之间依次对每个ExtDef调用ExtDef
+void eval_semantic_begin();
+void eval_semantic_end();
 #endif
\ No newline at end of file
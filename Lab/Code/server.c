@@ -0,0 +1,263 @@
+#define _DEFAULT_SOURCE
+#include "server.h"
+
+#include "compiler.h"
+#include "errno.h"
+#include "pthread.h"
+#include "signal.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/socket.h"
+#include "sys/un.h"
+#include "unistd.h"
+
+// 连接: 同一个套接字的读写两端
+struct Conn {
+  FILE *in, *out;
+};
+
+static Conn* Conn_Open(int fd) {
+  Conn* conn = malloc(sizeof(Conn));
+  conn->in = fdopen(fd, "r");
+  conn->out = fdopen(dup(fd), "w");
+  return conn;
+}
+
+static void Conn_Close(Conn* conn) {
+  fclose(conn->in);
+  fclose(conn->out);
+  free(conn);
+}
+
+// 关闭写端并丢弃读到结束为止的数据
+static void Conn_Drain(Conn* conn) {
+  char buf[4096];
+  shutdown(fileno(conn->out), SHUT_WR);
+  while (fread(buf, 1, sizeof(buf), conn->in) > 0) continue;
+}
+
+static int Socket_Addr(struct sockaddr_un* addr, const char* path) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return 0;
+  }
+  strcpy(addr->sun_path, path);
+  return 1;
+}
+
+// 读一行并去掉换行符; 连接结束时返回0, 行过长时返回-1
+static int Read_Line(Conn* conn, char* line) {
+  if (!fgets(line, SERVER_LINE, conn->in)) return 0;
+  size_t len = strlen(line);
+  if (len == 0 || line[len - 1] != '\n') return feof(conn->in) ? 0 : -1;
+  line[len - 1] = '\0';
+  return 1;
+}
+
+// 从from复制len字节到to, to为NULL时丢弃
+static int Copy_Bytes(FILE* from, FILE* to, size_t len) {
+  char buf[4096];
+  while (len > 0) {
+    size_t n = len < sizeof(buf) ? len : sizeof(buf);
+    if (fread(buf, 1, n, from) != n) return 0;
+    if (to) fwrite(buf, 1, n, to);
+    len -= n;
+  }
+  return 1;
+}
+
+/* 服务器 */
+
+typedef struct Session {
+  Conn* conn;
+  Server_Handler handler;
+} Session;
+
+static int Reply(Conn* conn, int status, const char* diag, size_t dlen,
+                 const char* out, size_t olen) {
+  fprintf(conn->out, "STATUS %d %zu %zu\n", status, dlen, olen);
+  if (dlen) fwrite(diag, 1, dlen, conn->out);
+  if (olen) fwrite(out, 1, olen, conn->out);
+  return !fflush(conn->out);
+}
+
+// 读SOURCE后的长度, 不是十进制数或超过上限时返回0
+static int Source_Len(const char* text, size_t* len) {
+  char* end;
+  errno = 0;
+  unsigned long long n = strtoull(text, &end, 10);
+  if (end == text || *end || errno || text[0] == '-' ||
+      n > SERVER_MAX_SOURCE)
+    return 0;
+  *len = n;
+  return 1;
+}
+
+// 处理连接上的下一个请求, 连接结束或出错时返回0
+static int Serve_Request(Session* s, Compiler* c) {
+  char line[SERVER_LINE];
+  char* args[SERVER_MAX_ARGS];
+  int nargs = 0;
+  char* src = NULL;
+  FILE* in = NULL;
+  const char* path = NULL;
+  // 请求有错时只回应error; 之后不知道请求在哪里结束的, 回应后断开
+  const char *error = NULL, *fatal = NULL;
+  int got;
+  while ((got = Read_Line(s->conn, line)) > 0) {
+    if (!strncmp(line, "ARG ", 4)) {
+      if (nargs < SERVER_MAX_ARGS)
+        args[nargs++] = strdup(line + 4);
+      else
+        error = "too many options";
+      continue;
+    }
+    if (!strncmp(line, "PATH ", 5)) {
+      path = line + 5;
+      if (!error) in = fopen(path, "r");
+    } else if (!strncmp(line, "SOURCE ", 7)) {
+      size_t len;
+      path = "<source>";
+      if (!Source_Len(line + 7, &len))
+        fatal = "bad source length";
+      else if (!(src = malloc(len + 1)))
+        fatal = "out of memory";
+      else if (fread(src, 1, len, s->conn->in) != len)
+        path = NULL;
+      else if (!error)
+        in = fmemopen(src, len, "r");
+    } else
+      fatal = "bad request line";
+    break;
+  }
+  if (got < 0) fatal = "request line too long";
+  if (fatal) error = fatal;
+
+  int ok = path != NULL || error != NULL;
+  if (error) {
+    char diag[64];
+    int dlen = snprintf(diag, sizeof(diag), "%s\n", error);
+    ok = Reply(s->conn, 1, diag, dlen, NULL, 0);
+    if (in) fclose(in);
+    // 读完客户端已发送的数据再断开, 否则客户端收不到回应
+    if (fatal) Conn_Drain(s->conn);
+  } else if (ok) {
+    char *obuf = NULL, *dbuf = NULL;
+    size_t olen = 0, dlen = 0;
+    FILE* out = open_memstream(&obuf, &olen);
+    FILE* diag = open_memstream(&dbuf, &dlen);
+    int status = 1;
+    if (!in)
+      fprintf(diag, "cannot open %s\n", path);
+    else {
+      Compiler_Reset(c);
+      c->diag = diag;
+      status = s->handler(args, nargs, in, out, diag);
+      fclose(in);
+    }
+    fclose(out);
+    fclose(diag);
+    ok = Reply(s->conn, status, dbuf, dlen, obuf, olen);
+    free(obuf);
+    free(dbuf);
+  }
+  for (int i = 0; i < nargs; i++) free(args[i]);
+  free(src);
+  return ok && !fatal;
+}
+
+static void* Session_Run(void* arg) {
+  Session* s = arg;
+  Compiler c;
+  Compiler_Init(&c, NULL);
+  while (Serve_Request(s, &c)) continue;
+  Compiler_Uninit(&c);
+  Conn_Close(s->conn);
+  free(s);
+  return NULL;
+}
+
+int Server_Run(const char* path, Server_Handler handler) {
+  struct sockaddr_un addr;
+  if (!Socket_Addr(&addr, path)) return 1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) ||
+      listen(fd, SOMAXCONN)) {
+    perror(path);
+    return 1;
+  }
+  // 客户端提前断开时写回应失败, 而不是收到SIGPIPE退出
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    int cfd = accept(fd, NULL, NULL);
+    if (cfd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      perror("accept");
+      break;
+    }
+    Session* s = malloc(sizeof(Session));
+    s->conn = Conn_Open(cfd);
+    s->handler = handler;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, Session_Run, s)) {
+      Conn_Close(s->conn);
+      free(s);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  close(fd);
+  return 1;
+}
+
+/* 客户端 */
+
+Conn* Client_Connect(const char* path) {
+  struct sockaddr_un addr;
+  if (!Socket_Addr(&addr, path)) return NULL;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+    perror(path);
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  return Conn_Open(fd);
+}
+
+int Client_Request(Conn* conn, char** args, int nargs, const char* path,
+                   FILE* src, FILE* out, FILE* diag) {
+  for (int i = 0; i < nargs; i++) fprintf(conn->out, "ARG %s\n", args[i]);
+  if (path) {
+    // 服务器的工作目录可能不同, 发送绝对路径
+    char* full = realpath(path, NULL);
+    fprintf(conn->out, "PATH %s\n", full ? full : path);
+    free(full);
+  } else {
+    char* buf = NULL;
+    size_t len = 0, cap = 0, n;
+    do {
+      if (len == cap) buf = realloc(buf, cap = cap ? cap * 2 : 4096);
+      n = fread(buf + len, 1, cap - len, src);
+      len += n;
+    } while (n > 0);
+    fprintf(conn->out, "SOURCE %zu\n", len);
+    fwrite(buf, 1, len, conn->out);
+    free(buf);
+  }
+  if (fflush(conn->out)) return -1;
+
+  char line[SERVER_LINE];
+  int status;
+  size_t dlen, olen;
+  if (Read_Line(conn, line) <= 0 ||
+      sscanf(line, "STATUS %d %zu %zu", &status, &dlen, &olen) != 3 ||
+      !Copy_Bytes(conn->in, diag, dlen) || !Copy_Bytes(conn->in, out, olen))
+    return -1;
+  return status;
+}
+
+void Client_Close(Conn* conn) { Conn_Close(conn); }
@@ -0,0 +1,43 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "stdio.h"
+
+/*
+编译服务器: 常驻进程在Unix域套接字上接受编译请求, 省去每次编译都要
+启动进程, 预热分配器的开销
+-- 每个连接一个线程, 线程有自己的编译上下文, 请求之间用Compiler_Reset
+   清空, 区域和散列表的内存都复用
+-- 一个连接上可以依次发送多个请求, 按顺序回应
+-- 请求: 若干行"ARG 选项", 然后是一行"PATH 文件名"(由服务器读文件),
+   或一行"SOURCE 长度"紧跟源代码
+-- 回应: 一行"STATUS 返回值 诊断长度 输出长度", 紧跟诊断信息和输出;
+   诊断信息为词法, 语法和语义错误等, 输出为中间代码或汇编
+-- 请求有错(选项过多, 长度不对, 不认识的行等)时回应STATUS 1和错误信息;
+   无法确定请求在哪里结束时, 回应后断开连接
+*/
+
+#define SERVER_MAX_ARGS 32            // 一个请求中选项的个数上限
+#define SERVER_LINE 4096              // 一行的长度上限
+#define SERVER_MAX_SOURCE (64 << 20)  // SOURCE的长度上限
+
+typedef struct Conn Conn;
+
+// 处理一个请求: 当前上下文已清空, 按args中的选项编译in, 结果写到out,
+// 诊断信息写到diag; 返回值作为请求的返回值
+typedef int (*Server_Handler)(char** args, int nargs, FILE* in, FILE* out,
+                              FILE* diag);
+
+// 在套接字path上监听并处理请求, 只在出错时返回
+extern int Server_Run(const char* path, Server_Handler handler);
+
+// 连接到套接字path上的服务器, 失败时返回NULL
+extern Conn* Client_Connect(const char* path);
+// 发送一个请求并等待回应: 编译文件path, path为NULL时发送src的全部内容;
+// 回应中的诊断信息写到diag, 输出写到out; 返回请求的返回值, 通信失败
+// 时返回-1
+extern int Client_Request(Conn* conn, char** args, int nargs,
+                          const char* path, FILE* src, FILE* out, FILE* diag);
+extern void Client_Close(Conn* conn);
+
+#endif
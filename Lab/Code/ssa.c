@@ -0,0 +1,333 @@
+#include "ssa.h"
+
+#include "assert.h"
+#include "stdlib.h"
+#include "string.h"
+
+typedef struct Builder {
+  SSA* ssa;
+  OpMap m;
+  char* taken;
+  Operand* name_of;  // OpMap下标 -> 名字
+  int* entry;        // OpMap下标 -> 入口处的版本
+  int* phi_var;      // phi -> 所属名字的OpMap下标
+  int cap;
+} Builder;
+
+static int New_Name(Builder* bd, Operand orig, int def) {
+  SSA* ssa = bd->ssa;
+  if (ssa->nname == bd->cap) {
+    bd->cap *= 2;
+    ssa->orig = realloc(ssa->orig, bd->cap * sizeof(Operand));
+    ssa->def = realloc(ssa->def, bd->cap * sizeof(int));
+  }
+  ssa->orig[ssa->nname] = orig;
+  ssa->def[ssa->nname] = def;
+  return ssa->nname++;
+}
+
+static int Entry(Builder* bd, int j) {
+  if (bd->entry[j] < 0) bd->entry[j] = New_Name(bd, bd->name_of[j], -1);
+  return bd->entry[j];
+}
+
+// 支配边界, 按块存放: df[df_first[b], df_first[b + 1])
+static void Build_DF(const CFG* cfg, int** df_first, int** df) {
+  int nb = cfg->nblock;
+  int* first = calloc(nb + 2, sizeof(int));
+  int* mark = malloc((nb + 1) * sizeof(int));
+  int* list = NULL;
+  // 第一遍计数, 第二遍填写
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 0; k < nb; k++) mark[k] = -1;
+    for (int b = 0; b < nb; b++) {
+      const Block* blk = &cfg->blocks[b];
+      if (blk->rpo < 0 || blk->npred < 2) continue;
+      for (int p = 0; p < blk->npred; p++) {
+        int r = blk->pred[p];
+        if (cfg->blocks[r].rpo < 0) continue;
+        while (r != blk->idom && mark[r] != b) {
+          mark[r] = b;
+          if (pass)
+            list[first[r + 1]++] = b;
+          else
+            first[r + 2]++;
+          r = cfg->blocks[r].idom;
+        }
+      }
+    }
+    if (!pass) {
+      for (int k = 2; k < nb + 2; k++) first[k] += first[k - 1];
+      list = malloc((first[nb + 1] + 1) * sizeof(int));
+    }
+  }
+  free(mark);
+  *df_first = first;
+  *df = list;
+}
+
+// 半剪枝: 在某个块中先使用后定值的名字
+static char* Global_Names(Builder* bd) {
+  const CFG* cfg = bd->ssa->cfg;
+  int size = OpMap_Size(&bd->m);
+  char* global = calloc(size + 1, 1);
+  int* killed = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) killed[j] = -1;
+  Operand* u[2];
+  for (int b = 0; b < cfg->nblock; b++)
+    for (int i = cfg->blocks[b].first; i < cfg->blocks[b].last; i++) {
+      Instr* in = &cfg->func->code[i];
+      int n = Instr_Uses(in, u);
+      for (int k = 0; k < n; k++) {
+        int j = OpMap_Index(&bd->m, *u[k]);
+        if (j >= 0 && killed[j] != b) global[j] = 1;
+      }
+      Operand* d = Instr_Def(in);
+      int j = d ? OpMap_Index(&bd->m, *d) : -1;
+      if (j >= 0) killed[j] = b;
+    }
+  free(killed);
+  return global;
+}
+
+// 在迭代支配边界上插入phi, 按块排好
+static void Place_Phis(Builder* bd) {
+  SSA* ssa = bd->ssa;
+  const CFG* cfg = ssa->cfg;
+  int nb = cfg->nblock, size = OpMap_Size(&bd->m);
+  char* global = Global_Names(bd);
+  int *df_first, *df;
+  Build_DF(cfg, &df_first, &df);
+
+  // 每个名字的定值块: defs[def_first[j], def_first[j + 1])
+  int* def_first = calloc(size + 2, sizeof(int));
+  int* last = malloc((size + 1) * sizeof(int));
+  int* defs = NULL;
+  for (int pass = 0; pass < 2; pass++) {
+    for (int j = 0; j < size; j++) last[j] = -1;
+    for (int b = 0; b < nb; b++) {
+      if (cfg->blocks[b].rpo < 0) continue;
+      for (int i = cfg->blocks[b].first; i < cfg->blocks[b].last; i++) {
+        Operand* d = Instr_Def(&cfg->func->code[i]);
+        int j = d ? OpMap_Index(&bd->m, *d) : -1;
+        if (j < 0 || !global[j] || bd->taken[j] || last[j] == b) continue;
+        last[j] = b;
+        if (pass)
+          defs[def_first[j + 1]++] = b;
+        else
+          def_first[j + 2]++;
+      }
+    }
+    if (!pass) {
+      for (int j = 2; j < size + 2; j++) def_first[j] += def_first[j - 1];
+      defs = malloc((def_first[size + 1] + 1) * sizeof(int));
+    }
+  }
+
+  // 工作表算法, 记下 (块, 名字)
+  int* has_phi = malloc((nb + 1) * sizeof(int));
+  int* in_work = malloc((nb + 1) * sizeof(int));
+  int* work = malloc((nb + 1) * sizeof(int));
+  int cap = 64, nphi = 0;
+  int* at = malloc(cap * 2 * sizeof(int));
+  for (int b = 0; b < nb; b++) has_phi[b] = in_work[b] = -1;
+  for (int j = 0; j < size; j++) {
+    int sp = 0;
+    for (int k = def_first[j]; k < def_first[j + 1]; k++) {
+      in_work[defs[k]] = j;
+      work[sp++] = defs[k];
+    }
+    while (sp) {
+      int b = work[--sp];
+      for (int k = df_first[b]; k < df_first[b + 1]; k++) {
+        int d = df[k];
+        if (has_phi[d] == j) continue;
+        has_phi[d] = j;
+        if (nphi == cap) {
+          cap *= 2;
+          at = realloc(at, cap * 2 * sizeof(int));
+        }
+        at[2 * nphi] = d;
+        at[2 * nphi + 1] = j;
+        nphi++;
+        if (in_work[d] != j) {
+          in_work[d] = j;
+          work[sp++] = d;
+        }
+      }
+    }
+  }
+
+  // 按块计数排序
+  ssa->nphi = nphi;
+  ssa->phis = malloc((nphi + 1) * sizeof(Phi));
+  bd->phi_var = malloc((nphi + 1) * sizeof(int));
+  ssa->phi_first = calloc(nb + 2, sizeof(int));
+  for (int p = 0; p < nphi; p++) ssa->phi_first[at[2 * p] + 2]++;
+  for (int b = 2; b < nb + 2; b++) ssa->phi_first[b] += ssa->phi_first[b - 1];
+  int nargs = 0;
+  for (int p = 0; p < nphi; p++) {
+    int q = ssa->phi_first[at[2 * p] + 1]++;
+    ssa->phis[q].block = at[2 * p];
+    ssa->phis[q].dst = -1;
+    bd->phi_var[q] = at[2 * p + 1];
+    nargs += Phi_NArg(ssa, &ssa->phis[q]);
+  }
+  // 来自不可达前驱的参数保持-1
+  ssa->arg_buf = malloc((nargs + 1) * sizeof(int));
+  memset(ssa->arg_buf, -1, (nargs + 1) * sizeof(int));
+  nargs = 0;
+  for (int p = 0; p < nphi; p++) {
+    ssa->phis[p].arg = ssa->arg_buf + nargs;
+    nargs += Phi_NArg(ssa, &ssa->phis[p]);
+  }
+
+  free(at);
+  free(has_phi);
+  free(in_work);
+  free(work);
+  free(defs);
+  free(last);
+  free(def_first);
+  free(df_first);
+  free(df);
+  free(global);
+}
+
+static int Rename_Op(Builder* bd, Operand* op) {
+  int j = OpMap_Index(&bd->m, *op);
+  return j < 0 || bd->taken[j] ? -1 : j;
+}
+
+// 沿支配树先序重命名, 离开子树时按日志恢复各名字的当前版本
+static void Rename(Builder* bd) {
+  SSA* ssa = bd->ssa;
+  CFG* cfg = ssa->cfg;
+  int nb = cfg->nblock, size = OpMap_Size(&bd->m);
+  int* top = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) top[j] = -1;
+  int log_cap = ssa->func->len + ssa->nphi + 1, nlog = 0;
+  int* log = malloc(2 * log_cap * sizeof(int));  // (名字, 原来的版本)
+  int* mark = malloc((nb + 1) * sizeof(int));
+  int* stack = malloc((2 * nb + 1) * sizeof(int));
+  int sp = 0;
+  Operand* u[2];
+
+  // 入口块的phi多出的参数
+  for (int p = ssa->phi_first[0]; p < ssa->phi_first[1]; p++)
+    ssa->phis[p].arg[cfg->blocks[0].npred] = Entry(bd, bd->phi_var[p]);
+
+  if (cfg->nreach) stack[sp++] = 0;
+  while (sp) {
+    int b = stack[--sp];
+    if (b < 0) {
+      for (b = ~b; nlog > mark[b]; nlog--)
+        top[log[2 * nlog - 2]] = log[2 * nlog - 1];
+      continue;
+    }
+    Block* blk = &cfg->blocks[b];
+    mark[b] = nlog;
+    stack[sp++] = ~b;
+
+    for (int p = ssa->phi_first[b]; p < ssa->phi_first[b + 1]; p++) {
+      int j = bd->phi_var[p];
+      log[2 * nlog] = j;
+      log[2 * nlog + 1] = top[j];
+      nlog++;
+      top[j] = ssa->phis[p].dst = New_Name(bd, bd->name_of[j], -2 - p);
+    }
+    for (int i = blk->first; i < blk->last; i++) {
+      Instr* in = &ssa->func->code[i];
+      int n = Instr_Uses(in, u);
+      for (int k = 0; k < n; k++) {
+        int j = Rename_Op(bd, u[k]);
+        if (j < 0) continue;
+        int id = top[j] >= 0 ? top[j] : Entry(bd, j);
+        *u[k] = OpTemp(ssa->base + id);
+      }
+      Operand* d = Instr_Def(in);
+      int j = d ? Rename_Op(bd, d) : -1;
+      if (j < 0) continue;
+      log[2 * nlog] = j;
+      log[2 * nlog + 1] = top[j];
+      nlog++;
+      top[j] = New_Name(bd, *d, i);
+      *d = OpTemp(ssa->base + top[j]);
+    }
+
+    // 填写后继中phi的参数
+    for (int s = 0; s < blk->nsucc; s++) {
+      if (s == 1 && blk->succ[1] == blk->succ[0]) break;
+      const Block* to = &cfg->blocks[blk->succ[s]];
+      int first = ssa->phi_first[blk->succ[s]];
+      int end = ssa->phi_first[blk->succ[s] + 1];
+      for (int k = 0; k < to->npred; k++) {
+        if (to->pred[k] != b) continue;
+        for (int p = first; p < end; p++) {
+          int j = bd->phi_var[p];
+          ssa->phis[p].arg[k] = top[j] >= 0 ? top[j] : Entry(bd, j);
+        }
+      }
+    }
+    for (int k = blk->nkid - 1; k >= 0; k--) stack[sp++] = blk->kids[k];
+  }
+
+  free(top);
+  free(log);
+  free(mark);
+  free(stack);
+}
+
+SSA* SSA_Build(IRFunc* func) {
+  SSA* ssa = malloc(sizeof(SSA));
+  Builder bd;
+  bd.ssa = ssa;
+  ssa->func = func;
+  ssa->cfg = CFG_Build(func);
+  OpMap_Init(&bd.m, func);
+  int size = OpMap_Size(&bd.m);
+  bd.taken = Func_AddrTaken(func, &bd.m);
+  bd.name_of = malloc((size + 1) * sizeof(Operand));
+  bd.entry = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) bd.entry[j] = -1;
+  // 先记下所有名字, 入口处的版本可能在见到名字之前就需要
+  for (int i = 0; i < func->len; i++) {
+    Operand* ops = &func->code[i].x;
+    for (int k = 0; k < 3; k++) {
+      int j = OpMap_Index(&bd.m, ops[k]);
+      if (j >= 0) bd.name_of[j] = ops[k];
+    }
+  }
+
+  ssa->base = bd.m.tcnt ? bd.m.tmin + bd.m.tcnt : 1;
+  ssa->nname = 0;
+  bd.cap = 64;
+  ssa->orig = malloc(bd.cap * sizeof(Operand));
+  ssa->def = malloc(bd.cap * sizeof(int));
+  Place_Phis(&bd);
+  Rename(&bd);
+
+  free(bd.taken);
+  free(bd.name_of);
+  free(bd.entry);
+  free(bd.phi_var);
+  return ssa;
+}
+
+void SSA_Destruct(SSA* ssa) {
+  IRFunc* func = ssa->func;
+  for (int i = 0; i < func->len; i++) {
+    Operand* ops = &func->code[i].x;
+    for (int k = 0; k < 3; k++) {
+      int id = SSA_Id(ssa, ops[k]);
+      if (id >= 0) ops[k] = ssa->orig[id];
+    }
+  }
+  CFG_Free(ssa->cfg);
+  free(ssa->orig);
+  free(ssa->def);
+  free(ssa->phis);
+  free(ssa->phi_first);
+  free(ssa->arg_buf);
+  free(ssa);
+}
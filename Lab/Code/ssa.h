@@ -0,0 +1,52 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "cfg.h"
+#include "opt.h"
+
+/*
+静态单赋值形式:
+-- 只为跨基本块活跃的名字(半剪枝)在迭代支配边界上插入phi
+-- 沿支配树重命名: 每个定值得到新名字 t(base + id), 每个使用改为
+   到达它的版本; phi单独存放, 不进入指令数组
+-- 放在内存中的变量不参与; 入口处的值(未初始化)也是一个版本
+-- SSA_Destruct把各版本换回原来的名字并丢弃phi. 期间的变换只能把
+   使用换成常量, 删除指令或跳转, 不能延长任何版本的活跃范围,
+   这样同一名字的各版本互不冲突, 换回原名即可, 不需要插入复制
+*/
+
+typedef struct Phi Phi;
+typedef struct SSA SSA;
+
+struct Phi {
+  int block, dst;
+  // arg[k]对应块的第k个前驱, 不可达的为-1; 入口块多一个进入函数时的值
+  int* arg;
+};
+
+struct SSA {
+  IRFunc* func;
+  CFG* cfg;
+  int base;  // 版本id对应临时变量 t(base + id)
+  int nname;
+  Operand* orig;  // id -> 原来的名字
+  int* def;       // id -> 定值的指令下标, phi p为-2-p, 入口处的值为-1
+  Phi* phis;
+  int nphi;
+  int* phi_first;  // 块b的phi为 phis[phi_first[b], phi_first[b + 1])
+  int* arg_buf;
+};
+
+extern SSA* SSA_Build(IRFunc* func);
+extern void SSA_Destruct(SSA* ssa);
+
+// 操作数是SSA版本时返回id, 否则为-1
+static inline int SSA_Id(const SSA* ssa, Operand op) {
+  return op.kind == O_TEMP && op.no >= ssa->base ? op.no - ssa->base : -1;
+}
+
+static inline int Phi_NArg(const SSA* ssa, const Phi* phi) {
+  return ssa->cfg->blocks[phi->block].npred + (phi->block == 0);
+}
+
+#endif
@@ -1,14 +1,22 @@
 #include "symtab.h"
 
 #include "assert.h"
+#include "compiler.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
 
 #define SYMTAB_SIZE 0x3FFF
 
-Symtab* global;  // 全局符号表
-Symtab* local;   // 局部符号表
+// 散列表中的绑定: 符号与其所在的作用域
+typedef struct Binding Binding;
+struct Binding {
+  Symbol* sym;
+  Symtab* st;
+  Binding* next;
+};
+
+// 全局, 局部符号表和散列桶在编译上下文中
 
 // 域类型
 int fieldlist_equal(const FieldList* fl1, const FieldList* fl2) {
@@ -39,64 +47,166 @@ static int function_equal(const FuncName* f1, const FuncName* f2) {
   return fieldlist_equal(f1->params, f2->params);
 }
 
+// 名字已驻留, 直接对指针散列
+static unsigned Hash_Name(const char* name) {
+  unsigned long p = (unsigned long)name;
+  return (unsigned)((p >> 3) * 2654435761u);
+}
+
+static void Hash_Grow() {
+  unsigned mask = ctx->bucket_mask * 2 + 1;
+  Binding** nb = calloc(mask + 1, sizeof(Binding*));
+  // 逆序搬移每个桶, 保持同名绑定新者在前
+  for (unsigned i = 0; i <= ctx->bucket_mask; i++) {
+    Binding* rev = NULL;
+    for (Binding *b = ctx->buckets[i], *next; b; b = next) {
+      next = b->next;
+      b->next = rev;
+      rev = b;
+    }
+    for (Binding *b = rev, *next; b; b = next) {
+      unsigned h = Hash_Name(b->sym->sbname) & mask;
+      next = b->next;
+      b->next = nb[h];
+      nb[h] = b;
+    }
+  }
+  free(ctx->buckets);
+  ctx->buckets = nb;
+  ctx->bucket_mask = mask;
+}
+
+static void Hash_Bind(Symbol* sb, Symtab* st) {
+  if (ctx->bindcnt > ctx->bucket_mask) Hash_Grow();
+  Binding* b = ctx->free_bindings;
+  if (b)
+    ctx->free_bindings = b->next;
+  else
+    b = malloc(sizeof(Binding));
+  unsigned h = Hash_Name(sb->sbname) & ctx->bucket_mask;
+  b->sym = sb;
+  b->st = st;
+  b->next = ctx->buckets[h];
+  ctx->buckets[h] = b;
+  ctx->bindcnt++;
+}
+
+static void Hash_Unbind(Symbol* sb, Symtab* st) {
+  Binding** pb = &ctx->buckets[Hash_Name(sb->sbname) & ctx->bucket_mask];
+  while (*pb && ((*pb)->sym != sb || (*pb)->st != st)) pb = &(*pb)->next;
+  assert(*pb);
+  Binding* b = *pb;
+  *pb = b->next;
+  b->next = ctx->free_bindings;
+  ctx->free_bindings = b;
+  ctx->bindcnt--;
+}
+
+// 最内层的同名绑定
+static Binding* Hash_Find(const char* sbname) {
+  for (Binding* b = ctx->buckets[Hash_Name(sbname) & ctx->bucket_mask]; b;
+       b = b->next)
+    if (b->sym->sbname == sbname) return b;
+  return NULL;
+}
+
 static Symtab* Symtab_Create(int h, int v, Symtab* hor, Symtab* ver) {
-  Symtab* ret = malloc(sizeof(Symtab));
+  Symtab* ret = Arena_Alloc(&ctx->sym_arena, sizeof(Symtab));
   ret->hor = h;
   ret->vert = v;
-  ret->symcnt = 0;
+  ret->syms = NULL;
+  ret->symcnt = ret->symcap = 0;
   ret->hor_last_symtab = hor;
   ret->vert_last_symtab = ver;
+  return ret;
 }
 
-static void* Symtab_Drop(Symtab* st) {}
+static void Symtab_Append(Symtab* st, Symbol* sb) {
+  if (st->symcnt == st->symcap) {
+    // 符号表都在区域中, 随上下文一起释放
+    st->symcap = st->symcap ? st->symcap * 2 : 8;
+    Symbol** syms = Arena_Alloc(&ctx->sym_arena, st->symcap * sizeof(Symbol*));
+    if (st->symcnt) memcpy(syms, st->syms, st->symcnt * sizeof(Symbol*));
+    st->syms = syms;
+  }
+  st->syms[st->symcnt++] = sb;
+  Hash_Bind(sb, st);
+}
+
+// 解除本表所有符号的绑定, 表中的记录保留
+static void Symtab_Unbind(Symtab* st) {
+  for (int i = st->symcnt - 1; i >= 0; i--) Hash_Unbind(st->syms[i], st);
+}
 
-int ver = 0;
+static void Symtab_Drop(Symtab* st) { Symtab_Unbind(st); }
 
 static void Symtab_Push() {
-  assert(local->hor == 0);
-  Symtab* st = Symtab_Create(local->hor, local->vert + 1, NULL, local);
-  local = st;
+  assert(ctx->local->hor == 0);
+  Symtab* st =
+      Symtab_Create(ctx->local->hor, ctx->local->vert + 1, NULL, ctx->local);
+  ctx->local = st;
 }
 
 static void Symtab_Pop() {
-  assert(local->hor == 0);
-  // assert(local->vert_last_symtab);
-  Symtab* st = local;
-  local = local->vert_last_symtab;
+  assert(ctx->local->hor == 0);
+  // assert(ctx->local->vert_last_symtab);
+  Symtab* st = ctx->local;
+  ctx->local = ctx->local->vert_last_symtab;
   Symtab_Drop(st);
 }
 
 void Symtab_Init() {
-  global = Symtab_Create(0, 0, NULL, NULL);
-  local = global;
+  // 上次编译留下的散列桶已全部解除绑定, 直接复用
+  if (!ctx->buckets) {
+    ctx->bucket_mask = SYMTAB_SIZE;
+    ctx->buckets = calloc(ctx->bucket_mask + 1, sizeof(Binding*));
+  }
+  assert(ctx->bindcnt == 0);
+  ctx->global = Symtab_Create(0, 0, NULL, NULL);
+  ctx->local = ctx->global;
 }
 
-void Symtab_Uninit() { Symtab_Pop(global); }
+void Symtab_Uninit() {
+  Symtab_Pop(ctx->global);
+  ctx->global = ctx->local = NULL;
+}
 
-static Symbol* Query_At_Symtab(char* sbname, Symtab* st) {
-  for (int i = 0; i < st->symcnt; i++)
-    if (!strcmp(sbname, st->syms[i]->sbname)) return st->syms[i];
-  return NULL;
+void Symtab_Free() {
+  free(ctx->buckets);
+  ctx->buckets = NULL;
+  while (ctx->free_bindings) {
+    Binding* next = ctx->free_bindings->next;
+    free(ctx->free_bindings);
+    ctx->free_bindings = next;
+  }
+  Arena_Release(&ctx->sym_arena);
+}
+
+static Symbol* Query_At_Symtab(const char* sbname, Symtab* st) {
+  // 最内层的同名符号恰在st中时才算在st中
+  Binding* b = Hash_Find(sbname);
+  return b && b->st == st ? b->sym : NULL;
 }
 
 int Insert_Symtab(Symbol* sb) {
 #ifdef DEBUG
-  // printf("insert: %s at [%d, %d]\n", sb->sbname, local->vert, local->hor);
+  // printf("insert: %s at [%d, %d]\n", sb->sbname, ctx->local->vert,
+  //        ctx->local->hor);
 #endif
   assert(sb->skind);
   Symbol* other;
 
   if (sb->skind == S_VARIABLE) {
     // 普通变量重定义: 3, 域变量重定义: 15
-    if (other = Query_At_Symtab(sb->sbname, local))
+    if (other = Query_At_Symtab(sb->sbname, ctx->local))
       // 局部作用域, 任意符号都算重名
-      return local->hor ? 15 : 3;
+      return ctx->local->hor ? 15 : 3;
     else if (other = Query_Symtab(sb->sbname)) {
       // 全局作用域, 同名变量不算重名
-      if (other->skind != S_VARIABLE) return local->hor ? 15 : 3;
+      if (other->skind != S_VARIABLE) return ctx->local->hor ? 15 : 3;
     }
     // 之前所有的重名检测都通过, 插入局部表
-    local->syms[local->symcnt++] = sb;
+    Symtab_Append(ctx->local, sb);
     return 0;
 
   } else if (sb->skind == S_FUNCTIONNAME) {
@@ -121,7 +231,7 @@ int Insert_Symtab(Symbol* sb) {
       }
     }
     // 之前所有的重名检测都通过, 插入局部表
-    local->syms[local->symcnt++] = sb;
+    Symtab_Append(ctx->local, sb);
     return 0;
 
   } else if (sb->skind == S_STRUCTNAME) {
@@ -130,67 +240,51 @@ int Insert_Symtab(Symbol* sb) {
       return 16;
 
     // 之前所有的重名检测都通过, 插入函数栈帧上的表
-    Symtab* st = local;
+    Symtab* st = ctx->local;
     while (st->hor_last_symtab) st = st->hor_last_symtab;
-    st->syms[st->symcnt++] = sb;
-    /*
-    // 之前所有的重名检测都通过, 插入局部表
-    // local->syms[local->symcnt++] = sb;
-    */
+    Symtab_Append(st, sb);
     return 0;
   }
   assert(0);
 }
 
-Symbol* Query_Symtab(char* sbname) {
+Symbol* Query_Symtab(const char* sbname) {
 #ifdef DEBUG
   // printf("query: %s\n", sbname);
 #endif
-  Symtab* st = local;
-  Symbol* ans;
-  while (st->hor) {
-    if (ans = Query_At_Symtab(sbname, st)) return ans;
-    st = st->hor_last_symtab;
-  }
-  while (st) {
-    if (ans = Query_At_Symtab(sbname, st)) return ans;
-    st = st->vert_last_symtab;
-  }
-  return NULL;
+  // 可见的符号都在散列表中, 同名者中最内层的在前
+  Binding* b = Hash_Find(sbname);
+  return b ? b->sym : NULL;
 }
 
 static FieldList* BuildFieldListFromSymtab(Symtab* st) {
-  FieldList* ret = NULL;
-  if (st->symcnt) {
-    FieldList* fl = ret = malloc(sizeof(FieldList));
-    for (int i = 0; i < st->symcnt; i++) {
-      if (st->syms[i]->skind == S_VARIABLE) {
-        fl->sym = st->syms[i];
-        if (i != st->symcnt - 1)
-          fl->next = malloc(sizeof(FieldList));
-        else
-          fl->next = NULL;
-        fl = fl->next;
-      }
+  FieldList *ret = NULL, **tail = &ret;
+  for (int i = 0; i < st->symcnt; i++) {
+    if (st->syms[i]->skind == S_VARIABLE) {
+      FieldList* fl = Arena_Alloc(&ctx->sym_arena, sizeof(FieldList));
+      fl->sym = st->syms[i];
+      fl->next = NULL;
+      *tail = fl;
+      tail = &fl->next;
     }
   }
   return ret;
 }
 
 void FunDecLP() {
-  assert(local->hor == 0);
+  assert(ctx->local->hor == 0);
   Symtab_Push();
 }
 
 void FunDecRP(Symbol* sb) {
-  assert(local->hor == 0);
+  assert(ctx->local->hor == 0);
   assert(sb->skind == S_FUNCTIONNAME);
-  sb->pfunc->params = BuildFieldListFromSymtab(local);
+  sb->pfunc->params = BuildFieldListFromSymtab(ctx->local);
   Symtab_Pop();
 }
 
 void FunDecDotCompSt(Symbol* sb) {
-  assert(local->hor == 0);
+  assert(ctx->local->hor == 0);
   assert(sb->skind == S_FUNCTIONNAME);
   Symtab_Push();
   FieldList* fl = sb->pfunc->params;
@@ -207,14 +301,16 @@ void CompStDot() { Symtab_Pop(); }
 
 void StructSpecifierLC(Symbol* sb) {
   sb->pstruct->this_symtab =
-      Symtab_Create(local->hor + 1, local->vert, local, NULL);
-  local = sb->pstruct->this_symtab;
+      Symtab_Create(ctx->local->hor + 1, ctx->local->vert, ctx->local, NULL);
+  ctx->local = sb->pstruct->this_symtab;
 }
 
 void StructSpecifierRC() {
-  assert(local->hor > 0);
-  assert(local->hor_last_symtab);
-  local = local->hor_last_symtab;
+  assert(ctx->local->hor > 0);
+  assert(ctx->local->hor_last_symtab);
+  // 结构体的域不再可见, 但保留在表中用于构造结构体类型
+  Symtab_Unbind(ctx->local);
+  ctx->local = ctx->local->hor_last_symtab;
 }
 
 int BuildBiasFromFieldList(FieldList* fl) {
@@ -227,9 +323,9 @@ int BuildBiasFromFieldList(FieldList* fl) {
   return bias;
 }
 
-Type* BuildStructure(Symtab* st, char* stname) {
+Type* BuildStructure(Symtab* st, const char* stname) {
   assert(st->hor);
-  Type* type = malloc(sizeof(Type));
+  Type* type = Arena_Alloc(&ctx->sym_arena, sizeof(Type));
 
   type->tkind = T_STRUCTURE;
   // strcpy(type->tname, stname);
@@ -241,5 +337,5 @@ Type* BuildStructure(Symtab* st, char* stname) {
 
 int Symtab_mode() {
   // 根据当前符号表的水平坐标确定模式
-  return local->hor;
+  return ctx->local->hor;
 }
@@ -67,9 +67,20 @@ typedef struct Symtab Symtab;
 ------ 无：未定义错误
 */
 
+/*
+（四）实现：
+
+所有可见的符号都挂在同一张按名字(驻留指针)散列的表上, 同名符号新者在前
+-- 查找: 取桶中第一个同名绑定, 即最内层的可见符号, 平均O(1)
+-- 插入: 绑定挂到桶头, 同时记入当前作用域的syms
+-- 出作用域: 按syms逐个解除绑定, 结构体的表保留syms供构造域
+-- 表项过多时散列表加倍扩容, 没有符号个数上限
+*/
+
 // 外部接口
 extern void Symtab_Init();    // 初始化全局表
-extern void Symtab_Uninit();  // 反初始化
+extern void Symtab_Uninit();  // 反初始化, 散列桶留给下次编译
+extern void Symtab_Free();    // 释放散列桶和全部符号
 
 extern void FunDecLP();
 extern void FunDecRP(Symbol* sb);
@@ -79,12 +90,12 @@ extern void DotCompSt();
 extern void CompStDot();
 extern void StructSpecifierLC(Symbol* sb);
 extern void StructSpecifierRC();
-extern Type* BuildStructure(Symtab* st, char* stname);
+extern Type* BuildStructure(Symtab* st, const char* stname);
 
 extern int Symtab_mode();
 
 extern int Insert_Symtab(Symbol* sb);
-extern Symbol* Query_Symtab(char* sbname);
+extern Symbol* Query_Symtab(const char* sbname);
 
 /* 接口 */
 int type_equal(const Type* t1, const Type* t2);
@@ -102,7 +113,6 @@ struct Type {
   };
   int left_val;
   int type_size;
-  // char tname[MAX_NAME_LEN];
 };
 
 //变量
@@ -143,23 +153,26 @@ struct Symbol {
     StructName* pstruct;
     FuncName* pfunc;
   };
-  char sbname[MAX_NAME_LEN];
+  // 驻留后的名字, 可直接用 == 比较
+  const char* sbname;
   int dec_lineno;
 };
 
-// 符号表
+// 符号表(作用域)
+// 名字查找统一走symtab.c中的散列表, 这里只按插入顺序记录本作用域的符号,
+// 用于出作用域时解除绑定以及构造结构体的域和函数的参数列表
 struct Symtab {
   // 这里放变量，结构体名，函数名
   // 结构体名可以延伸出横向符号表
-  Symbol* syms[1024];
+  Symbol** syms;
   // 纵向移动
   Symtab* vert_last_symtab;
   // 横向移动
   Symtab* hor_last_symtab;
   // 当前符号表的的模式
   int vert, hor;
-  // 当前符号表的符号数量
-  int symcnt;
+  // 当前符号表的符号数量及容量
+  int symcnt, symcap;
 };
 
 #endif
\ No newline at end of file
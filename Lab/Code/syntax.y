@@ -1,16 +1,35 @@
 %{
     #include <stdio.h>
+    #include "compiler.h"
+    #include "lexical_syntax.h"
+    #include "pipeline.h"
 
-    extern int yylex();
-    extern void yyerror(char*);
-    extern struct ast* root;
-    extern struct ast* newnode(char* name, int num, ...);
     extern void eval(struct ast* node, int level);
 %}
 
+/* reentrant: the scanner carries all state */
+%define api.pure full
+%lex-param {void* scanner}
+%parse-param {void* scanner}
+
 /* declared types */
 %union {
     struct ast* a;
+    struct ast_list { struct ast *head, *tail; } list;  /* 列表的首尾结点 */
+}
+
+%code {
+    extern int yylex(YYSTYPE* lvalp, void* scanner);
+    extern void yyerror(void* scanner, const char* msg);
+
+    /* 把item接在列表的最后一项之后; 最后一项的children[1]是空列表 */
+    static void Append(struct ast_list* l, int kind, struct ast* item) {
+        struct ast* end = l->tail->num == -1 ? l->tail : l->tail->children[1];
+        struct ast* node = newnode(kind, 2, item, end);
+        if (l->head == end) l->head = node;
+        else l->tail->children[1] = node;
+        l->tail = node;
+    }
 }
 
 /* declared tokens*/
@@ -23,9 +42,10 @@
 %token <a> TYPE LP RP LB RB LC RC
 %token <a> STRUCT RETURN IF ELSE WHILE
 
-%type <a> Program ExtDefList ExtDef ExtDecList Specifier StructSpecifier 
-OptTag Tag VarDec FunDec VarList ParamDec CompSt StmtList Stmt 
-DefList Def DecList Dec Exp Args
+%type <list> ExtDefList StmtList DefList
+%type <a> Program ExtDef ExtDecList Specifier StructSpecifier 
+OptTag Tag VarDec FunDec VarList ParamDec CompSt Stmt 
+Def DecList Dec Exp Args
 
 /* priority */
 %right ASSIGNOP
@@ -49,104 +69,120 @@ DefList Def DecList Dec Exp Args
 
 /* high-level definitions*/
 
-Program : ExtDefList { root=newnode("Program", 1, $1); $$=root;}
-    ;
-ExtDefList : ExtDef ExtDefList      { $$=newnode("ExtDefList", 2, $1, $2); }
-    | /* empty */                   { $$=newnode("ExtDefList", -1); }
-    ;
-ExtDef : Specifier ExtDecList SEMI  { $$=newnode("ExtDef", 3, $1, $2, $3); }
-    | Specifier SEMI                                   { $$=newnode("ExtDef", 2, $1, $2); }
-    | Specifier FunDec SEMI              { $$=newnode("ExtDef", 3, $1, $2, $3); }
-    | Specifier FunDec CompSt       { $$=newnode("ExtDef", 3, $1, $2, $3); }
-    ;
-ExtDecList : VarDec             { $$=newnode("ExtDecList", 1, $1); }
-    | VarDec COMMA ExtDecList   { $$=newnode("ExtDecList", 3, $1, $2, $3); }
+Program : ExtDefList { ctx->root=newnode(N_PROGRAM, 1, $1.head); $$=ctx->root;}
+    ;
+/*
+左递归: 分析栈不随ExtDef的个数增长, 每个ExtDef归约后立即可用
+-- 语法树仍是 ExtDefList -> ExtDef ExtDefList 的右倾形状, 新的ExtDef
+   接在tail之后, 最后是空的ExtDefList; StmtList和DefList同样处理
+-- 流水线模式下ExtDef不进入语法树, 直接交给翻译线程; 没有读入向前看
+   符号时, 它的结点所在的块随之移交
+*/
+ExtDefList : ExtDefList ExtDef      {
+        $$=$1;
+        if (ctx->pipeline) {
+            Pipeline_Push(ctx->pipeline, $2, yychar == YYEMPTY);
+            /* 原来的空结点可能随块移交了 */
+            $$.head=$$.tail=newnode(N_EXTDEFLIST, -1);
+        } else {
+            Append(&$$, N_EXTDEFLIST, $2);
+        }
+    }
+    | /* empty */                   { $$.head=$$.tail=newnode(N_EXTDEFLIST, -1); }
+    ;
+ExtDef : Specifier ExtDecList SEMI  { $$=newnode(N_EXTDEF_VAR, 3, $1, $2, $3); }
+    | Specifier SEMI                                   { $$=newnode(N_EXTDEF_STRUCT, 2, $1, $2); }
+    | Specifier FunDec SEMI              { $$=newnode(N_EXTDEF_FUNDEC, 3, $1, $2, $3); }
+    | Specifier FunDec CompSt       { $$=newnode(N_EXTDEF_FUNC, 3, $1, $2, $3); }
+    ;
+ExtDecList : VarDec             { $$=newnode(N_EXTDECLIST, 1, $1); }
+    | VarDec COMMA ExtDecList   { $$=newnode(N_EXTDECLIST, 3, $1, $2, $3); }
     ;
 
 /* specifiers*/
-Specifier : TYPE        { $$=newnode("Specifier", 1, $1); }
-    | StructSpecifier   { $$=newnode("Specifier", 1, $1); }
+Specifier : TYPE        { $$=newnode(N_SPECIFIER_TYPE, 1, $1); }
+    | StructSpecifier   { $$=newnode(N_SPECIFIER_STRUCT, 1, $1); }
     ;
-StructSpecifier : STRUCT OptTag LC DefList RC       { $$=newnode("StructSpecifier", 5, $1, $2, $3, $4, $5); }
-    | STRUCT Tag        { $$=newnode("StructSpecifier", 2, $1, $2); }
+StructSpecifier : STRUCT OptTag LC DefList RC       { $$=newnode(N_STRUCTSPECIFIER_DEF, 5, $1, $2, $3, $4.head, $5); }
+    | STRUCT Tag        { $$=newnode(N_STRUCTSPECIFIER_TAG, 2, $1, $2); }
     | STRUCT OptTag LC error RC                     { }
     ;
-OptTag : ID             { $$=newnode("OptTag", 1, $1); }
-    | /* empty */       { $$=newnode("OptTag", -1); }
+OptTag : ID             { $$=newnode(N_OPTTAG, 1, $1); }
+    | /* empty */       { $$=newnode(N_OPTTAG, -1); }
     ;
-Tag : ID                { $$=newnode("Tag", 1, $1); }
+Tag : ID                { $$=newnode(N_TAG, 1, $1); }
     ;
 
 /* declarators */
-VarDec : ID                         { $$=newnode("VarDec", 1, $1); }
-    | VarDec LB INT RB              { $$=newnode("VarDec", 4, $1, $2, $3, $4); }
+VarDec : ID                         { $$=newnode(N_VARDEC, 1, $1); }
+    | VarDec LB INT RB              { $$=newnode(N_VARDEC, 4, $1, $2, $3, $4); }
     ;
-FunDec : ID LP VarList RP           { $$=newnode("FunDec", 4, $1, $2, $3, $4); }
-    | ID LP RP                      { $$=newnode("FunDec", 3, $1, $2, $3); }
+FunDec : ID LP VarList RP           { $$=newnode(N_FUNDEC, 4, $1, $2, $3, $4); }
+    | ID LP RP                      { $$=newnode(N_FUNDEC, 3, $1, $2, $3); }
     | ID LP error RP                { }
     ;
-VarList : ParamDec %prec LOWER_THAN_COMMA   { $$=newnode("VarList", 1, $1); }
-    | ParamDec COMMA VarList        { $$=newnode("VarList", 3, $1, $2, $3); }
+VarList : ParamDec %prec LOWER_THAN_COMMA   { $$=newnode(N_VARLIST, 1, $1); }
+    | ParamDec COMMA VarList        { $$=newnode(N_VARLIST, 3, $1, $2, $3); }
     ;
-ParamDec : Specifier VarDec         { $$=newnode("ParamDec", 2, $1, $2); }
+ParamDec : Specifier VarDec         { $$=newnode(N_PARAMDEC, 2, $1, $2); }
     ;
 
 /* statements */
-CompSt : LC DefList StmtList RC { $$=newnode("CompSt", 4, $1, $2, $3, $4); }
+CompSt : LC DefList StmtList RC { $$=newnode(N_COMPST, 4, $1, $2.head, $3.head, $4); }
     | error RC                   { }
     ;
-StmtList : Stmt StmtList            { $$=newnode("StmtList", 2, $1, $2); }
-    | /* empty */                   { $$=newnode("StmtList", -1); }
+StmtList : StmtList Stmt            { $$=$1; Append(&$$, N_STMTLIST, $2); }
+    | /* empty */                   { $$.head=$$.tail=newnode(N_STMTLIST, -1); }
     ;
-Stmt : Exp SEMI                                 { $$=newnode("Stmt", 2, $1, $2); }
-    | CompSt                                    { $$=newnode("Stmt", 1, $1); }
-    | RETURN Exp SEMI                           { $$=newnode("Stmt", 3, $1, $2, $3); }
-    | IF LP Exp RP Stmt %prec LOWER_THAN_ELSE   { $$=newnode("Stmt", 5, $1, $2, $3, $4, $5); }
-    | IF LP Exp RP Stmt ELSE Stmt               { $$=newnode("Stmt", 7, $1, $2, $3, $4, $5, $6, $7); }
+Stmt : Exp SEMI                                 { $$=newnode(N_STMT_EXP, 2, $1, $2); }
+    | CompSt                                    { $$=newnode(N_STMT_COMPST, 1, $1); }
+    | RETURN Exp SEMI                           { $$=newnode(N_STMT_RETURN, 3, $1, $2, $3); }
+    | IF LP Exp RP Stmt %prec LOWER_THAN_ELSE   { $$=newnode(N_STMT_IF, 5, $1, $2, $3, $4, $5); }
+    | IF LP Exp RP Stmt ELSE Stmt               { $$=newnode(N_STMT_IFELSE, 7, $1, $2, $3, $4, $5, $6, $7); }
     | IF LP Exp RP error ELSE Stmt              { }
-    | WHILE LP Exp RP Stmt                      { $$=newnode("Stmt", 5, $1, $2, $3, $4, $5); }
+    | WHILE LP Exp RP Stmt                      { $$=newnode(N_STMT_WHILE, 5, $1, $2, $3, $4, $5); }
     | WHILE LP error RP Stmt                    { }
     | error SEMI                                { }
     ;
 
 /* local definitions */
-DefList : Def DefList       { $$=newnode("DefList", 2, $1, $2); }
-    | /* empty */           { $$=newnode("DefList", -1); }
+DefList : DefList Def       { $$=$1; Append(&$$, N_DEFLIST, $2); }
+    | /* empty */           { $$.head=$$.tail=newnode(N_DEFLIST, -1); }
     ;
-Def : Specifier DecList SEMI    { $$=newnode("Def", 3, $1, $2, $3); } 
+Def : Specifier DecList SEMI    { $$=newnode(N_DEF, 3, $1, $2, $3); } 
     | Specifier error SEMI  { }
     ;
-DecList : Dec               { $$=newnode("DecList", 1, $1); }
-    | Dec COMMA DecList     { $$=newnode("DecList", 3, $1, $2, $3); }
+DecList : Dec               { $$=newnode(N_DECLIST, 1, $1); }
+    | Dec COMMA DecList     { $$=newnode(N_DECLIST, 3, $1, $2, $3); }
     ;
-Dec : VarDec                { $$=newnode("Dec", 1, $1); }
-    | VarDec ASSIGNOP Exp   { $$=newnode("Dec", 3, $1, $2, $3); }
+Dec : VarDec                { $$=newnode(N_DEC, 1, $1); }
+    | VarDec ASSIGNOP Exp   { $$=newnode(N_DEC, 3, $1, $2, $3); }
     ;
 
 /* expressions */
 
-Exp : Exp ASSIGNOP Exp  { $$=newnode("Exp", 3, $1, $2, $3); }
-    | Exp AND Exp       { $$=newnode("Exp", 3, $1, $2, $3); }
-    | Exp OR Exp        { $$=newnode("Exp", 3, $1, $2, $3); }
-    | Exp RELOP Exp     { $$=newnode("Exp", 3, $1, $2, $3); }
-    | Exp PLUS Exp      { $$=newnode("Exp", 3, $1, $2, $3); }
-    | Exp MINUS Exp     { $$=newnode("Exp", 3, $1, $2, $3); }
-    | Exp STAR Exp      { $$=newnode("Exp", 3, $1, $2, $3); }
-    | Exp DIV Exp       { $$=newnode("Exp", 3, $1, $2, $3); }
-    | LP Exp RP         { $$=newnode("Exp", 3, $1, $2, $3); }
-    | MINUS Exp %prec UMINUS    { $$=newnode("Exp", 2, $1, $2); }
-    | NOT Exp           { $$=newnode("Exp", 2, $1, $2); }
-    | ID LP Args RP     { $$=newnode("Exp", 4, $1, $2, $3, $4); }
-    | ID LP RP          { $$=newnode("Exp", 3, $1, $2, $3); }
-    | Exp LB Exp RB     { $$=newnode("Exp", 4, $1, $2, $3, $4); }
-    | Exp DOT ID        { $$=newnode("Exp", 3, $1, $2, $3); }
-    | ID                { $$=newnode("Exp", 1, $1); }
-    | INT               { $$=newnode("Exp", 1, $1); }
-    | FLOAT             { $$=newnode("Exp", 1, $1); }
-    ;
-
-Args : Exp COMMA Args   { $$=newnode("Args", 3, $1, $2, $3); }
-    | Exp               { $$=newnode("Args", 1, $1); }
+Exp : Exp ASSIGNOP Exp  { $$=newnode(N_EXP_ASSIGNOP, 3, $1, $2, $3); }
+    | Exp AND Exp       { $$=newnode(N_EXP_AND, 3, $1, $2, $3); }
+    | Exp OR Exp        { $$=newnode(N_EXP_OR, 3, $1, $2, $3); }
+    | Exp RELOP Exp     { $$=newnode(N_EXP_RELOP, 3, $1, $2, $3); }
+    | Exp PLUS Exp      { $$=newnode(N_EXP_PLUS, 3, $1, $2, $3); }
+    | Exp MINUS Exp     { $$=newnode(N_EXP_MINUS, 3, $1, $2, $3); }
+    | Exp STAR Exp      { $$=newnode(N_EXP_STAR, 3, $1, $2, $3); }
+    | Exp DIV Exp       { $$=newnode(N_EXP_DIV, 3, $1, $2, $3); }
+    | LP Exp RP         { $$=newnode(N_EXP_PAREN, 3, $1, $2, $3); }
+    | MINUS Exp %prec UMINUS    { $$=newnode(N_EXP_NEG, 2, $1, $2); }
+    | NOT Exp           { $$=newnode(N_EXP_NOT, 2, $1, $2); }
+    | ID LP Args RP     { $$=newnode(N_EXP_CALL, 4, $1, $2, $3, $4); }
+    | ID LP RP          { $$=newnode(N_EXP_CALL, 3, $1, $2, $3); }
+    | Exp LB Exp RB     { $$=newnode(N_EXP_INDEX, 4, $1, $2, $3, $4); }
+    | Exp DOT ID        { $$=newnode(N_EXP_DOT, 3, $1, $2, $3); }
+    | ID                { $$=newnode(N_EXP_ID, 1, $1); }
+    | INT               { $$=newnode(N_EXP_INT, 1, $1); }
+    | FLOAT             { $$=newnode(N_EXP_FLOAT, 1, $1); }
+    ;
+
+Args : Exp COMMA Args   { $$=newnode(N_ARGS, 3, $1, $2, $3); }
+    | Exp               { $$=newnode(N_ARGS, 1, $1); }
     ;
 
 
@@ -0,0 +1,481 @@
+#define _POSIX_C_SOURCE 199309L
+#include "vm.h"
+
+#include "assert.h"
+#include "opt.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+// 解释器的操作码, IF按比较运算符分开
+enum {
+  V_ASSIGN,
+  V_ADD,
+  V_SUB,
+  V_MUL,
+  V_DIV,
+  V_ADDR,
+  V_LOAD,
+  V_STORE,
+  V_GOTO,
+  V_IFEQ,
+  V_IFNE,
+  V_IFLT,
+  V_IFGT,
+  V_IFLE,
+  V_IFGE,
+  V_DEC,
+  V_ARG,
+  V_CALL,
+  V_READ,
+  V_WRITE,
+  V_END,  // 执行到函数末尾, 返回0且不计数
+  V_RETURN,
+  V_NUM
+};
+
+typedef struct VmInstr VmInstr;
+typedef struct VmFunc VmFunc;
+
+struct VmInstr {
+  const void* h;  // threaded时处理代码的地址
+  int op;
+  int x, y, z;  // 帧中的字偏移, DEC的z为字数
+  union {
+    const VmInstr* to;  // 跳转目标
+    VmFunc* callee;
+    int index;  // 解析之前的目标下标
+  };
+  const char* name;  // 被调用的函数名
+};
+
+struct VmFunc {
+  const char* name;
+  VmInstr* code;
+  int len;
+  int names;           // 需要清零的名字数
+  int frame;           // 帧的字数
+  int *param, nparam;  // 形参在帧中的偏移
+  int *consts, cbase, nconst;  // 常量放在帧的 [cbase, cbase + nconst)
+};
+
+typedef struct Ret {
+  const VmInstr* pc;  // 返回后执行的指令
+  const VmFunc* f;
+  int fp, dest;
+} Ret;
+
+typedef struct VM {
+  int* mem;  // 平坦的内存, 按字
+  int cap, sp;
+  int *args, nargs, argcap;
+  Ret* rets;
+  int nret, retcap;
+  FILE *in, *out;
+  long long count;  // 执行的指令数
+} VM;
+
+// 帧所在内存的上限(字), 与JIT的STACK_LIMIT相同, 超过时为栈溢出
+#define MEM_LIMIT (0x7FF00000 / 4)
+// 调用深度的上限, 返回信息最多占1GB, 与JIT的机器栈相同
+#define DEPTH_LIMIT (1 << 25)
+
+// 扩大到至少need个元素, 超过max或分配失败时返回NULL, p不变
+static void* Grow(void* p, int* cap, int need, int max, size_t size) {
+  if (need <= *cap) return p;
+  if (need > max) return NULL;
+  int n = *cap ? *cap : 1024;
+  while (n < need) n = n > max / 2 ? max : 2 * n;
+  void* q = realloc(p, (size_t)n * size);
+  if (q) *cap = n;
+  return q;
+}
+
+/* 翻译 */
+
+typedef struct Builder {
+  VmFunc* vf;
+  OpMap m;
+  int* off;            // 名字 -> 帧偏移
+  int *ctable, cmask;  // 常量 -> consts下标的散列表
+} Builder;
+
+static int Const_Slot(Builder* b, int v) {
+  VmFunc* vf = b->vf;
+  unsigned h = (unsigned)v * 2654435761u;
+  for (;; h++) {
+    int* e = &b->ctable[h & b->cmask];
+    if (*e < 0) {
+      *e = vf->nconst;
+      vf->consts[vf->nconst++] = v;
+      return vf->cbase + *e;
+    }
+    if (vf->consts[*e] == v) return vf->cbase + *e;
+  }
+}
+
+static int Slot(Builder* b, Operand op) {
+  switch (op.kind) {
+    case O_TEMP:
+    case O_VAR:
+      return b->off[OpMap_Index(&b->m, op)];
+    case O_CONST:
+      return Const_Slot(b, op.ival);
+    case O_FCONST:
+      return Const_Slot(b, (int)op.fval);
+    default:
+      return 0;
+  }
+}
+
+static void Build_Func(VmFunc* vf, const IRFunc* func) {
+  Builder b;
+  b.vf = vf;
+  OpMap_Init(&b.m, func);
+  int size = OpMap_Size(&b.m), n = func->len;
+  vf->name = func->name;
+  vf->names = size;
+
+  // 帧: 名字, DEC的区域, 常量
+  b.off = malloc((size + 1) * sizeof(int));
+  for (int j = 0; j < size; j++) b.off[j] = j;
+  vf->frame = size;
+  int lmax = 0, nop = 0;
+  for (int i = 0; i < n; i++) {
+    const Instr* in = &func->code[i];
+    if (in->op == IR_DEC) {
+      b.off[OpMap_Index(&b.m, in->x)] = vf->frame;
+      vf->frame += (in->y.ival + 3) / 4;
+    }
+    if (in->op == IR_LABEL && in->x.no > lmax) lmax = in->x.no;
+    for (int k = 0; k < 3; k++)
+      if ((&in->x)[k].kind == O_CONST || (&in->x)[k].kind == O_FCONST) nop++;
+  }
+  vf->cbase = vf->frame;
+  vf->nconst = 0;
+  vf->consts = malloc((nop + 1) * sizeof(int));
+  int cap = 16;
+  while (cap < 2 * nop + 2) cap <<= 1;
+  b.ctable = malloc(cap * sizeof(int));
+  b.cmask = cap - 1;
+  for (int h = 0; h < cap; h++) b.ctable[h] = -1;
+  // 函数末尾返回的0
+  int zero = Const_Slot(&b, 0);
+
+  // 标号 -> 下一条解释器指令的下标
+  int* label = malloc((lmax + 1) * sizeof(int));
+  int len = 0;
+  vf->nparam = 0;
+  for (int i = 0; i < n; i++) {
+    int op = func->code[i].op;
+    if (op == IR_LABEL)
+      label[func->code[i].x.no] = len;
+    else if (op == IR_PARAM)
+      vf->nparam++;
+    else if (op != IR_NOP)
+      len++;
+  }
+
+  vf->code = calloc(len + 1, sizeof(VmInstr));
+  vf->param = malloc((vf->nparam + 1) * sizeof(int));
+  vf->len = len + 1;
+  int k = 0, p = 0;
+  for (int i = 0; i < n; i++) {
+    const Instr* in = &func->code[i];
+    VmInstr* v = &vf->code[k];
+    switch (in->op) {
+      case IR_LABEL:
+      case IR_NOP:
+        continue;
+      case IR_PARAM:
+        vf->param[p++] = Slot(&b, in->x);
+        continue;
+      case IR_ASSIGN:
+      case IR_ADD:
+      case IR_SUB:
+      case IR_MUL:
+      case IR_DIV:
+      case IR_LOAD:
+        v->op = V_ASSIGN + in->op - IR_ASSIGN;
+        v->x = Slot(&b, in->x);
+        v->y = Slot(&b, in->y);
+        v->z = Slot(&b, in->z);
+        break;
+      case IR_ADDR:
+        v->op = V_ADDR;
+        v->x = Slot(&b, in->x);
+        v->y = Slot(&b, in->y);
+        break;
+      case IR_STORE:
+        v->op = V_STORE;
+        v->x = Slot(&b, in->x);
+        v->y = Slot(&b, in->y);
+        break;
+      case IR_GOTO:
+        v->op = V_GOTO;
+        v->index = label[in->x.no];
+        break;
+      case IR_IF:
+        v->op = V_IFEQ + in->relop;
+        v->y = Slot(&b, in->y);
+        v->z = Slot(&b, in->z);
+        v->index = label[in->x.no];
+        break;
+      case IR_DEC:
+        v->op = V_DEC;
+        v->x = Slot(&b, in->x);
+        v->z = (in->y.ival + 3) / 4;
+        break;
+      case IR_CALL:
+        v->op = V_CALL;
+        v->x = Slot(&b, in->x);
+        v->name = in->y.name;
+        break;
+      case IR_RETURN:
+      case IR_ARG:
+      case IR_READ:
+      case IR_WRITE:
+        v->op = in->op == IR_RETURN ? V_RETURN
+                : in->op == IR_ARG  ? V_ARG
+                : in->op == IR_READ ? V_READ
+                                    : V_WRITE;
+        v->x = Slot(&b, in->x);
+        break;
+      default:
+        assert(0);
+    }
+    k++;
+  }
+  vf->code[k].op = V_END;
+  vf->code[k].x = zero;
+  vf->frame = vf->cbase + vf->nconst;
+
+  for (int i = 0; i < k; i++) {
+    VmInstr* v = &vf->code[i];
+    if (v->op == V_GOTO || (v->op >= V_IFEQ && v->op <= V_IFGE))
+      v->to = &vf->code[v->index];
+  }
+  free(label);
+  free(b.off);
+  free(b.ctable);
+}
+
+/* 执行 */
+
+static void Runtime_Error(const VmFunc* f, const char* msg) {
+  fprintf(stderr, "runtime error in %s: %s\n", f->name, msg);
+}
+
+// 在栈顶建立f的帧, 形参取自ARG, 返回帧的起点; 栈溢出返回-1
+static int Enter(VM* vm, const VmFunc* f) {
+  int fp = vm->sp;
+  if (f->frame > MEM_LIMIT - fp) return -1;
+  int* mem = Grow(vm->mem, &vm->cap, fp + f->frame, MEM_LIMIT, sizeof(int));
+  if (!mem) return -1;
+  vm->mem = mem;
+  int* F = mem + fp;
+  memset(F, 0, f->names * sizeof(int));
+  memcpy(F + f->cbase, f->consts, f->nconst * sizeof(int));
+  // 最后一个ARG是第一个形参
+  for (int p = 0; p < f->nparam; p++)
+    F[f->param[p]] = p < vm->nargs ? vm->args[vm->nargs - 1 - p] : 0;
+  vm->nargs = 0;
+  vm->sp = fp + f->frame;
+  return fp;
+}
+
+#ifdef __GNUC__
+#define CASE(op) L_##op:
+#define DISPATCH() goto* pc->h
+#else
+#define CASE(op) case op:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() \
+  do {           \
+    count++;     \
+    pc++;        \
+    DISPATCH();  \
+  } while (0)
+#define JUMP(cond)                 \
+  do {                             \
+    count++;                       \
+    pc = (cond) ? pc->to : pc + 1; \
+    DISPATCH();                    \
+  } while (0)
+// 字节地址 -> 内存中的字, 不在活跃的帧中(当前帧的末尾之上)为NULL
+#define MEM(addr)                                                   \
+  ((unsigned)(addr) >> 2 < (unsigned)vm->sp ? &vm->mem[(unsigned)(addr) >> 2] \
+                                            : NULL)
+
+static int Exec(VM* vm, VmFunc* funcs, int nfunc, VmFunc* entry) {
+#ifdef __GNUC__
+  static const void* handlers[V_NUM] = {
+      &&L_V_ASSIGN, &&L_V_ADD,  &&L_V_SUB,   &&L_V_MUL,   &&L_V_DIV,
+      &&L_V_ADDR,   &&L_V_LOAD, &&L_V_STORE, &&L_V_GOTO,  &&L_V_IFEQ,
+      &&L_V_IFNE,   &&L_V_IFLT, &&L_V_IFGT,  &&L_V_IFLE,  &&L_V_IFGE,
+      &&L_V_DEC,    &&L_V_ARG,  &&L_V_CALL,  &&L_V_READ,  &&L_V_WRITE,
+      &&L_V_END,    &&L_V_RETURN};
+  for (int k = 0; k < nfunc; k++)
+    for (int i = 0; i < funcs[k].len; i++)
+      funcs[k].code[i].h = handlers[funcs[k].code[i].op];
+#else
+  (void)funcs, (void)nfunc;
+#endif
+  long long count = 0;
+  const VmFunc* f = entry;
+  int fp = Enter(vm, f);
+  if (fp < 0) goto overflow;
+  int* F = vm->mem + fp;
+  const VmInstr* pc = f->code;
+  int* p;
+  DISPATCH();
+#ifndef __GNUC__
+dispatch:
+  switch (pc->op) {
+#endif
+    CASE(V_ASSIGN) F[pc->x] = F[pc->y];
+    NEXT();
+    CASE(V_ADD) F[pc->x] = (int)((unsigned)F[pc->y] + (unsigned)F[pc->z]);
+    NEXT();
+    CASE(V_SUB) F[pc->x] = (int)((unsigned)F[pc->y] - (unsigned)F[pc->z]);
+    NEXT();
+    CASE(V_MUL) F[pc->x] = (int)((unsigned)F[pc->y] * (unsigned)F[pc->z]);
+    NEXT();
+    CASE(V_DIV) {
+      int a = F[pc->y], d = F[pc->z];
+      if (!d) {
+        Runtime_Error(f, "division by zero");
+        goto fail;
+      }
+      F[pc->x] = d == -1 ? (int)(0u - (unsigned)a) : a / d;
+      NEXT();
+    }
+    CASE(V_ADDR) F[pc->x] = (int)((unsigned)(F + pc->y - vm->mem) << 2);
+    NEXT();
+    CASE(V_LOAD) if (!(p = MEM(F[pc->y]))) goto bad_address;
+    F[pc->x] = *p;
+    NEXT();
+    CASE(V_STORE) if (!(p = MEM(F[pc->x]))) goto bad_address;
+    *p = F[pc->y];
+    NEXT();
+    CASE(V_GOTO) JUMP(1);
+    CASE(V_IFEQ) JUMP(F[pc->y] == F[pc->z]);
+    CASE(V_IFNE) JUMP(F[pc->y] != F[pc->z]);
+    CASE(V_IFLT) JUMP(F[pc->y] < F[pc->z]);
+    CASE(V_IFGT) JUMP(F[pc->y] > F[pc->z]);
+    CASE(V_IFLE) JUMP(F[pc->y] <= F[pc->z]);
+    CASE(V_IFGE) JUMP(F[pc->y] >= F[pc->z]);
+    CASE(V_DEC) memset(F + pc->x, 0, pc->z * sizeof(int));
+    NEXT();
+    CASE(V_ARG) {
+      int* args = Grow(vm->args, &vm->argcap, vm->nargs + 1, MEM_LIMIT,
+                       sizeof(int));
+      if (!args) goto overflow;
+      vm->args = args;
+      vm->args[vm->nargs++] = F[pc->x];
+      NEXT();
+    }
+    CASE(V_CALL) {
+      if (!pc->callee) {
+        Runtime_Error(f, "call to undefined function");
+        goto fail;
+      }
+      Ret* rets = Grow(vm->rets, &vm->retcap, vm->nret + 1, DEPTH_LIMIT,
+                       sizeof(Ret));
+      if (!rets) goto overflow;
+      vm->rets = rets;
+      vm->rets[vm->nret++] = (Ret){pc + 1, f, fp, pc->x};
+      f = pc->callee;
+      fp = Enter(vm, f);
+      if (fp < 0) goto overflow;
+      F = vm->mem + fp;
+      count += 1 + f->nparam;
+      pc = f->code;
+      DISPATCH();
+    }
+    CASE(V_READ) {
+      int v = 0;
+      if (fscanf(vm->in, "%d", &v) != 1) v = 0;
+      F[pc->x] = v;
+      NEXT();
+    }
+    CASE(V_WRITE) fprintf(vm->out, "%d\n", F[pc->x]);
+    NEXT();
+    CASE(V_END) count--;
+    CASE(V_RETURN) {
+      int v = F[pc->x];
+      count++;
+      if (!vm->nret) {
+        vm->count = count;
+        return 0;
+      }
+      const Ret* r = &vm->rets[--vm->nret];
+      vm->sp = fp;
+      fp = r->fp;
+      F = vm->mem + fp;
+      F[r->dest] = v;
+      pc = r->pc;
+      f = r->f;
+      DISPATCH();
+    }
+#ifndef __GNUC__
+  }
+#endif
+bad_address:
+  Runtime_Error(f, "bad address");
+  goto fail;
+overflow:
+  Runtime_Error(f, "stack overflow");
+fail:
+  vm->count = count;
+  return 1;
+}
+
+int VM_Run(FILE* in, FILE* out, FILE* report) {
+  int nfunc = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next) nfunc++;
+  VmFunc* funcs = calloc(nfunc + 1, sizeof(VmFunc));
+  int k = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next)
+    Build_Func(&funcs[k++], func);
+  // 解析被调用的函数, 函数名已驻留, 直接比较指针
+  VmFunc* entry = NULL;
+  for (k = 0; k < nfunc; k++) {
+    if (!strcmp(funcs[k].name, "main")) entry = &funcs[k];
+    for (int i = 0; i < funcs[k].len; i++) {
+      VmInstr* v = &funcs[k].code[i];
+      if (v->op != V_CALL) continue;
+      v->callee = NULL;
+      for (int c = 0; c < nfunc && !v->callee; c++)
+        if (funcs[c].name == v->name) v->callee = &funcs[c];
+    }
+  }
+
+  int status = 1;
+  VM vm = {0};
+  vm.in = in;
+  vm.out = out;
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if (entry)
+    status = Exec(&vm, funcs, nfunc, entry);
+  else
+    fprintf(stderr, "runtime error: no main function\n");
+  fflush(out);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if (report)
+    fprintf(report, "run      instructions %lld, time %.3f s\n", vm.count,
+            (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+
+  for (k = 0; k < nfunc; k++) {
+    free(funcs[k].code);
+    free(funcs[k].param);
+    free(funcs[k].consts);
+  }
+  free(funcs);
+  free(vm.mem);
+  free(vm.args);
+  free(vm.rets);
+  return status;
+}
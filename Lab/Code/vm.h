@@ -0,0 +1,26 @@
+#ifndef VM_H
+#define VM_H
+
+#include "ir.h"
+#include "stdio.h"
+
+/*
+中间代码解释器:
+-- 执行前把每个函数翻译成紧凑的指令数组: 标号换成指令下标, PARAM
+   并入CALL, 每个操作数都是栈帧中的字偏移(常量也放在帧里)
+-- 栈帧依次是各个名字, DEC的数组和结构体, 常量; 所有帧在一块平坦的
+   内存中, 地址为字节偏移, 可以在函数之间传递
+-- 进入函数时名字清零, DEC执行时把它的区域清零, 与模拟器一致
+-- 访存的地址须在活跃的帧中, 即低于当前帧的末尾, 否则为bad address;
+   JIT和x86-64本地代码的检查与此相同
+-- 帧所在的内存不超过约2GB, 返回信息不超过1GB(与JIT相同), 超过或分配
+   失败时报栈溢出
+-- GCC下用computed goto逐条跳转(threaded), 否则退回switch
+-- 计数与模拟器相同: 不计LABEL, 每个PARAM计一条
+*/
+
+// 从main开始执行, READ读in, WRITE写out; 出错返回非零
+// report非空时输出执行的指令数和用时
+extern int VM_Run(FILE* in, FILE* out, FILE* report);
+
+#endif
@@ -0,0 +1,604 @@
+#include "x86.h"
+
+#include "assert.h"
+#include "cfg.h"
+#include "ir.h"
+#include "liveness.h"
+#include "opt.h"
+#include "regalloc.h"
+#include "stdlib.h"
+#include "string.h"
+
+// 寄存器编号
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+static const char* const r32[16] = {
+    "%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi",  "%edi",
+    "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"};
+static const char* const r64[16] = {
+    "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+    "%r8",  "%r9",  "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
+
+// 有调用的函数的分配顺序, 前NCALLEE个由被调用者保存; 叶函数从
+// 调用者保存的开始
+#define NREG 10
+#define NCALLEE 4
+static const int alloc_regs[NREG] = {RBX, R12, R13, R14, R10,
+                                     R11, RSI, RDI, R8,  R9};
+static const int arg_regs[6] = {RDI, RSI, RDX, RCX, R8, R9};
+#define STACK_TOP 0x7FFF0000  // 栈顶相对%r15的偏移
+static const char* const jcc[] = {"je", "jne", "jl", "jg", "jle", "jge"};
+static const int swap_relop[] = {RELOP_EQ, RELOP_NE, RELOP_GT,
+                                 RELOP_LT, RELOP_GE, RELOP_LE};
+
+static const char* runtime =
+    "\n"
+    "  .section .rodata\n"
+    ".Lcmm.in: .string \"%d\"\n"
+    ".Lcmm.out: .string \"%d\\n\"\n"
+    ".Lcmm.div: .string \"runtime error: division by zero\\n\"\n"
+    ".Lcmm.stack: .string \"runtime error: stack overflow\\n\"\n"
+    ".Lcmm.nomem: .string \"runtime error: cannot allocate stack\\n\"\n"
+    ".Lcmm.addr: .string \"runtime error: bad address\\n\"\n"
+    "  .data\n"
+    "  .align 8\n"
+    "cmm.stack_limit: .quad 0\n"
+    "cmm.sp: .quad 0\n"
+    "  .text\n"
+    "  .globl main\n"
+    "main:\n"
+    "  pushq %rbx\n"
+    "  pushq %r15\n"
+    "  subq $8, %rsp\n"
+    "  movq %rsp, cmm.sp(%rip)\n"
+    "  movl $11, %edi\n"  // SIGSEGV
+    "  leaq cmm.bad_address(%rip), %rsi\n"
+    "  call signal@PLT\n"
+    "  xorl %edi, %edi\n"
+    "  movl $0x40000000, %esi\n"  // 1GB
+    "  movl $3, %edx\n"       // PROT_READ | PROT_WRITE
+    "  movl $0x4022, %ecx\n"  // MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+    "  movl $-1, %r8d\n"
+    "  xorl %r9d, %r9d\n"
+    "  call mmap@PLT\n"
+    "  leaq .Lcmm.nomem(%rip), %rdi\n"
+    "  cmpq $-1, %rax\n"
+    "  je cmm.fail\n"
+    "  leaq 0x10000(%rax), %rcx\n"  // 栈底留给运行时错误的处理
+    "  movq %rcx, cmm.stack_limit(%rip)\n"
+    "  leaq 0x40000000(%rax), %rsp\n"
+    "  leaq -0x7FFF0000(%rsp), %r15\n"  // 栈中的地址都在%r15之上2GB内
+    "  call cmm_main\n"
+    "  movq cmm.sp(%rip), %rsp\n"
+    "  xorl %eax, %eax\n"
+    "  addq $8, %rsp\n"
+    "  popq %r15\n"
+    "  popq %rbx\n"
+    "  ret\n"
+    "\n"
+    "cmm.read:\n"
+    "  subq $24, %rsp\n"
+    "  movl $0, 12(%rsp)\n"
+    "  leaq 12(%rsp), %rsi\n"
+    "  leaq .Lcmm.in(%rip), %rdi\n"
+    "  xorl %eax, %eax\n"
+    "  call scanf@PLT\n"
+    "  movl 12(%rsp), %eax\n"
+    "  addq $24, %rsp\n"
+    "  ret\n"
+    "\n"
+    "cmm.write:\n"
+    "  subq $8, %rsp\n"
+    "  movl %edi, %esi\n"
+    "  leaq .Lcmm.out(%rip), %rdi\n"
+    "  xorl %eax, %eax\n"
+    "  call printf@PLT\n"
+    "  addq $8, %rsp\n"
+    "  ret\n"
+    "\n"
+    "cmm.div_zero:\n"
+    "  leaq .Lcmm.div(%rip), %rdi\n"
+    "  jmp cmm.fail\n"
+    "cmm.bad_address:\n"
+    "  leaq .Lcmm.addr(%rip), %rdi\n"
+    "  jmp cmm.fail\n"
+    "cmm.stack_overflow:\n"
+    "  leaq .Lcmm.stack(%rip), %rdi\n"
+    "cmm.fail:\n"  // %rdi为消息, 回到C的栈上输出后exit(1)
+    "  movq cmm.sp(%rip), %rsp\n"
+    "  movq stderr@GOTPCREL(%rip), %rsi\n"
+    "  movq (%rsi), %rsi\n"
+    "  call fputs@PLT\n"
+    "  movl $1, %edi\n"
+    "  call exit@PLT\n"
+    "\n"
+    "  .section .note.GNU-stack,\"\",@progbits\n";
+
+// 操作数的位置
+typedef struct Loc {
+  enum { L_REG, L_IMM, L_MEM } kind;
+  int v;  // 寄存器, 立即数, 或相对%rbp的偏移
+} Loc;
+
+typedef struct Move {
+  int dst;  // 寄存器
+  Loc src;
+} Move;
+
+typedef struct X86 {
+  FILE* fp;
+  IRFunc* func;
+  OpMap m;
+  char* taken;
+  int *home, *off;  // 名字 -> 寄存器, 不在寄存器中为-1; 名字 -> 帧中的偏移
+  int *lo, *hi;     // 活跃区间
+  int save[16];     // 寄存器 -> 保存的位置, 不用保存为0
+  int base;         // 帧的下界(相对%r15)在帧中的位置, 没有访存时为0
+  int nparam, frame;
+} X86;
+
+static __thread int local_labels;  // 除法, 清零循环等生成的标号
+
+static Loc Reg(int r) { return (Loc){L_REG, r}; }
+
+static Loc Loc_Of(const X86* g, Operand op) {
+  if (op.kind == O_CONST) return (Loc){L_IMM, op.ival};
+  if (op.kind == O_FCONST) return (Loc){L_IMM, (int)op.fval};
+  int k = OpMap_Index(&g->m, op);
+  return g->home[k] >= 0 ? Reg(g->home[k]) : (Loc){L_MEM, g->off[k]};
+}
+
+static int Callee_Saved(int r) { return r == RBX || (r >= R12 && r <= R14); }
+
+// 32位操作数的文本
+static const char* Text(Loc l, char* buf) {
+  if (l.kind == L_REG) return r32[l.v];
+  if (l.kind == L_IMM)
+    sprintf(buf, "$%d", l.v);
+  else
+    sprintf(buf, "%d(%%rbp)", l.v);
+  return buf;
+}
+
+// reg := src
+static void Mov_To(X86* g, int reg, Loc src) {
+  char b[32];
+  if (src.kind == L_REG && src.v == reg) return;
+  if (src.kind == L_IMM && !src.v)
+    fprintf(g->fp, "  xorl %s, %s\n", r32[reg], r32[reg]);
+  else
+    fprintf(g->fp, "  movl %s, %s\n", Text(src, b), r32[reg]);
+}
+
+// dst := src
+static void Move_Loc(X86* g, Loc dst, Loc src) {
+  char a[32], b[32];
+  if (dst.kind == L_REG) {
+    Mov_To(g, dst.v, src);
+    return;
+  }
+  if (src.kind == L_MEM) {
+    if (src.v == dst.v) return;
+    Mov_To(g, RAX, src);
+    src = Reg(RAX);
+  }
+  fprintf(g->fp, "  movl %s, %s\n", Text(src, a), Text(dst, b));
+}
+
+// 并行地把各src传到寄存器dst, 成环时借用%eax
+static void Parallel_Move(X86* g, Move* mv, int n) {
+  while (n > 0) {
+    int k;
+    for (k = 0; k < n; k++) {
+      int busy = 0;
+      for (int t = 0; t < n; t++)
+        if (t != k && mv[t].src.kind == L_REG && mv[t].src.v == mv[k].dst)
+          busy = 1;
+      if (!busy) break;
+    }
+    if (k == n) {
+      int d = mv[0].dst;
+      Mov_To(g, RAX, Reg(d));
+      for (int t = 0; t < n; t++)
+        if (mv[t].src.kind == L_REG && mv[t].src.v == d) mv[t].src.v = RAX;
+      continue;
+    }
+    Mov_To(g, mv[k].dst, mv[k].src);
+    mv[k] = mv[--n];
+  }
+}
+
+static int Call_Of(const IRFunc* func, int i) {
+  while (i < func->len && func->code[i].op == IR_ARG) i++;
+  return i < func->len && func->code[i].op == IR_CALL ? i : -1;
+}
+
+static int Is_Call(int op) {
+  return op == IR_CALL || op == IR_READ || op == IR_WRITE;
+}
+
+// 名字到寄存器和帧中的位置
+static void Layout(X86* g) {
+  IRFunc* func = g->func;
+  int size = OpMap_Size(&g->m), n = func->len, leaf = 1, access = 0;
+  for (int i = 0; i < n; i++) {
+    if (Is_Call(func->code[i].op)) leaf = 0;
+    if (func->code[i].op == IR_LOAD || func->code[i].op == IR_STORE) access = 1;
+  }
+
+  int* reg = RegAlloc_Linear(func, &g->m, g->taken, NREG);
+  for (int k = 0; k < size; k++)
+    g->home[k] =
+        reg[k] < 0 ? -1 : alloc_regs[leaf ? (reg[k] + NCALLEE) % NREG : reg[k]];
+  free(reg);
+
+  int used[16] = {0};
+  for (int k = 0; k < size; k++)
+    if (g->home[k] >= 0) used[g->home[k]] = 1;
+  g->frame = 0;
+  for (int r = 0; r < 16; r++) {
+    g->save[r] = 0;
+    if (used[r] && Callee_Saved(r)) g->save[r] = -(g->frame += 8);
+  }
+  for (int r = 0; r < 16; r++)
+    if (used[r] && !Callee_Saved(r) && !leaf) g->save[r] = -(g->frame += 4);
+
+  // 第7个起的形参用调用者放在栈上的位置
+  for (int k = 0; k < size; k++) g->off[k] = 0;
+  for (int p = 6; p < g->nparam; p++)
+    g->off[OpMap_Index(&g->m, func->code[p].x)] = 16 + 8 * (p - 6);
+  for (int i = 0; i < n; i++) {
+    const Instr* in = &func->code[i];
+    if (in->op == IR_DEC)
+      g->off[OpMap_Index(&g->m, in->x)] = -(g->frame += (in->y.ival + 3) & ~3);
+  }
+  for (int k = 0; k < size; k++)
+    if (g->home[k] < 0 && !g->off[k] && (g->hi[k] >= 0 || g->taken[k]))
+      g->off[k] = -(g->frame += 4);
+  g->base = access ? -(g->frame += 4) : 0;
+  g->frame = (g->frame + 15) & ~15;
+}
+
+static void Prologue(X86* g, const Liveness* lv) {
+  IRFunc* func = g->func;
+  fprintf(g->fp, "\ncmm_%s:\n", func->name);
+  fprintf(g->fp, "  pushq %%rbp\n  movq %%rsp, %%rbp\n");
+  if (g->frame) fprintf(g->fp, "  subq $%d, %%rsp\n", g->frame);
+  fprintf(g->fp, "  cmpq cmm.stack_limit(%%rip), %%rsp\n");
+  fprintf(g->fp, "  jb cmm.stack_overflow\n");
+  if (g->base) {
+    fprintf(g->fp, "  movq %%rsp, %%rax\n  subq %%r15, %%rax\n");
+    fprintf(g->fp, "  movl %%eax, %d(%%rbp)\n", g->base);
+  }
+  for (int r = 0; r < 16; r++)
+    if (g->save[r] && Callee_Saved(r))
+      fprintf(g->fp, "  movq %s, %d(%%rbp)\n", r64[r], g->save[r]);
+
+  // 形参从实参的寄存器并行地传到它的位置
+  Move mv[6];
+  int nmv = 0;
+  for (int p = 0; p < g->nparam && p < 6; p++) {
+    Loc h = Loc_Of(g, func->code[p].x);
+    if (h.kind == L_REG)
+      mv[nmv++] = (Move){h.v, Reg(arg_regs[p])};
+    else
+      Move_Loc(g, h, Reg(arg_regs[p]));
+  }
+  Parallel_Move(g, mv, nmv);
+  for (int p = 6; p < g->nparam; p++) {
+    Loc h = Loc_Of(g, func->code[p].x);
+    if (h.kind == L_REG) Mov_To(g, h.v, (Loc){L_MEM, 16 + 8 * (p - 6)});
+  }
+
+  // 进入时就活跃(先使用后定值)的名字和内存中的变量清零, DEC的区域
+  // 执行到DEC时清零
+  int size = OpMap_Size(&g->m);
+  char* skip = calloc(size + 1, 1);
+  for (int p = 0; p < g->nparam; p++)
+    skip[OpMap_Index(&g->m, func->code[p].x)] = 1;
+  for (int i = 0; i < func->len; i++)
+    if (func->code[i].op == IR_DEC)
+      skip[OpMap_Index(&g->m, func->code[i].x)] = 1;
+  for (int k = 0; k < size; k++) {
+    if (skip[k] || (!g->taken[k] && !(lv && Live_In(lv, 0, k)))) continue;
+    Move_Loc(g, g->home[k] >= 0 ? Reg(g->home[k]) : (Loc){L_MEM, g->off[k]},
+             (Loc){L_IMM, 0});
+  }
+  free(skip);
+}
+
+// 访存的地址须在活跃的帧中: 不低于当前帧的下界, 低于栈顶
+static void Check_Address(X86* g, int idx) {
+  fprintf(g->fp, "  cmpl %d(%%rbp), %s\n  jb cmm.bad_address\n", g->base,
+          r32[idx]);
+  fprintf(g->fp, "  cmpl $0x%X, %s\n  jae cmm.bad_address\n", STACK_TOP,
+          r32[idx]);
+}
+
+static void Epilogue(X86* g) {
+  for (int r = 0; r < 16; r++)
+    if (g->save[r] && Callee_Saved(r))
+      fprintf(g->fp, "  movq %d(%%rbp), %s\n", g->save[r], r64[r]);
+  fprintf(g->fp, "  leave\n  ret\n");
+}
+
+static void Binary(X86* g, const Instr* in) {
+  static const char* const ops[] = {
+      [IR_ADD] = "addl", [IR_SUB] = "subl", [IR_MUL] = "imull"};
+  Loc x = Loc_Of(g, in->x), y = Loc_Of(g, in->y), z = Loc_Of(g, in->z);
+  int commute = in->op != IR_SUB;
+  char a[32], b[32];
+  if (commute && y.kind == L_IMM) {
+    Loc t = y;
+    y = z, z = t;
+  }
+  int d = x.kind == L_REG ? x.v : RAX;
+  int k = in->op == IR_MUL && z.kind == L_IMM ? Pow2_Shift(z.v) : -1;
+  if (k > 0 && k <= 3 && y.kind == L_REG && y.v != d) {
+    // 乘2, 4, 8用lea的比例因子, 不必先复制
+    fprintf(g->fp, "  leal (,%s,%d), %s\n", r64[y.v], z.v, r32[d]);
+  } else if (k > 0 && y.kind != L_IMM) {
+    Mov_To(g, d, y);
+    fprintf(g->fp, "  shll $%d, %s\n", k, r32[d]);
+  } else if (in->op == IR_MUL && z.kind == L_IMM && y.kind != L_IMM) {
+    // 乘常量用三操作数的imull
+    fprintf(g->fp, "  imull %s, %s, %s\n", Text(z, a), Text(y, b), r32[d]);
+  } else if (in->op == IR_ADD && z.kind == L_IMM && y.kind == L_REG &&
+             y.v != d) {
+    fprintf(g->fp, "  leal %d(%s), %s\n", z.v, r64[y.v], r32[d]);
+  } else {
+    if (z.kind == L_REG && z.v == d && !(y.kind == L_REG && y.v == d)) {
+      if (commute) {
+        Loc t = y;
+        y = z, z = t;
+      } else
+        d = RAX;
+    }
+    Mov_To(g, d, y);
+    fprintf(g->fp, "  %s %s, %s\n", ops[in->op], Text(z, a), r32[d]);
+  }
+  Move_Loc(g, x, Reg(d));
+}
+
+// 除数为0是运行时错误; 为-1时直接取负, 避免INT_MIN / -1的异常
+static void Divide(X86* g, const Instr* in) {
+  Loc x = Loc_Of(g, in->x), y = Loc_Of(g, in->y), z = Loc_Of(g, in->z);
+  if (z.kind == L_IMM && !z.v) {
+    fprintf(g->fp, "  jmp cmm.div_zero\n");
+    return;
+  }
+  Mov_To(g, RCX, z);
+  Mov_To(g, RAX, y);
+  if (z.kind == L_IMM && z.v == -1)
+    fprintf(g->fp, "  negl %%eax\n");
+  else if (z.kind == L_IMM)
+    fprintf(g->fp, "  cltd\n  idivl %%ecx\n");
+  else {
+    int l = local_labels++;
+    fprintf(g->fp, "  testl %%ecx, %%ecx\n  je cmm.div_zero\n");
+    fprintf(g->fp, "  cmpl $-1, %%ecx\n  je .Lneg%d\n", l);
+    fprintf(g->fp, "  cltd\n  idivl %%ecx\n  jmp .Ldiv%d\n", l);
+    fprintf(g->fp, ".Lneg%d:\n  negl %%eax\n.Ldiv%d:\n", l, l);
+  }
+  Move_Loc(g, x, Reg(RAX));
+}
+
+static void Branch(X86* g, const Instr* in) {
+  Loc y = Loc_Of(g, in->y), z = Loc_Of(g, in->z);
+  int relop = in->relop;
+  char a[32], b[32];
+  if (y.kind == L_IMM && z.kind != L_IMM) {
+    Loc t = y;
+    y = z, z = t;
+    relop = swap_relop[relop];
+  }
+  if (y.kind == L_IMM || (y.kind == L_MEM && z.kind == L_MEM)) {
+    Mov_To(g, RAX, y);
+    y = Reg(RAX);
+  }
+  if (y.kind == L_REG && z.kind == L_IMM && !z.v)
+    fprintf(g->fp, "  testl %s, %s\n", r32[y.v], r32[y.v]);
+  else
+    fprintf(g->fp, "  cmpl %s, %s\n", Text(z, a), Text(y, b));
+  fprintf(g->fp, "  %s .L%d\n", jcc[relop], in->x.no);
+}
+
+// 在第i条指令的调用之后仍要用到的调用者保存寄存器
+static void Live_Across(const X86* g, int i, int* live) {
+  Operand* d = Instr_Def(&g->func->code[i]);
+  int x = d ? OpMap_Index(&g->m, *d) : -1, size = OpMap_Size(&g->m);
+  for (int r = 0; r < 16; r++) live[r] = 0;
+  for (int k = 0; k < size; k++)
+    if (k != x && g->home[k] >= 0 && !Callee_Saved(g->home[k]) &&
+        g->lo[k] < 2 * i + 1 && g->hi[k] > 2 * i + 1)
+      live[g->home[k]] = 1;
+}
+
+static void Save(X86* g, const int* live, int restore) {
+  for (int r = 0; r < 16; r++) {
+    if (!live[r]) continue;
+    if (restore)
+      fprintf(g->fp, "  movl %d(%%rbp), %s\n", g->save[r], r32[r]);
+    else
+      fprintf(g->fp, "  movl %s, %d(%%rbp)\n", r32[r], g->save[r]);
+  }
+}
+
+// 调用: 第7个起的实参放到栈上, 保存跨调用的寄存器后前6个实参就位
+static void Call(X86* g, int c) {
+  IRFunc* func = g->func;
+  char a[32];
+  int first = c;
+  while (first > 0 && func->code[first - 1].op == IR_ARG) first--;
+  int n = c - first;  // 最后一个ARG是第一个形参
+  int stack = n > 6 ? n - 6 : 0, bytes = 8 * (stack + (stack & 1));
+  if (bytes) fprintf(g->fp, "  subq $%d, %%rsp\n", bytes);
+  for (int p = 6; p < n; p++) {
+    Loc s = Loc_Of(g, func->code[c - 1 - p].x);
+    if (s.kind == L_MEM) {
+      Mov_To(g, RAX, s);
+      s = Reg(RAX);
+    }
+    fprintf(g->fp, "  movl %s, %d(%%rsp)\n", Text(s, a), 8 * (p - 6));
+  }
+  int live[16];
+  Live_Across(g, c, live);
+  Save(g, live, 0);
+  Move mv[6];
+  for (int p = 0; p < n && p < 6; p++)
+    mv[p] = (Move){arg_regs[p], Loc_Of(g, func->code[c - 1 - p].x)};
+  Parallel_Move(g, mv, n < 6 ? n : 6);
+  fprintf(g->fp, "  call cmm_%s\n", func->code[c].y.name);
+  if (bytes) fprintf(g->fp, "  addq $%d, %%rsp\n", bytes);
+  Save(g, live, 1);
+  Move_Loc(g, Loc_Of(g, func->code[c].x), Reg(RAX));
+}
+
+// DEC的区域清零
+static void Zero(X86* g, int off, int bytes) {
+  if (bytes <= 32) {
+    for (int b = 0; b < bytes; b += 4)
+      fprintf(g->fp, "  movl $0, %d(%%rbp)\n", off + b);
+    return;
+  }
+  int l = local_labels++;
+  fprintf(g->fp, "  leaq %d(%%rbp), %%rax\n  movl $%d, %%ecx\n", off, bytes / 4);
+  fprintf(g->fp, ".Lzero%d:\n  movl $0, -4(%%rax,%%rcx,4)\n", l);
+  fprintf(g->fp, "  decl %%ecx\n  jnz .Lzero%d\n", l);
+}
+
+static int Print_Func(FILE* fp, IRFunc* func) {
+  // ARG须连续地紧接CALL, PARAM须在函数开头
+  for (int i = 0, params = 1; i < func->len; i++) {
+    int op = func->code[i].op;
+    if ((op == IR_ARG && Call_Of(func, i) < 0) || (op == IR_PARAM && !params))
+      return 0;
+    if (op != IR_PARAM) params = 0;
+  }
+  X86 g = {.fp = fp, .func = func};
+  OpMap_Init(&g.m, func);
+  int size = OpMap_Size(&g.m), n = func->len;
+  g.taken = Func_AddrTaken(func, &g.m);
+  g.home = malloc((size + 1) * sizeof(int));
+  g.off = malloc((size + 1) * sizeof(int));
+  g.lo = malloc((size + 1) * sizeof(int));
+  g.hi = malloc((size + 1) * sizeof(int));
+  while (g.nparam < n && func->code[g.nparam].op == IR_PARAM) g.nparam++;
+
+  CFG* cfg = n ? CFG_Build(func) : NULL;
+  Liveness* lv = cfg ? Liveness_Build(cfg, &g.m, g.taken) : NULL;
+  if (lv) Live_Intervals(lv, g.lo, g.hi);
+  for (int k = 0; !lv && k < size; k++) g.hi[k] = -1;
+  Layout(&g);
+  Prologue(&g, lv);
+  if (lv) Liveness_Free(lv);
+  if (cfg) CFG_Free(cfg);
+
+  for (int i = g.nparam; i < n; i++) {
+    const Instr* in = &func->code[i];
+    switch (in->op) {
+      case IR_NOP:
+      case IR_ARG:  // 由CALL处理
+        break;
+      case IR_LABEL:
+        fprintf(fp, ".L%d:\n", in->x.no);
+        break;
+      case IR_ASSIGN:
+        Move_Loc(&g, Loc_Of(&g, in->x), Loc_Of(&g, in->y));
+        break;
+      case IR_ADD:
+      case IR_SUB:
+      case IR_MUL:
+        Binary(&g, in);
+        break;
+      case IR_DIV:
+        Divide(&g, in);
+        break;
+      case IR_ADDR: {
+        Loc x = Loc_Of(&g, in->x);
+        int d = x.kind == L_REG ? x.v : RAX;
+        fprintf(fp, "  leaq %d(%%rbp), %s\n", g.off[OpMap_Index(&g.m, in->y)],
+                r64[d]);
+        fprintf(fp, "  subq %%r15, %s\n", r64[d]);
+        Move_Loc(&g, x, Reg(d));
+        break;
+      }
+      case IR_LOAD: {
+        Loc x = Loc_Of(&g, in->x), y = Loc_Of(&g, in->y);
+        int idx = y.kind == L_REG ? y.v : RAX;
+        int d = x.kind == L_REG ? x.v : RAX;
+        Mov_To(&g, idx, y);
+        Check_Address(&g, idx);
+        fprintf(fp, "  movl (%%r15,%s), %s\n", r64[idx], r32[d]);
+        Move_Loc(&g, x, Reg(d));
+        break;
+      }
+      case IR_STORE: {
+        Loc x = Loc_Of(&g, in->x), y = Loc_Of(&g, in->y);
+        int idx = x.kind == L_REG ? x.v : RAX;
+        char b[32];
+        Mov_To(&g, idx, x);
+        Check_Address(&g, idx);
+        if (y.kind == L_MEM) {
+          Mov_To(&g, RCX, y);
+          y = Reg(RCX);
+        }
+        fprintf(fp, "  movl %s, (%%r15,%s)\n", Text(y, b), r64[idx]);
+        break;
+      }
+      case IR_GOTO:
+        fprintf(fp, "  jmp .L%d\n", in->x.no);
+        break;
+      case IR_IF:
+        Branch(&g, in);
+        break;
+      case IR_RETURN:
+        Mov_To(&g, RAX, Loc_Of(&g, in->x));
+        Epilogue(&g);
+        break;
+      case IR_DEC:
+        Zero(&g, g.off[OpMap_Index(&g.m, in->x)], (in->y.ival + 3) & ~3);
+        break;
+      case IR_CALL:
+        Call(&g, i);
+        break;
+      case IR_READ:
+      case IR_WRITE: {
+        int live[16];
+        Live_Across(&g, i, live);
+        Save(&g, live, 0);
+        if (in->op == IR_WRITE) Mov_To(&g, RDI, Loc_Of(&g, in->x));
+        fprintf(fp, "  call cmm.%s\n", in->op == IR_READ ? "read" : "write");
+        Save(&g, live, 1);
+        if (in->op == IR_READ) Move_Loc(&g, Loc_Of(&g, in->x), Reg(RAX));
+        break;
+      }
+      default:
+        assert(0);
+    }
+  }
+  // 执行到末尾返回0
+  int last = n ? func->code[n - 1].op : IR_NOP;
+  if (n == g.nparam || (last != IR_RETURN && last != IR_GOTO)) {
+    fprintf(fp, "  xorl %%eax, %%eax\n");
+    Epilogue(&g);
+  }
+
+  free(g.taken);
+  free(g.home);
+  free(g.off);
+  free(g.lo);
+  free(g.hi);
+  return 1;
+}
+
+int X86_Print(FILE* fp) {
+  fprintf(fp, "  .text\n");
+  local_labels = 0;
+  for (IRFunc* func = ctx->ir_funcs; func; func = func->next)
+    if (!Print_Func(fp, func)) {
+      fprintf(stderr, "x86: unsupported code in function %s\n", func->name);
+      return 1;
+    }
+  fputs(runtime, fp);
+  return 0;
+}
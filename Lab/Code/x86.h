@@ -0,0 +1,26 @@
+#ifndef X86_H
+#define X86_H
+
+#include "stdio.h"
+
+/*
+中间代码翻译为x86-64汇编(GAS, AT&T语法), 用cc链接成Linux可执行文件:
+-- 运行时也在输出中: C的main在mmap得到的1GB栈上调用C--的main,
+   READ, WRITE调用scanf, printf, 运行时错误输出后exit(1)
+-- 地址与解释器相同是32位整数, 为相对%r15的偏移, %r15在栈顶之下2GB处,
+   因此名字都是32位的, 访存为(%r15,reg)
+-- 访存前检查地址在活跃的帧中(当前帧的下界到栈顶之间), 与解释器相同,
+   否则为bad address
+-- 名字用线性扫描(RegAlloc_Linear)分配到rbx, r12-r14, r10, r11, rsi,
+   rdi, r8, r9, 溢出的和DEC的区域在%rbp下的帧中; 有调用的函数先用被
+   调用者保存的寄存器, 叶函数先用调用者保存的
+-- 调用约定同SysV: 按PARAM的顺序前6个实参在rdi, rsi, rdx, rcx, r8, r9,
+   其余在栈上, 返回值在eax; 跨调用仍活跃的调用者保存寄存器由调用者保存
+-- rax, rcx, rdx为临时寄存器
+-- C--的函数f的符号为cmm_f, 运行时的符号形如cmm.read, 不会冲突
+*/
+
+// 输出整个程序, 有不支持的形式时返回非零
+extern int X86_Print(FILE* fp);
+
+#endif